@@ -0,0 +1,13 @@
+#version 430 core
+
+// Gathers the AO computed on the deinterleaved layers back into screen order, each pixel
+// reading its layer for its position in the 4x4 block
+
+uniform sampler2DArray ao_layers;
+
+out vec2 ao_out;
+
+void main(void){
+	ivec2 px = ivec2(gl_FragCoord.xy);
+	ao_out = texelFetch(ao_layers, ivec3(px >> 2, (px.x & 3) + 4 * (px.y & 3)), 0).xy;
+}
@@ -1,53 +1,201 @@
 #version 430 core
 
 #include "global.glsl"
+#include "layered.glsl"
 
 #define FAR_PLANE -1000.f
+#define NEAR_PLANE -1.f
+// Adaptive sampling takes as many samples again where the standard error of the AO
+// estimate from the first set is above this
+#define AO_REFINE_ERROR 0.04
 
-uniform sampler2D camera_positions;
+// This shader is specialized by AOShaderCache which defines:
+// AO_N_SAMPLES: the number of samples taken per pixel
+// AO_MAX_SAMPLES: the size of the sample pattern table
+// AO_RENDERED_NORMALS: 1 to read the rendered normals instead of using the position derivatives
+// AO_OCTAHEDRAL_NORMALS: 1 if the normals are octahedral encoded in a two channel target
+// AO_ADAPTIVE: 1 to pick the sample count per pixel, with AO_N_SAMPLES as the most taken
+// AO_MULTI_SCALE: 1 to combine a few small sample sets taken at the radii in the params block,
+//                 with AO_N_SAMPLES as the most taken over all scales
+// AO_MAX_SCALES: the number of radii in the params block
+// AO_SAMPLE_HEATMAP: 1 to output the fraction of AO_N_SAMPLES taken instead of the AO
+// AO_DEINTERLEAVED: 1 to run on the 4x4 deinterleaved layers of the depth, drawn once per layer.
+//                   Layer x + 4y holds the pixels at (x, y) of each 4x4 block
+
+// The linear camera space depth pyramid, or its deinterleaved layers
+uniform layer_sampler camera_depth;
+#if AO_DEINTERLEAVED
+// The normals aren't deinterleaved, each pixel reads its own at full resolution
 uniform sampler2D camera_normals;
+#define fetch_normal(p) texelFetch(camera_normals, p, 0)
+#else
+uniform layer_sampler camera_normals;
+#define fetch_normal(p) fetch_layer(camera_normals, p, 0)
+#endif
+// log2 of the factor we're computing AO at below full resolution, we then treat
+// this level of the depth pyramid as the screen
+uniform int ao_level;
+// Rotation added to the per-pixel spiral, jittered each frame when accumulating AO over time
+uniform float phi_offset;
+
+// Each sample's unit offset on the unrotated spiral in xy and its fraction of the
+// screen space radius in z, filled by fill_ao_sample_pattern
+layout(std140, binding = 6) uniform AOSamplePattern {
+	vec4 ao_samples[AO_MAX_SAMPLES];
+};
 
 out vec2 ao_out;
 
+#if AO_DEINTERLEAVED
+// Position in the 4x4 block of the pixels held by this layer
+ivec2 deinterleave_offset(){
+	return ivec2(layer & 3, layer >> 2);
+}
+#endif
+
+// Compute the obscurance from sample i of the pattern, rotated and scaled to the pixel's sample ball.
+// The tap is read from the pyramid level picked by its distance, kept within [min_mip, max_mip]
+float ao_sample(int i, ivec2 px, vec3 pos, vec3 normal, vec2 rotation, float screen_radius, float scale,
+		int min_mip, int max_mip)
+{
+	vec4 s = ao_samples[i];
+	float h = screen_radius * s.z;
+	vec2 u = vec2(s.x * rotation.x - s.y * rotation.y, s.x * rotation.y + s.y * rotation.x);
+	ivec2 tap = ivec2(h * u) + px;
+#if AO_DEINTERLEAVED
+	// Snap the tap to the nearest pixel in this layer, all the layer's pixels share a rotation
+	// so neighbouring pixels read neighbouring texels without needing the pyramid
+	const ivec2 offset = deinterleave_offset();
+	ivec2 layer_pos = clamp((tap - offset + ivec2(2)) >> 2, ivec2(0), layer_size(camera_depth, 0) - ivec2(1));
+	tap = layer_pos * 4 + offset;
+	const float tap_depth = fetch_layer(camera_depth, layer_pos, 0).r;
+#else
+	int m = clamp(findMSB(int(h)) - 4, min_mip, max_mip);
+	ivec2 mip_pos = clamp(tap >> m, ivec2(0), layer_size(camera_depth, m + ao_level) - ivec2(1));
+	const float tap_depth = fetch_layer(camera_depth, mip_pos, m + ao_level).r;
+#endif
+	// Rebuild the tap's position at its full resolution screen position
+	vec3 q = reconstruct_position((vec2(tap) + vec2(0.5)) * scale, tap_depth);
+	vec3 v = q - pos;
+	// The original estimator in the paper, from Alchemy AO
+	// I tried getting their new recommended estimator running but couldn't get it to look nice,
+	// from taking a look at their AO shader it also looks like we compute this value quite differently
+	return max(0, dot(v, normal + pos.z * ao_params.beta)) / (dot(v, v) + 0.01);
+}
+
 void main(void){
-	vec3 pos = texture(camera_positions, gl_FragCoord.xy / viewport_dim).xyz;
-	vec3 normal;
-	if (ao_params.use_rendered_normals == 1){
-		normal = normalize(texture(camera_normals, gl_FragCoord.xy / viewport_dim).xyz);
+	const float scale = float(1 << ao_level);
+#if AO_DEINTERLEAVED
+	// px is the pixel's position on the screen at the AO resolution, as in the interleaved pass
+	ivec2 px = ivec2(gl_FragCoord.xy) * 4 + deinterleave_offset();
+	vec3 pos = reconstruct_position((vec2(px) + vec2(0.5)) * scale,
+			fetch_layer(camera_depth, ivec2(gl_FragCoord.xy), 0).r);
+#else
+	ivec2 px = ivec2(gl_FragCoord.xy);
+	vec3 pos = reconstruct_position(gl_FragCoord.xy * scale, fetch_layer(camera_depth, px, ao_level).r);
+#endif
+#if AO_RENDERED_NORMALS
+	ivec2 full_res_px = px << ao_level;
+#if AO_OCTAHEDRAL_NORMALS
+	vec3 normal = oct_decode(fetch_normal(full_res_px).xy);
+#else
+	vec3 normal = normalize(fetch_normal(full_res_px).xyz);
+#endif
+#else
+	// When deinterleaved the derivatives are across the pixels 4 apart in the layer
+	vec3 normal = normalize(cross(dFdx(pos), dFdy(pos)));
+#endif
+
+#if AO_DEINTERLEAVED
+	// One rotation per layer, stepping by the golden angle so the 16 in each block spread evenly
+	float phi = layer * 2.3999632 + phi_offset;
+#else
+	// The Alchemy AO hash for random per-pixel offset, which rotates the sample spiral
+	float phi = (3 * px.x ^ px.y + px.x * px.y) * 10 + phi_offset;
+#endif
+	vec2 rotation = vec2(cos(phi), sin(phi));
+	// The projection scale is the size in pixels of a 1m object at z = -1m, so the ball radius
+	// covers the same part of the scene at any resolution or aspect ratio
+	const float proj_scale = 0.5 * viewport_dim.y * proj[1][1];
+	const float screen_radius = -ao_params.ball_radius * proj_scale / (pos.z * scale);
+	int max_mip = textureQueryLevels(camera_depth) - 1 - ao_level;
+#if AO_MULTI_SCALE
+	float ao_value = 1;
+	int n_taken = 0;
+	if (pos.z <= NEAR_PLANE){
+		const int n_scales = clamp(ao_params.n_scales, 1, AO_MAX_SCALES);
+		const int k = clamp(ao_params.scale_samples, 1, max(AO_N_SAMPLES / n_scales, 1));
+		// Each scale only needs to resolve occluders around its own radius, so the larger scales
+		// start further up the pyramid where a texel covers about as much as the first scale's
+		// taps do at the bottom of theirs. This keeps the wide scales cheap and cache friendly
+		float obscurance = 0;
+		for (int s = 0; s < n_scales; ++s){
+			const float radius = ao_params.scale_radii[s];
+			const float scale_screen_radius = -radius * proj_scale / (pos.z * scale);
+			const int min_mip = clamp(int(log2(max(radius / ao_params.scale_radii[0], 1))), 0, max_mip);
+			float ao_sum = 0;
+			// Interleave the scales' samples so each covers the whole spiral
+			for (int i = 0; i < k; ++i){
+				ao_sum += ao_sample((i * n_scales + s) * AO_N_SAMPLES / (k * n_scales), px, pos, normal, rotation,
+						scale_screen_radius, scale, min_mip, max_mip);
+			}
+			// Take the strongest scale instead of summing them, an occluder within the small radius
+			// is also within the larger ones and would otherwise darken the pixel several times
+			obscurance = max(obscurance, 2.f * ao_params.sigma / k * ao_sum);
+		}
+		n_taken = k * n_scales;
+		ao_value = pow(max(0, 1.f - obscurance), ao_params.kappa);
 	}
-	else {
-		normal = normalize(cross(dFdx(pos), dFdy(pos)));
+#elif AO_ADAPTIVE
+	float ao_value = 1;
+	// Background pixels keep the prepass target's clear value, in front of the near plane,
+	// and are skipped. Derivatives aren't taken inside the branch so it's fine for it to diverge
+	int n_taken = 0;
+	if (pos.z <= NEAR_PLANE){
+		// Distant pixels' sample balls only cover a few texels, so fewer samples resolve them
+		const int min_samples = clamp(ao_params.min_samples, 1, AO_N_SAMPLES);
+		n_taken = clamp(int(ceil(AO_N_SAMPLES * screen_radius / ao_params.full_sample_radius)),
+				min_samples, AO_N_SAMPLES);
+		// Step through the pattern so the samples still cover the whole spiral
+		float ao_sum = 0;
+		float ao_sq_sum = 0;
+		for (int i = 0; i < n_taken; ++i){
+			const float a = ao_sample(i * AO_N_SAMPLES / n_taken, px, pos, normal, rotation, screen_radius,
+					scale, 0, max_mip);
+			ao_sum += a;
+			ao_sq_sum += a * a;
+		}
+		// If the estimate is still noisy take the samples halfway between those we took
+		const float mean = ao_sum / n_taken;
+		const float std_error = 2.f * ao_params.sigma * sqrt(max(ao_sq_sum / n_taken - mean * mean, 0) / n_taken);
+		if (2 * n_taken <= AO_N_SAMPLES && std_error > AO_REFINE_ERROR){
+			for (int i = 0; i < n_taken; ++i){
+				ao_sum += ao_sample((2 * i + 1) * AO_N_SAMPLES / (2 * n_taken), px, pos, normal, rotation,
+						screen_radius, scale, 0, max_mip);
+			}
+			n_taken *= 2;
+		}
+		ao_value = max(0, 1.f - 2.f * ao_params.sigma / n_taken * ao_sum);
+		ao_value = pow(ao_value, ao_params.kappa);
 	}
-
-	// The Alchemy AO hash for random per-pixel offset
-	ivec2 px = ivec2(gl_FragCoord.xy);
-	float phi = (3 * px.x ^ px.y + px.x * px.y) * 10;
-	const float TAU = 6.2831853071795864;
-	const float ball_radius_sqr = pow(ao_params.ball_radius, 2);
-	// What's the radius of a 1m object at z = -1m to compute screen_radius properly?
-	// Comments in their code mention we can compute it from the projection mat, or hardcode in like 500
-	// and make the ball radius resolution dependent (as I've done currently)
-	const float screen_radius = -ao_params.ball_radius * 3500 / pos.z;
-	int max_mip = textureQueryLevels(camera_positions) - 1;
+#else
+	const int n_taken = AO_N_SAMPLES;
 	float ao_value = 0;
-	for (int i = 0; i < ao_params.n_samples; ++i){
-		float alpha = 1.f / ao_params.n_samples * (i + 0.5);
-		float h = screen_radius * alpha;
-		float theta = TAU * alpha * ao_params.turns + phi;
-		vec2 u = vec2(cos(theta), sin(theta));
-		int m = clamp(findMSB(int(h)) - 4, 0, max_mip);
-		ivec2 mip_pos = clamp((ivec2(h * u) + px) >> m, ivec2(0), textureSize(camera_positions, m) - ivec2(1));
-		vec3 q = texelFetch(camera_positions, mip_pos, m).xyz;
-		vec3 v = q - pos;
-		// The original estimator in the paper, from Alchemy AO
-		// I tried getting their new recommended estimator running but couldn't get it to look nice,
-		// from taking a look at their AO shader it also looks like we compute this value quite differently
-		ao_value += max(0, dot(v, normal + pos.z * ao_params.beta)) / (dot(v, v) + 0.01);
+	for (int i = 0; i < AO_N_SAMPLES; ++i){
+		ao_value += ao_sample(i, px, pos, normal, rotation, screen_radius, scale, 0, max_mip);
 	}
 	// The original method in paper, from Alchemy AO
-	ao_value = max(0, 1.f - 2.f * ao_params.sigma / ao_params.n_samples * ao_value);
+	ao_value = max(0, 1.f - 2.f * ao_params.sigma / AO_N_SAMPLES * ao_value);
 	ao_value = pow(ao_value, ao_params.kappa);
+#endif
 
+#if AO_SAMPLE_HEATMAP
+	ao_out = vec2(float(n_taken) / AO_N_SAMPLES, clamp(pos.z / FAR_PLANE, 0, 1));
+#elif AO_DEINTERLEAVED
+	// Neighbouring fragments are 4 pixels apart in the layers, so the 2x2 filtering below
+	// is left to the blur after the layers are gathered back together
+	ao_out = clamp(vec2(ao_value, pos.z / FAR_PLANE), vec2(0), vec2(1));
+#else
     // Do a little bit of filtering now, respecting depth edges
     if (abs(dFdx(pos.z)) < 0.02) {
         ao_value -= dFdx(ao_value) * ((px.x & 1) - 0.5);
@@ -55,6 +203,8 @@ void main(void){
     if (abs(dFdy(pos.z)) < 0.02) {
         ao_value -= dFdy(ao_value) * ((px.y & 1) - 0.5);
     }
-	ao_out = vec2(ao_value, pos.z / FAR_PLANE);
+	// Both values are in [0, 1] so the target can be a normalized format, clamp
+	// so the same values go in to a float target
+	ao_out = clamp(vec2(ao_value, pos.z / FAR_PLANE), vec2(0), vec2(1));
+#endif
 }
-
@@ -0,0 +1,46 @@
+#version 430 core
+
+#include "global.glsl"
+
+#define FAR_PLANE -1000.f
+
+// This frame's noisy AO values and depth keys
+uniform sampler2D ao_in;
+// The AO accumulated up to the previous frame
+uniform sampler2D history;
+// Transforms this frame's camera space positions to the previous frame's camera space
+uniform mat4 reproject;
+// log2 of the factor the AO is computed at below full resolution
+uniform int ao_level;
+// False if the history is from a different resolution or there is none yet
+uniform bool history_valid;
+// Weight of the new frame when blending with the history
+uniform float blend;
+
+out vec2 result;
+
+void main(void){
+	ivec2 px = ivec2(gl_FragCoord.xy);
+	vec2 current = texelFetch(ao_in, px, 0).xy;
+	float z = current.y * FAR_PLANE;
+	result = current;
+	if (!history_valid || z >= 0){
+		return;
+	}
+	// Find where this pixel's surface was on screen last frame
+	const float scale = float(1 << ao_level);
+	vec4 prev_pos = reproject * vec4(reconstruct_position(gl_FragCoord.xy * scale, z), 1);
+	vec4 prev_clip = proj * prev_pos;
+	vec2 prev_px = (prev_clip.xy / prev_clip.w * 0.5 + vec2(0.5)) * viewport_dim / scale;
+	if (prev_clip.w <= 0 || any(lessThan(prev_px, vec2(0))) || any(greaterThanEqual(prev_px, vec2(textureSize(history, 0))))){
+		return;
+	}
+	vec2 prev = texelFetch(history, ivec2(prev_px), 0).xy;
+	// Reject the history if it's from a different surface, e.g. one that was
+	// disoccluded by the camera moving
+	if (abs(prev.y * FAR_PLANE - prev_pos.z) > 0.02 * abs(prev_pos.z)){
+		return;
+	}
+	result.x = mix(prev.x, current.x, blend);
+}
+
@@ -0,0 +1,39 @@
+#version 430 core
+
+#include "global.glsl"
+
+#define FAR_PLANE -1000.f
+
+// The reduced resolution AO values and depth keys
+uniform sampler2D ao_in;
+// The full resolution linear depth
+uniform sampler2D camera_depth;
+// log2 of the factor the AO was computed at below full resolution
+uniform int ao_level;
+
+out vec2 result;
+
+// Joint bilateral upsample of the reduced resolution AO: the bilinear weights of the four
+// nearest low resolution texels are scaled by how close their depth is to the depth of the
+// pixel we're filling in, so AO doesn't bleed across depth edges
+void main(void){
+	ivec2 px = ivec2(gl_FragCoord.xy);
+	float z_key = texelFetch(camera_depth, px, 0).r / FAR_PLANE;
+	vec2 low_res_pos = gl_FragCoord.xy / float(1 << ao_level) - vec2(0.5);
+	ivec2 base = ivec2(floor(low_res_pos));
+	vec2 f = low_res_pos - vec2(base);
+	ivec2 max_px = textureSize(ao_in, 0) - ivec2(1);
+
+	float sum = 0;
+	float weight = 0;
+	for (int i = 0; i < 4; ++i){
+		ivec2 offset = ivec2(i & 1, i >> 1);
+		vec2 val = texelFetch(ao_in, clamp(base + offset, ivec2(0), max_px), 0).xy;
+		vec2 bilinear = mix(vec2(1) - f, f, vec2(offset));
+		float w = bilinear.x * bilinear.y / (0.0001 + abs(z_key - val.y));
+		sum += val.x * w;
+		weight += w;
+	}
+	result = vec2(sum / weight, z_key);
+}
+
@@ -0,0 +1,62 @@
+#version 430 core
+
+#include "global.glsl"
+
+// BATCH_VIEWS is defined by BatchAO as the number of views rendered per batch, each
+// invocation renders the triangle for one view into its layer of the targets
+layout(triangles, invocations = BATCH_VIEWS) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+layout(std140, binding = 3) uniform BatchViews {
+	mat4 batch_view[BATCH_VIEWS];
+	mat4 batch_inv_trans_view[BATCH_VIEWS];
+};
+// The last batch may not fill all the layers
+uniform int num_views;
+
+in BatchVertex {
+	vec3 world_pos;
+	vec3 normal;
+	vec2 texcoord;
+	flat uint mat_id;
+} vert_data[];
+
+out PrepassData {
+	float cam_space_depth;
+	vec3 cam_normal;
+	vec2 texcoord;
+	flat uint mat_id;
+} geom_data;
+
+void main(void){
+	const int v = gl_InvocationID;
+	if (v >= num_views){
+		return;
+	}
+	vec4 cam_pos[3];
+	vec4 clip_pos[3];
+	for (int i = 0; i < 3; ++i){
+		cam_pos[i] = batch_view[v] * vec4(vert_data[i].world_pos, 1);
+		clip_pos[i] = proj * cam_pos[i];
+	}
+	// Most of the scene is outside any one view, so drop triangles entirely outside
+	// one of its clip planes here instead of sending them on to be clipped
+	for (int c = 0; c < 3; ++c){
+		if ((clip_pos[0][c] < -clip_pos[0].w && clip_pos[1][c] < -clip_pos[1].w && clip_pos[2][c] < -clip_pos[2].w)
+				|| (clip_pos[0][c] > clip_pos[0].w && clip_pos[1][c] > clip_pos[1].w && clip_pos[2][c] > clip_pos[2].w))
+		{
+			return;
+		}
+	}
+	for (int i = 0; i < 3; ++i){
+		geom_data.cam_space_depth = cam_pos[i].z;
+		geom_data.cam_normal = (batch_inv_trans_view[v] * vec4(vert_data[i].normal, 0)).xyz;
+		geom_data.texcoord = vert_data[i].texcoord;
+		geom_data.mat_id = vert_data[i].mat_id;
+		gl_Position = clip_pos[i];
+		gl_Layer = v;
+		EmitVertex();
+	}
+	EndPrimitive();
+}
+
@@ -0,0 +1,22 @@
+#version 430 core
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 texcoord;
+layout(location = 3) in uint mat_id;
+
+// Vertices stay in world space, batch_prepass_geom.glsl transforms them by each view
+out BatchVertex {
+	vec3 world_pos;
+	vec3 normal;
+	vec2 texcoord;
+	flat uint mat_id;
+} vert_data;
+
+void main(void){
+	vert_data.world_pos = pos * 0.25;
+	vert_data.normal = normal;
+	vert_data.texcoord = texcoord;
+	vert_data.mat_id = mat_id;
+}
+
@@ -0,0 +1,105 @@
+#version 430 core
+
+#define RADIUS 4
+// Width and height of the tile of pixels blurred by each work group
+#define TILE 16
+// The largest filter scale we have room for in shared memory, larger scales
+// fall back to the fragment shader blur
+#define MAX_FILTER_SCALE 4
+#define MAX_REGION (TILE + 2 * RADIUS * MAX_FILTER_SCALE)
+
+#include "global.glsl"
+
+layout(local_size_x = TILE, local_size_y = TILE) in;
+
+// Gaussian filter values from the author's blurring shader
+const float gaussian[RADIUS + 1] = float[](0.153170, 0.144893, 0.122649, 0.092902, 0.062970);
+
+uniform sampler2D ao_in;
+layout(binding = 0) writeonly uniform image2D ao_out;
+
+// The AO values and depth keys of the tile and the apron around it covered by the filter
+shared float region_ao[MAX_REGION][MAX_REGION];
+shared float region_z[MAX_REGION][MAX_REGION];
+// The result of blurring the region along y, for the rows of the tile
+shared float col_blur_ao[TILE][MAX_REGION];
+shared float col_blur_z[TILE][MAX_REGION];
+
+// Weight of a filter tap at offset i with depth key z from a pixel with depth key z_pos,
+// matching blur_frag.glsl
+float tap_weight(int i, float z_pos, float z){
+	return (0.3 + gaussian[abs(i)]) * max(0.f, 1.f - (ao_params.edge_sharpness * 400.f) * abs(z_pos - z));
+}
+
+// Blurs both axes of the AO in one dispatch, the tile and its apron are read once into
+// shared memory and the result of the first axis stays there for the second instead of
+// going through an intermediate render target
+void main(void){
+	int scale = ao_params.filter_scale;
+	int apron = RADIUS * scale;
+	int region = TILE + 2 * apron;
+	int n_threads = TILE * TILE;
+	int thread = int(gl_LocalInvocationIndex);
+	ivec2 size = textureSize(ao_in, 0);
+	ivec2 tile_start = ivec2(gl_WorkGroupID.xy) * TILE;
+	ivec2 region_start = tile_start - ivec2(apron);
+
+	// Fetches outside the image read zero like texelFetch with robust access in the fragment path
+	for (int i = thread; i < region * region; i += n_threads){
+		ivec2 p = ivec2(i % region, i / region);
+		ivec2 src = region_start + p;
+		vec2 val = vec2(0);
+		if (all(greaterThanEqual(src, ivec2(0))) && all(lessThan(src, size))){
+			val = texelFetch(ao_in, src, 0).xy;
+		}
+		region_ao[p.y][p.x] = val.x;
+		region_z[p.y][p.x] = val.y;
+	}
+	barrier();
+
+	// Blur along y for each column of the region in the tile's rows. Columns outside
+	// the image are left zero as the intermediate target would read in the fragment path
+	for (int i = thread; i < TILE * region; i += n_threads){
+		ivec2 p = ivec2(i % region, i / region);
+		int src_x = region_start.x + p.x;
+		if (src_x < 0 || src_x >= size.x){
+			col_blur_ao[p.y][p.x] = 0.f;
+			col_blur_z[p.y][p.x] = 0.f;
+			continue;
+		}
+		int y = p.y + apron;
+		float z_pos = region_z[y][p.x];
+		float weight = gaussian[0];
+		float sum = weight * region_ao[y][p.x];
+		for (int k = -RADIUS; k <= RADIUS; ++k){
+			if (k != 0){
+				float w = tap_weight(k, z_pos, region_z[y + k * scale][p.x]);
+				sum += region_ao[y + k * scale][p.x] * w;
+				weight += w;
+			}
+		}
+		col_blur_ao[p.y][p.x] = sum / (weight + 0.0001);
+		col_blur_z[p.y][p.x] = z_pos;
+	}
+	barrier();
+
+	// Blur along x for the tile's pixels
+	ivec2 p = ivec2(gl_LocalInvocationID.xy);
+	ivec2 out_px = tile_start + p;
+	if (any(greaterThanEqual(out_px, size))){
+		return;
+	}
+	int x = p.x + apron;
+	float z_pos = col_blur_z[p.y][x];
+	float weight = gaussian[0];
+	float sum = weight * col_blur_ao[p.y][x];
+	for (int k = -RADIUS; k <= RADIUS; ++k){
+		if (k != 0){
+			float w = tap_weight(k, z_pos, col_blur_z[p.y][x + k * scale]);
+			sum += col_blur_ao[p.y][x + k * scale] * w;
+			weight += w;
+		}
+	}
+	imageStore(ao_out, out_px, vec4(sum / (weight + 0.0001), z_pos, 0, 0));
+}
+
@@ -5,11 +5,12 @@
 #define RADIUS 4
 
 #include "global.glsl"
+#include "layered.glsl"
 
 // Gaussian filter values from the author's blurring shader
 const float gaussian[RADIUS + 1] = float[](0.153170, 0.144893, 0.122649, 0.092902, 0.062970);
 
-uniform sampler2D ao_in;
+uniform layer_sampler ao_in;
 // True if we're blurring vertically, false if horizontally since we
 // do the blurring in two passes, once for horizontal and once for vertical
 uniform ivec2 axis;
@@ -18,7 +19,9 @@ out vec2 result;
 
 void main(void){
 	ivec2 px = ivec2(gl_FragCoord.xy);
-	vec3 val = texelFetch(ao_in, px, 0).xyz;
+	// The AO value and depth key, which may be stored in 16 bit normalized
+	// channels. The depth key quantizes to ~1.5cm steps which is fine for the edge test
+	vec2 val = fetch_layer(ao_in, px, 0).xy;
 	float z_pos = val.y;
 
 	// Compute weighting for the term at the center of the kernel
@@ -31,7 +34,7 @@ void main(void){
 		if (i != 0){
 			// Filter scale effects how many pixels the kernel actually covers
 			ivec2 p = px + axis * i * ao_params.filter_scale;
-			vec3 val = texelFetch(ao_in, p, 0).xyz;
+			vec2 val = fetch_layer(ao_in, p, 0).xy;
 			float z = val.y;
 			float w = 0.3 + gaussian[abs(i)];
 			// Decrease weight as depth difference increases. This prevents us from
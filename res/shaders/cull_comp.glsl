@@ -0,0 +1,84 @@
+#version 430 core
+
+#include "global.glsl"
+
+layout(local_size_x = 64) in;
+
+// Matches glt::DrawElemsIndirectCmd
+struct DrawCmd {
+	uint count;
+	uint instance_count;
+	uint first_index;
+	uint base_vertex;
+	uint base_instance;
+};
+
+// World space bounds of each draw's geometry, w is unused
+struct Bounds {
+	vec4 lower;
+	vec4 upper;
+};
+
+layout(std430, binding = 7) readonly buffer DrawBounds {
+	Bounds bounds[];
+};
+layout(std430, binding = 8) readonly buffer DrawCmds {
+	DrawCmd cmds[];
+};
+layout(std430, binding = 9) writeonly buffer CulledCmds {
+	DrawCmd culled[];
+};
+// The number of draws and triangles which passed, the draw count is read by
+// glMultiDrawElementsIndirectCount
+layout(std430, binding = 10) buffer CullCounters {
+	uint draw_count;
+	uint triangle_count;
+};
+
+uniform uint num_draws;
+// If the visible draws should be packed at the start of culled, otherwise the draws
+// keep their place and culled ones get an instance count of 0
+uniform bool compact;
+
+// Check if the box is entirely outside one of the clip planes
+bool outside_frustum(vec3 lower, vec3 upper){
+	mat4 view_proj = proj * view;
+	// Count the corners outside each plane, the box is culled if they all are
+	ivec3 n_low = ivec3(0);
+	ivec3 n_high = ivec3(0);
+	for (int i = 0; i < 8; ++i){
+		vec3 corner = vec3((i & 1) != 0 ? upper.x : lower.x, (i & 2) != 0 ? upper.y : lower.y,
+				(i & 4) != 0 ? upper.z : lower.z);
+		vec4 p = view_proj * vec4(corner, 1);
+		n_low += ivec3(lessThan(p.xyz, vec3(-p.w)));
+		n_high += ivec3(greaterThan(p.xyz, vec3(p.w)));
+	}
+	return any(equal(n_low, ivec3(8))) || any(equal(n_high, ivec3(8)));
+}
+
+void main(void){
+	uint i = gl_GlobalInvocationID.x;
+	if (i >= num_draws){
+		return;
+	}
+	DrawCmd cmd = cmds[i];
+	bool visible = !outside_frustum(bounds[i].lower.xyz, bounds[i].upper.xyz);
+	if (visible){
+		atomicAdd(triangle_count, cmd.count / 3 * cmd.instance_count);
+	}
+	if (compact){
+		if (visible){
+			culled[atomicAdd(draw_count, 1)] = cmd;
+		}
+	}
+	else {
+		if (!visible){
+			cmd.instance_count = 0;
+		}
+		else {
+			atomicAdd(draw_count, 1);
+		}
+		culled[i] = cmd;
+	}
+}
+
@@ -0,0 +1,18 @@
+#version 430 core
+
+// Splits a level of the linear depth pyramid into 16 quarter resolution layers for the
+// deinterleaved AO pass, layer x + 4y holding the pixels at (x, y) of each 4x4 block.
+// Drawn once per layer, rendering to the layer passed
+
+uniform int layer;
+
+uniform sampler2D depth_in;
+uniform int level;
+
+out float depth;
+
+void main(void){
+	ivec2 px = ivec2(gl_FragCoord.xy) * 4 + ivec2(layer & 3, layer >> 2);
+	// The layers are rounded up to cover the screen, their last texels repeat the edge
+	depth = texelFetch(depth_in, min(px, textureSize(depth_in, level) - ivec2(1)), level).r;
+}
@@ -0,0 +1,19 @@
+#version 430 core
+
+// Builds one level of the linear depth pyramid from the level above it. The texture's base
+// level is set to the previous level while rendering so we don't read the level being written
+
+#include "layered.glsl"
+
+uniform layer_sampler depth_in;
+
+out float depth;
+
+void main(void){
+	ivec2 px = ivec2(gl_FragCoord.xy);
+	// Take one of the 2x2 texels on a rotated grid instead of averaging them, as in the
+	// SAO paper, so depths aren't blended across edges and each level keeps real surfaces
+	ivec2 p = clamp(px * 2 + ivec2(px.y & 1, px.x & 1), ivec2(0), layer_size(depth_in, 0) - ivec2(1));
+	depth = fetch_layer(depth_in, p, 0).r;
+}
+
@@ -4,18 +4,21 @@
 
 uniform sampler2D ao_texture;
 uniform bool ao_only;
+// Show the fraction of the AO samples taken at each pixel, which the AO pass wrote in place of the AO
+uniform bool sample_heatmap;
+// Multiply the screen space AO by the far field AO baked at the vertices
+uniform bool baked_ao_enabled;
 
 layout(location = 0) out vec4 color;
-layout(location = 1) out vec3 cam_normal;
 
 in VertexData {
 	vec3 world_pos;
-	vec3 cam_space_pos;
 	vec3 normal;
 	vec2 texcoord;
 	vec3 tangent;
 	vec3 bitangent;
 	flat uint mat_id;
+	float baked_ao;
 } frag_data;
 
 // Transform a vector from shading space to object space
@@ -25,9 +28,22 @@ vec3 from_shading(vec3 v){
 			frag_data.bitangent.z * v.x + frag_data.tangent.z * v.y + frag_data.normal.z * v.z);
 }
 
+// Map t in [0, 1] to a blue to green to red ramp
+vec3 heatmap(float t){
+	return clamp(vec3(2 * t - 1, 1 - abs(2 * t - 1), 1 - 2 * t), vec3(0), vec3(1));
+}
+
 void main(void){
-	if (ao_only && !depth_pass){
-		color = vec4(texture(ao_texture, gl_FragCoord.xy / viewport_dim).rrr, 1);
+	if (sample_heatmap){
+		color = vec4(heatmap(texture(ao_texture, gl_FragCoord.xy / viewport_dim).r), 1);
+		return;
+	}
+	float ao = texture(ao_texture, gl_FragCoord.xy / viewport_dim).r;
+	if (baked_ao_enabled){
+		ao *= frag_data.baked_ao;
+	}
+	if (ao_only){
+		color = vec4(vec3(ao), 1);
 		return;
 	}
 	vec3 view_dir = normalize(cam_pos - frag_data.world_pos);
@@ -49,12 +65,6 @@ void main(void){
 		normal = normalize(from_shading(normal));
 	}
 
-	if (depth_pass){
-		cam_normal = (inv_trans_view * vec4(normal, 0)).xyz;
-		color = vec4(frag_data.cam_space_pos, 1);
-		return;
-	}
-
 	if (mats[frag_data.mat_id].map_ka_kd.xy != ivec2(-1, -1)){
 		ka = texture(model_textures[mats[frag_data.mat_id].map_ka_kd.x],
 				vec3(frag_data.texcoord, mats[frag_data.mat_id].map_ka_kd.y));
@@ -68,7 +78,6 @@ void main(void){
 				vec3(frag_data.texcoord, mats[frag_data.mat_id].map_ks_n.y)).r;
 	}
 
-	float ao = texture(ao_texture, gl_FragCoord.xy / viewport_dim).r;
 	vec3 linear_col = ambient_light * ka.rgb * ao;
 	vec3 half_vec = normalize(light_dir.xyz + view_dir);
 	float light_power = light_dir.a;
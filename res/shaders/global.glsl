@@ -1,7 +1,5 @@
 // Just having some hardcoded light properties for now
 const vec3 ambient_light = vec3(0.2);
-// If we're doing a depth only pass
-uniform bool depth_pass;
 
 layout(std140, binding = 0) uniform Viewing {
 	mat4 proj, view, inv_trans_view;
@@ -11,6 +9,29 @@ layout(std140, binding = 0) uniform Viewing {
 	vec2 viewport_dim;
 };
 
+// Octahedral encoding of unit vectors into [-1, 1]^2, the normals are stored
+// like this in a two channel target when using the compact G-buffer formats
+vec2 oct_encode(vec3 n){
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	if (n.z < 0){
+		n.xy = (vec2(1) - abs(n.yx)) * vec2(n.x >= 0 ? 1 : -1, n.y >= 0 ? 1 : -1);
+	}
+	return n.xy;
+}
+vec3 oct_decode(vec2 e){
+	vec3 n = vec3(e, 1 - abs(e.x) - abs(e.y));
+	if (n.z < 0){
+		n.xy = (vec2(1) - abs(e.yx)) * vec2(e.x >= 0 ? 1 : -1, e.y >= 0 ? 1 : -1);
+	}
+	return normalize(n);
+}
+
+// Reconstruct the camera space position of the pixel at window position px with linear depth z
+vec3 reconstruct_position(vec2 px, float z){
+	vec2 ndc = px / viewport_dim * 2.f - vec2(1);
+	return vec3(-z * (ndc + vec2(proj[2][0], proj[2][1])) / vec2(proj[0][0], proj[1][1]), z);
+}
+
 layout(std140, binding = 2) uniform ShadowView {
 	mat4 cube_view[6];
 	mat4 cube_proj;
@@ -45,5 +66,14 @@ layout(std140, binding = 5) uniform AOTweakParams {
 	// Parameters for the blurring pass
 	int filter_scale;
 	float edge_sharpness;
+	// Parameters for adaptive sampling
+	int adaptive_samples;
+	int min_samples;
+	float full_sample_radius;
+	// Parameters for multi-scale AO, the radii are in camera space like the ball radius
+	int multi_scale;
+	int n_scales;
+	int scale_samples;
+	vec4 scale_radii;
 } ao_params;
 
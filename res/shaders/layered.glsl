@@ -0,0 +1,23 @@
+// Full screen passes compiled with LAYERED defined to 1 run over every layer of the batch
+// renderer's 2D array targets, with layered_quad_geom.glsl routing each instance of the quad
+// to its layer. These wrap the texture reads so the same shader can read either kind of target.
+// With LAYER_UNIFORM defined to 1 each layer is drawn on its own and the layer is a uniform
+#ifndef LAYERED
+#define LAYERED 0
+#endif
+
+#if LAYERED
+#define layer_sampler sampler2DArray
+#if LAYER_UNIFORM
+uniform int layer;
+#else
+flat in int layer;
+#endif
+#define fetch_layer(tex, p, lod) texelFetch(tex, ivec3(p, layer), lod)
+#define layer_size(tex, lod) textureSize(tex, lod).xy
+#else
+#define layer_sampler sampler2D
+#define fetch_layer(tex, p, lod) texelFetch(tex, p, lod)
+#define layer_size(tex, lod) textureSize(tex, lod)
+#endif
+
@@ -0,0 +1,20 @@
+#version 430 core
+
+// Send each instance of the full screen quad to its layer of the target
+layout(triangles) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+flat in int instance_layer[];
+
+flat out int layer;
+
+void main(void){
+	for (int i = 0; i < 3; ++i){
+		gl_Position = gl_in[i].gl_Position;
+		gl_Layer = instance_layer[0];
+		layer = instance_layer[0];
+		EmitVertex();
+	}
+	EndPrimitive();
+}
+
@@ -0,0 +1,17 @@
+#version 430 core
+
+// The full screen quad of ao_sample_vert.glsl, drawn with an instance per layer of the target
+const vec4 pos[4] = vec4[4](
+	vec4(-1, 1, 0.5, 1),
+	vec4(-1, -1, 0.5, 1),
+	vec4(1, 1, 0.5, 1),
+	vec4(1, -1, 0.5, 1)
+);
+
+flat out int instance_layer;
+
+void main(void){
+	gl_Position = pos[gl_VertexID];
+	instance_layer = gl_InstanceID;
+}
+
@@ -0,0 +1,32 @@
+#version 430 core
+
+#include "global.glsl"
+
+// If the normals target is two channel and needs octahedral encoded normals
+uniform bool octahedral_normals;
+
+// Only the linear depth is kept, the AO pass rebuilds positions from it
+layout(location = 0) out float cam_space_depth;
+layout(location = 1) out vec3 cam_normal;
+
+in PrepassData {
+	float cam_space_depth;
+	vec3 cam_normal;
+	vec2 texcoord;
+	flat uint mat_id;
+} frag_data;
+
+void main(void){
+	// The alpha mask is the only material property that affects the depth
+	ivec4 map_mask = mats[frag_data.mat_id].map_mask;
+	if (map_mask.xy != ivec2(-1, -1)
+			&& texture(model_textures[map_mask.x], vec3(frag_data.texcoord, map_mask.y)).r == 0){
+		discard;
+	}
+	cam_normal = normalize(frag_data.cam_normal);
+	if (octahedral_normals){
+		cam_normal = vec3(oct_encode(cam_normal), 0);
+	}
+	cam_space_depth = frag_data.cam_space_depth;
+}
+
@@ -0,0 +1,29 @@
+#version 430 core
+
+#include "global.glsl"
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 texcoord;
+layout(location = 3) in uint mat_id;
+
+// The shading pass tests against the depth written here with GL_EQUAL, so the position
+// must come out exactly as it does in vert.glsl
+invariant gl_Position;
+
+out PrepassData {
+	float cam_space_depth;
+	vec3 cam_normal;
+	vec2 texcoord;
+	flat uint mat_id;
+} vert_data;
+
+void main(void){
+	vert_data.cam_normal = (inv_trans_view * vec4(normal, 0)).xyz;
+	vert_data.texcoord = texcoord;
+	vert_data.mat_id = mat_id;
+	vec4 p = view * vec4(pos * 0.25, 1);
+	vert_data.cam_space_depth = p.z;
+	gl_Position = proj * p;
+}
+
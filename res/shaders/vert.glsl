@@ -6,24 +6,37 @@ layout(location = 0) in vec3 pos;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 texcoord;
 layout(location = 3) in uint mat_id;
+// Tangent along increasing s with the handedness of the frame in w, computed at load
+layout(location = 4) in vec4 tangent;
+// Far field AO baked by ao_bake, 1 if the model has no bake
+layout(location = 5) in float baked_ao;
+
+// Must match prepass_vert.glsl's position exactly for the depth equal test
+invariant gl_Position;
 
 out VertexData {
-	vec3 obj_pos;
 	vec3 world_pos;
-	vec3 cam_space_pos;
 	vec3 normal;
 	vec2 texcoord;
+	vec3 tangent;
+	vec3 bitangent;
 	flat uint mat_id;
+	float baked_ao;
 } vert_data;
 
 void main(void){
-	vert_data.obj_pos = pos;
+	vec3 n = normalize(normal);
+	vec3 t = normalize(tangent.xyz - n * dot(n, tangent.xyz));
 	vert_data.world_pos = pos;
-	vert_data.normal = normalize(normal);
+	vert_data.normal = n;
 	vert_data.texcoord = texcoord;
 	vert_data.mat_id = mat_id;
+	vert_data.baked_ao = baked_ao;
+	// The shading frame's x axis is passed as the bitangent and its y axis as the tangent,
+	// pointing along decreasing t
+	vert_data.bitangent = t;
+	vert_data.tangent = -tangent.w * cross(n, t);
 	vec4 p = view * vec4(pos * 0.25, 1);
-	vert_data.cam_space_pos = p.xyz;
 	gl_Position = proj * p;
 }
 
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include "glt/gl_core_4_5.h"
+#include "glt/buffer_allocator.h"
+#include "glt/load_models.h"
+#include "headless.h"
+#include "scene_cache.h"
+#include "obj_loader.h"
+#include "obj_upload.h"
+#include "model_geometry.h"
+#include "bvh.h"
+#include "vertex_ao.h"
+
+/*
+ * Bake per-vertex ambient occlusion for a model by ray tracing it on the CPU, the renderer
+ * picks up the bake and combines it with the screen space AO. The model is loaded the same
+ * way the renderer loads it, from the scene cache if there is one or through the loader picked
+ * otherwise, so the vertices are in the same order. The loaders upload the model as they go
+ * so we read it back from a headless context
+ */
+int main(int argc, char **argv){
+	if (argc < 2){
+		std::cout << "Usage: ./ao_bake <model.obj> [--rays N] [--near D] [--far D] [--threads N] [--loader glt|parallel]"
+			<< " [--out out.aobake]\n"
+			<< "Distances are in the model's units, far defaults to a tenth of the model's bounding box diagonal."
+			<< " The output defaults to the model's path with a .aobake extension, which the renderer picks up"
+			<< " automatically\n";
+		return 1;
+	}
+	const std::string model_file = argv[1];
+	std::string bake_file = vertex_ao_path(model_file);
+	VertexAOParams params{256, 0.f, 0.f};
+	int threads = 0;
+	bool parallel_loader = true;
+	for (int i = 2; i < argc; ++i){
+		const std::string arg = argv[i];
+		if (i + 1 >= argc){
+			std::cout << "Missing value for argument " << arg << "\n";
+			return 1;
+		}
+		if (arg == "--rays"){
+			params.rays = std::max(std::stoi(argv[++i]), 1);
+		}
+		else if (arg == "--near"){
+			params.near = std::max(std::stof(argv[++i]), 0.f);
+		}
+		else if (arg == "--far"){
+			params.far = std::stof(argv[++i]);
+		}
+		else if (arg == "--threads"){
+			threads = std::max(std::stoi(argv[++i]), 0);
+		}
+		else if (arg == "--loader"){
+			const std::string loader = argv[++i];
+			if (loader != "glt" && loader != "parallel"){
+				std::cout << "Invalid loader " << loader << ", expected glt or parallel\n";
+				return 1;
+			}
+			parallel_loader = loader == "parallel";
+		}
+		else if (arg == "--out"){
+			bake_file = argv[++i];
+		}
+		else {
+			std::cout << "Unrecognized argument " << arg << "\n";
+			return 1;
+		}
+	}
+
+	HeadlessContext ctx;
+	if (!create_headless_context(ctx)){
+		return 1;
+	}
+	if (ogl_LoadFunctions() == ogl_LOAD_FAILED){
+		std::cout << "ogl load failed" << std::endl;
+		destroy_headless_context(ctx);
+		return 1;
+	}
+
+	int ret = 0;
+	{
+		GLuint vao;
+		glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+		glt::BufferAllocator allocator{static_cast<size_t>(128e6)};
+		glt::SubBuffer vert_buf, elem_buf, mat_buf;
+		std::unordered_map<std::string, glt::ModelMatInfo> model_info;
+		glt::OBJTextures textures;
+
+		bool loaded = load_scene_cache(scene_cache_path(model_file), allocator, vert_buf, elem_buf, mat_buf,
+				textures, model_info);
+		if (!loaded && parallel_loader){
+			ObjModel obj;
+			loaded = load_obj_parallel(model_file, obj);
+			if (loaded){
+				upload_obj_model(obj, allocator, vert_buf, elem_buf, mat_buf, model_info);
+			}
+		}
+		else if (!loaded){
+			loaded = glt::load_model_with_mats(model_file, allocator, vert_buf, elem_buf, mat_buf, textures, model_info);
+		}
+		if (!loaded){
+			std::cout << "Error loading model!\n";
+			ret = 1;
+		}
+		else {
+			const ModelGeometry geometry = read_back_geometry(vert_buf, elem_buf);
+			const std::vector<uint32_t> triangles = model_triangles(geometry, model_info);
+			WorkStealingPool pool{threads};
+			const auto start = std::chrono::steady_clock::now();
+			const std::vector<float> ao = bake_vertex_ao(geometry.vertices, MODEL_VERTEX_FLOATS, triangles,
+					params, pool);
+			const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			const size_t rays = ao.size() * ((params.rays + BVH_PACKET_SIZE - 1) / BVH_PACKET_SIZE) * BVH_PACKET_SIZE;
+			std::cout << "Baked AO for " << ao.size() << " vertices and " << triangles.size() / 3 << " triangles in "
+				<< elapsed << "s on " << pool.size() << " threads, " << rays / elapsed / 1e6 << "M rays/s\n";
+			if (save_vertex_ao(bake_file, vertex_checksum(geometry.vertices), ao)){
+				std::cout << "Wrote " << bake_file << "\n";
+			}
+			else {
+				ret = 1;
+			}
+		}
+		glDeleteTextures(textures.textures.size(), textures.textures.data());
+		glDeleteVertexArrays(1, &vao);
+	}
+	destroy_headless_context(ctx);
+	return ret;
+}
+
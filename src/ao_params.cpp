@@ -0,0 +1,103 @@
+#include <fstream>
+#include <iostream>
+#include "ao_params.h"
+
+bool save_ao_params(const std::string &file, const AOParams &params){
+	std::ofstream fout{file};
+	if (!fout){
+		std::cout << "Failed to open " << file << " for writing\n";
+		return false;
+	}
+	fout << "use_rendered_normals " << params.use_rendered_normals << "\n"
+		<< "n_samples " << params.n_samples << "\n"
+		<< "turns " << params.turns << "\n"
+		<< "ball_radius " << params.ball_radius << "\n"
+		<< "sigma " << params.sigma << "\n"
+		<< "kappa " << params.kappa << "\n"
+		<< "beta " << params.beta << "\n"
+		<< "filter_scale " << params.filter_scale << "\n"
+		<< "edge_sharpness " << params.edge_sharpness << "\n"
+		<< "adaptive_samples " << params.adaptive_samples << "\n"
+		<< "min_samples " << params.min_samples << "\n"
+		<< "full_sample_radius " << params.full_sample_radius << "\n"
+		<< "multi_scale " << params.multi_scale << "\n"
+		<< "n_scales " << params.n_scales << "\n"
+		<< "scale_samples " << params.scale_samples << "\n"
+		<< "scale_radii";
+	for (const float r : params.scale_radii){
+		fout << " " << r;
+	}
+	fout << "\n";
+	return true;
+}
+bool load_ao_params(const std::string &file, AOParams &params){
+	std::ifstream fin{file};
+	if (!fin){
+		std::cout << "Failed to open AO params " << file << "\n";
+		return false;
+	}
+	params = DEFAULT_AO_PARAMS;
+	std::string name;
+	while (fin >> name){
+		if (name == "use_rendered_normals"){
+			fin >> params.use_rendered_normals;
+		}
+		else if (name == "n_samples"){
+			fin >> params.n_samples;
+		}
+		else if (name == "turns"){
+			fin >> params.turns;
+		}
+		else if (name == "ball_radius"){
+			fin >> params.ball_radius;
+		}
+		else if (name == "sigma"){
+			fin >> params.sigma;
+		}
+		else if (name == "kappa"){
+			fin >> params.kappa;
+		}
+		else if (name == "beta"){
+			fin >> params.beta;
+		}
+		else if (name == "filter_scale"){
+			fin >> params.filter_scale;
+		}
+		else if (name == "edge_sharpness"){
+			fin >> params.edge_sharpness;
+		}
+		else if (name == "adaptive_samples"){
+			fin >> params.adaptive_samples;
+		}
+		else if (name == "min_samples"){
+			fin >> params.min_samples;
+		}
+		else if (name == "full_sample_radius"){
+			fin >> params.full_sample_radius;
+		}
+		else if (name == "multi_scale"){
+			fin >> params.multi_scale;
+		}
+		else if (name == "n_scales"){
+			fin >> params.n_scales;
+		}
+		else if (name == "scale_samples"){
+			fin >> params.scale_samples;
+		}
+		else if (name == "scale_radii"){
+			for (auto &r : params.scale_radii){
+				fin >> r;
+			}
+		}
+		else {
+			std::cout << "Unrecognized AO param " << name << " in " << file << "\n";
+			return false;
+		}
+		if (!fin){
+			std::cout << "Invalid value for AO param " << name << " in " << file << "\n";
+			return false;
+		}
+	}
+	return true;
+}
+
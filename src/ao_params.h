@@ -0,0 +1,52 @@
+#ifndef AO_PARAMS_H
+#define AO_PARAMS_H
+
+#include <string>
+
+// Most radii the multi-scale AO can combine, the size of the scale_radii vec4 in global.glsl
+const int AO_MAX_SCALES = 4;
+
+// Tweak params for the AO and blur passes, laid out to match the layout
+// of the uniform buffer
+struct AOParams {
+	// Parameters for the AO pass
+	int use_rendered_normals;
+	int n_samples;
+	int turns;
+	float ball_radius;
+	float sigma;
+	float kappa;
+	float beta;
+	// Parameters for the blurring pass
+	int filter_scale;
+	float edge_sharpness;
+	// Parameters for adaptive sampling, which picks each pixel's sample count between
+	// min_samples and n_samples by the sample ball's radius in pixels, taking all n_samples
+	// once it reaches full_sample_radius
+	int adaptive_samples;
+	int min_samples;
+	float full_sample_radius;
+	// Parameters for multi-scale AO, which evaluates the AO at each of the first n_scales radii
+	// with scale_samples samples each, reading coarser levels of the depth pyramid for the
+	// larger radii, and keeps the strongest occlusion found
+	int multi_scale;
+	int n_scales;
+	int scale_samples;
+	// Aligned to match the vec4 in the uniform block
+	alignas(16) float scale_radii[AO_MAX_SCALES];
+};
+
+// The default AO params the renderer starts with. The ball radius is in camera space units,
+// 26 gives the same screen radius at 1280x720 as the 3.5 * 3500 pixels we used to hardcode
+const AOParams DEFAULT_AO_PARAMS{0, 27, 16, 26.f, 3.8f, 0.8f, 0.0005f, 2, 0.8f, 0, 4, 64.f,
+	0, 3, 6, {6.f, 18.f, 54.f, 160.f}};
+
+/*
+ * Save/load the AO params as a simple "name value" per line text file, so dumped
+ * golden images can be reproduced with the same settings
+ */
+bool save_ao_params(const std::string &file, const AOParams &params);
+bool load_ao_params(const std::string &file, AOParams &params);
+
+#endif
+
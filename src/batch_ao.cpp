@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <glm/ext.hpp>
+#include "float_image.h"
+#include "batch_ao.h"
+
+BatchAO::BatchAO(const std::string &shader_path, const std::string &output_prefix, int width, int height,
+		int views_per_batch, bool compact_gbuffer, int model_textures)
+	: output_prefix(output_prefix), width(width), height(height), views_per_batch(views_per_batch),
+	first_unit(model_textures), levels(std::log2(std::max(width, height))), prepass_program(0),
+	depth_mip_program(0), blur_program(0), num_views_unif(-1), blur_axis_unif(-1), blur_ao_in_unif(-1),
+	ao_shaders(shader_path, compact_gbuffer, model_textures, model_textures + 1, AO_LAYOUT_LAYERED), batch(0), views_written(0)
+{
+	// Each view is rendered by an invocation of the prepass' geometry shader
+	GLint max_invocations = 32;
+	glGetIntegerv(GL_MAX_GEOMETRY_SHADER_INVOCATIONS, &max_invocations);
+	GLint max_layers = 256;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+	this->views_per_batch = std::max(std::min({views_per_batch, static_cast<int>(max_invocations),
+				static_cast<int>(max_layers)}), 1);
+	if (this->views_per_batch != views_per_batch){
+		std::cout << "BatchAO: limiting batches to " << this->views_per_batch << " views\n";
+	}
+	views_per_batch = this->views_per_batch;
+
+	const GLint prepass = load_program_variant({
+		std::make_pair(GL_VERTEX_SHADER, shader_path + "batch_prepass_vert.glsl"),
+		std::make_pair(GL_GEOMETRY_SHADER, shader_path + "batch_prepass_geom.glsl"),
+		std::make_pair(GL_FRAGMENT_SHADER, shader_path + "prepass_frag.glsl")},
+		{{"BATCH_VIEWS", std::to_string(views_per_batch)}});
+	const std::vector<std::pair<GLenum, std::string>> layered_quad{
+		std::make_pair(GL_VERTEX_SHADER, shader_path + "layered_quad_vert.glsl"),
+		std::make_pair(GL_GEOMETRY_SHADER, shader_path + "layered_quad_geom.glsl")};
+	auto quad_pass = layered_quad;
+	quad_pass.push_back(std::make_pair(GL_FRAGMENT_SHADER, shader_path + "depth_mip_frag.glsl"));
+	const GLint depth_mip = load_program_variant(quad_pass, {{"LAYERED", "1"}});
+	quad_pass.back().second = shader_path + "blur_frag.glsl";
+	const GLint blur = load_program_variant(quad_pass, {{"LAYERED", "1"}});
+	prepass_program = prepass != -1 ? prepass : 0;
+	depth_mip_program = depth_mip != -1 ? depth_mip : 0;
+	blur_program = blur != -1 ? blur : 0;
+	if (prepass_program != 0){
+		std::vector<GLint> tex_unifs;
+		for (int i = 0; i < model_textures; ++i){
+			tex_unifs.push_back(i);
+		}
+		glUseProgram(prepass_program);
+		glUniform1iv(glGetUniformLocation(prepass_program, "model_textures"), tex_unifs.size(), tex_unifs.data());
+		glUniform1ui(glGetUniformLocation(prepass_program, "octahedral_normals"), compact_gbuffer);
+		num_views_unif = glGetUniformLocation(prepass_program, "num_views");
+	}
+	if (depth_mip_program != 0){
+		glUseProgram(depth_mip_program);
+		glUniform1i(glGetUniformLocation(depth_mip_program, "depth_in"), first_unit);
+	}
+	if (blur_program != 0){
+		blur_axis_unif = glGetUniformLocation(blur_program, "axis");
+		blur_ao_in_unif = glGetUniformLocation(blur_program, "ao_in");
+	}
+
+	// The targets match the full resolution ones of the interactive renderer, with a layer per view
+	const GLenum ao_format = compact_gbuffer ? GL_RG16 : GL_RG32F;
+	const GLenum normal_format = compact_gbuffer ? GL_RG16_SNORM : GL_RGB32F;
+	glGenTextures(textures.size(), textures.data());
+	const std::array<GLenum, 5> formats = {GL_DEPTH_COMPONENT32F, GL_R32F, normal_format, ao_format, ao_format};
+	// The depth is only tested against so doesn't need a unit, the others take the four after the model's
+	const std::array<int, 5> units = {first_unit, first_unit, first_unit + 1, first_unit + 2, first_unit + 3};
+	for (size_t i = 0; i < textures.size(); ++i){
+		glActiveTexture(GL_TEXTURE0 + units[i]);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, textures[i]);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, i < 2 ? levels : 1, formats[i], width, height, views_per_batch);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, i == 1 ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+	// Rebind the linear depth, which replaced the depth on the unit
+	glActiveTexture(GL_TEXTURE0 + first_unit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textures[1]);
+
+	// Attaching the whole array makes the framebuffers layered
+	glGenFramebuffers(1, &prepass_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, prepass_fbo);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, textures[0], 0);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, textures[1], 0);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, textures[2], 0);
+	const GLenum draw_buffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+	glDrawBuffers(2, draw_buffers);
+
+	glGenFramebuffers(1, &depth_mip_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, depth_mip_fbo);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+
+	glGenFramebuffers(1, &ao_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, ao_fbo);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, textures[3], 0);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+
+	glGenFramebuffers(1, &blur_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, blur_fbo);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, textures[4], 0);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+
+	// Each view's AO is read back by attaching its layer to this framebuffer
+	glGenFramebuffers(1, &read_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	glGenBuffers(1, &views_ubo);
+	glBindBuffer(GL_UNIFORM_BUFFER, views_ubo);
+	glBufferData(GL_UNIFORM_BUFFER, 2 * views_per_batch * sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
+	glGenVertexArrays(1, &quad_vao);
+
+	const size_t readback_bytes = static_cast<size_t>(width) * height * views_per_batch * sizeof(float);
+	for (auto &r : readbacks){
+		glGenBuffers(1, &r.pbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, r.pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, readback_bytes, nullptr, GL_STREAM_READ);
+		r.fence = 0;
+		r.first_view = 0;
+		r.count = 0;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+BatchAO::~BatchAO(){
+	for (auto &r : readbacks){
+		if (r.fence){
+			glDeleteSync(r.fence);
+		}
+		glDeleteBuffers(1, &r.pbo);
+	}
+	glDeleteBuffers(1, &views_ubo);
+	glDeleteVertexArrays(1, &quad_vao);
+	glDeleteFramebuffers(1, &prepass_fbo);
+	glDeleteFramebuffers(1, &depth_mip_fbo);
+	glDeleteFramebuffers(1, &ao_fbo);
+	glDeleteFramebuffers(1, &blur_fbo);
+	glDeleteFramebuffers(1, &read_fbo);
+	glDeleteTextures(textures.size(), textures.data());
+	for (const GLuint p : {prepass_program, depth_mip_program, blur_program}){
+		if (p != 0){
+			glDeleteProgram(p);
+		}
+	}
+}
+bool BatchAO::is_valid() const {
+	return prepass_program != 0 && depth_mip_program != 0 && blur_program != 0;
+}
+int BatchAO::batch_size() const {
+	return views_per_batch;
+}
+void BatchAO::render(const std::vector<glm::mat4> &views, size_t first, size_t count, const AOParams &params,
+		const std::function<void()> &draw_scene)
+{
+	const AOVariant *ao_variant = ao_shaders.get(params);
+	if (!is_valid() || !ao_variant || count == 0){
+		return;
+	}
+	count = std::min(count, static_cast<size_t>(views_per_batch));
+	// Orphan the views from the last batch instead of waiting for the GPU to finish with them
+	std::vector<glm::mat4> view_data(2 * views_per_batch, glm::mat4(1));
+	for (size_t i = 0; i < count; ++i){
+		view_data[i] = views[first + i];
+		view_data[views_per_batch + i] = glm::inverse(glm::transpose(views[first + i]));
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, views_ubo);
+	glBufferData(GL_UNIFORM_BUFFER, view_data.size() * sizeof(glm::mat4), view_data.data(), GL_STREAM_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, 3, views_ubo);
+
+	// Render the linear depth and normals of every view, clearing clears all the layers
+	glViewport(0, 0, width, height);
+	glBindFramebuffer(GL_FRAMEBUFFER, prepass_fbo);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glUseProgram(prepass_program);
+	glUniform1i(num_views_unif, count);
+	draw_scene();
+
+	// Build each view's depth pyramid, as in the interactive renderer
+	glBindFramebuffer(GL_FRAMEBUFFER, depth_mip_fbo);
+	glBindVertexArray(quad_vao);
+	glUseProgram(depth_mip_program);
+	glActiveTexture(GL_TEXTURE0 + first_unit);
+	for (GLsizei i = 1; i < levels; ++i){
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, i - 1);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, i - 1);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, textures[1], i);
+		glViewport(0, 0, std::max(width >> i, 1), std::max(height >> i, 1));
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+	}
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	glViewport(0, 0, width, height);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, ao_fbo);
+	glUseProgram(ao_variant->program);
+	glUniform1i(ao_variant->ao_level_unif, 0);
+	glUniform1f(ao_variant->phi_offset_unif, 0.f);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, blur_fbo);
+	glUseProgram(blur_program);
+	glUniform2i(blur_axis_unif, 0, 1);
+	glUniform1i(blur_ao_in_unif, first_unit + 2);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, ao_fbo);
+	glUniform2i(blur_axis_unif, 1, 0);
+	glUniform1i(blur_ao_in_unif, first_unit + 3);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+
+	// Queue the copy of each view's AO into the next buffer in the ring, writing out the
+	// batch which last used it first
+	Readback &r = readbacks[batch % readbacks.size()];
+	collect(r);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, r.pbo);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	for (size_t i = 0; i < count; ++i){
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, textures[3], 0, i);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		glReadPixels(0, 0, width, height, GL_RED, GL_FLOAT,
+				reinterpret_cast<void*>(i * static_cast<size_t>(width) * height * sizeof(float)));
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	r.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	r.first_view = first;
+	r.count = count;
+	++batch;
+	// Make sure the batch gets going while we record the next one
+	glFlush();
+}
+void BatchAO::finish(){
+	for (size_t i = 0; i < readbacks.size(); ++i){
+		collect(readbacks[(batch + i) % readbacks.size()]);
+	}
+}
+size_t BatchAO::written() const {
+	return views_written;
+}
+void BatchAO::collect(Readback &r){
+	if (!r.fence){
+		return;
+	}
+	glClientWaitSync(r.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+	glDeleteSync(r.fence);
+	r.fence = 0;
+
+	const size_t view_floats = static_cast<size_t>(width) * height;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, r.pbo);
+	const float *data = static_cast<const float*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+				r.count * view_floats * sizeof(float), GL_MAP_READ_BIT));
+	if (!data){
+		std::cout << "BatchAO: failed to map the AO of views " << r.first_view << "-"
+			<< r.first_view + r.count - 1 << "\n";
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		return;
+	}
+	for (size_t i = 0; i < r.count; ++i){
+		char suffix[32];
+		std::snprintf(suffix, sizeof(suffix), "_%05zu.fimg", r.first_view + i);
+		const FloatImage img{width, height, 1,
+			std::vector<float>(data + i * view_floats, data + (i + 1) * view_floats)};
+		if (save_float_image(output_prefix + suffix, img)){
+			++views_written;
+		}
+	}
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
@@ -0,0 +1,79 @@
+#ifndef BATCH_AO_H
+#define BATCH_AO_H
+
+#include <array>
+#include <functional>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "glt/gl_core_4_5.h"
+#include "ao_params.h"
+#include "shader_variants.h"
+
+// Number of batches which can be waiting to be read back before we wait on the oldest
+const int BATCH_READBACK_SLOTS = 3;
+
+/*
+ * Renders AO for a list of views in batches for offline dataset generation, without
+ * presenting anything. Each batch renders up to views_per_batch views into the layers of
+ * 2D array targets: the depth prepass draws the scene once with a geometry shader that
+ * sends each triangle to every view's layer, and the depth pyramid, AO and blur passes
+ * each draw one instanced full screen quad over all the layers. The blurred AO of each
+ * batch is copied into a pixel buffer and fenced, and only mapped and written out once
+ * the GPU has moved on, so the GPU is never left waiting on us between batches.
+ * The Viewing and AO params blocks must be bound by the caller, the AO is computed with
+ * the Viewing block's projection and viewport size
+ */
+class BatchAO {
+	struct Readback {
+		GLuint pbo;
+		GLsync fence;
+		size_t first_view, count;
+	};
+
+	std::string output_prefix;
+	int width, height, views_per_batch, first_unit;
+	GLsizei levels;
+	GLuint prepass_program, depth_mip_program, blur_program;
+	GLint num_views_unif, blur_axis_unif, blur_ao_in_unif;
+	AOShaderCache ao_shaders;
+	// Depth, linear depth pyramid, normals, AO and blur intermediate arrays
+	std::array<GLuint, 5> textures;
+	GLuint prepass_fbo, depth_mip_fbo, ao_fbo, blur_fbo, read_fbo;
+	GLuint views_ubo, quad_vao;
+	std::array<Readback, BATCH_READBACK_SLOTS> readbacks;
+	size_t batch, views_written;
+
+public:
+	/*
+	 * Setup the targets and programs to render batches of views at width x height. The model's
+	 * texture arrays are bound to the first model_textures units and the batch's targets are
+	 * bound to the four units after them. Results are written as <output_prefix>_<view>.fimg
+	 */
+	BatchAO(const std::string &shader_path, const std::string &output_prefix, int width, int height,
+			int views_per_batch, bool compact_gbuffer, int model_textures);
+	~BatchAO();
+	BatchAO(const BatchAO&) = delete;
+	BatchAO& operator=(const BatchAO&) = delete;
+	// Check if all the programs compiled
+	bool is_valid() const;
+	int batch_size() const;
+	/*
+	 * Render the AO for the views [first, first + count), count must be at most the batch size.
+	 * draw_scene should draw the scene's geometry with its vertex array bound
+	 */
+	void render(const std::vector<glm::mat4> &views, size_t first, size_t count, const AOParams &params,
+			const std::function<void()> &draw_scene);
+	/*
+	 * Wait for the batches still being read back and write them out
+	 */
+	void finish();
+	// The number of views written out so far
+	size_t written() const;
+
+private:
+	void collect(Readback &r);
+};
+
+#endif
+
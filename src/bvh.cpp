@@ -0,0 +1,314 @@
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include "bvh.h"
+
+// Number of bins the centroids are sorted into along each axis when picking a split
+const int SAH_BINS = 16;
+// Cost of visiting a node relative to intersecting a triangle
+const float SAH_TRAVERSAL_COST = 1.f;
+// Leaves are split while this big even if the SAH says not to
+const uint32_t MAX_LEAF_TRIANGLES = 8;
+// Depth below which the builder stops using the SAH and splits at the median centroid instead.
+// Halving the triangles takes at most 32 more levels, so the tree is under 97 levels deep
+const int MAX_SAH_DEPTH = 64;
+// Depth of the traversal stack, which holds at most one node more than the tree is deep
+const int TRAVERSAL_STACK_SIZE = 128;
+static_assert(MAX_SAH_DEPTH + 33 < TRAVERSAL_STACK_SIZE, "BVH can be deeper than the traversal stack");
+
+static float surface_area(const float min[3], const float max[3]){
+	const float d[3] = {max[0] - min[0], max[1] - min[1], max[2] - min[2]};
+	return 2.f * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+}
+
+BVH::BVH(const std::vector<float> &vertices, size_t stride, const std::vector<uint32_t> &triangles){
+	const uint32_t n = triangles.size() / 3;
+	std::vector<float> bounds(6 * static_cast<size_t>(n)), centroids(3 * static_cast<size_t>(n));
+	std::vector<uint32_t> order(n);
+	for (int a = 0; a < 3; ++a){
+		scene_min[a] = std::numeric_limits<float>::max();
+		scene_max[a] = -std::numeric_limits<float>::max();
+	}
+	for (uint32_t t = 0; t < n; ++t){
+		order[t] = t;
+		for (int a = 0; a < 3; ++a){
+			float lo = std::numeric_limits<float>::max();
+			float hi = -std::numeric_limits<float>::max();
+			for (int v = 0; v < 3; ++v){
+				const float x = vertices[triangles[3 * t + v] * stride + a];
+				lo = std::min(lo, x);
+				hi = std::max(hi, x);
+			}
+			bounds[6 * t + a] = lo;
+			bounds[6 * t + 3 + a] = hi;
+			centroids[3 * t + a] = 0.5f * (lo + hi);
+			scene_min[a] = std::min(scene_min[a], lo);
+			scene_max[a] = std::max(scene_max[a], hi);
+		}
+	}
+	if (n == 0){
+		for (int a = 0; a < 3; ++a){
+			scene_min[a] = scene_max[a] = 0.f;
+		}
+		return;
+	}
+	nodes.reserve(2 * n);
+	build(order, bounds, centroids, 0, n, 0);
+
+	tris.resize(n);
+	for (uint32_t i = 0; i < n; ++i){
+		const uint32_t *t = &triangles[3 * order[i]];
+		for (int a = 0; a < 3; ++a){
+			const float v0 = vertices[t[0] * stride + a];
+			tris[i].v0[a] = v0;
+			tris[i].e1[a] = vertices[t[1] * stride + a] - v0;
+			tris[i].e2[a] = vertices[t[2] * stride + a] - v0;
+		}
+	}
+}
+uint32_t BVH::build(std::vector<uint32_t> &order, const std::vector<float> &bounds,
+		const std::vector<float> &centroids, uint32_t begin, uint32_t end, int depth)
+{
+	const uint32_t node = nodes.size();
+	nodes.push_back(BVHNode{});
+	float bmin[3], bmax[3], cmin[3], cmax[3];
+	for (int a = 0; a < 3; ++a){
+		bmin[a] = cmin[a] = std::numeric_limits<float>::max();
+		bmax[a] = cmax[a] = -std::numeric_limits<float>::max();
+	}
+	for (uint32_t i = begin; i < end; ++i){
+		const uint32_t t = order[i];
+		for (int a = 0; a < 3; ++a){
+			bmin[a] = std::min(bmin[a], bounds[6 * t + a]);
+			bmax[a] = std::max(bmax[a], bounds[6 * t + 3 + a]);
+			cmin[a] = std::min(cmin[a], centroids[3 * t + a]);
+			cmax[a] = std::max(cmax[a], centroids[3 * t + a]);
+		}
+	}
+	// Pad the boxes slightly so flat ones, e.g. around an axis aligned floor, still have
+	// an inside for the slab test to find
+	const float pad = 1e-5f * diagonal();
+	for (int a = 0; a < 3; ++a){
+		nodes[node].min[a] = bmin[a] - pad;
+		nodes[node].max[a] = bmax[a] + pad;
+	}
+	const uint32_t count = end - begin;
+	if (count <= 2 || (depth >= MAX_SAH_DEPTH && count <= MAX_LEAF_TRIANGLES)){
+		nodes[node].offset = begin;
+		nodes[node].count = count;
+		return node;
+	}
+	// Degenerate geometry can keep the SAH splitting off a few triangles at a time, so past the
+	// depth limit halve the triangles along the widest axis to bound the depth
+	if (depth >= MAX_SAH_DEPTH){
+		int axis = 0;
+		for (int a = 1; a < 3; ++a){
+			if (cmax[a] - cmin[a] > cmax[axis] - cmin[axis]){
+				axis = a;
+			}
+		}
+		const uint32_t mid = begin + count / 2;
+		std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+			[&](const uint32_t a, const uint32_t b){
+				return centroids[3 * a + axis] < centroids[3 * b + axis];
+			});
+		build(order, bounds, centroids, begin, mid, depth + 1);
+		const uint32_t right = build(order, bounds, centroids, mid, end, depth + 1);
+		nodes[node].offset = right;
+		nodes[node].count = 0;
+		nodes[node].axis = axis;
+		return node;
+	}
+
+	// Find the cheapest split between bins along any axis
+	struct Bin {
+		float min[3], max[3];
+		uint32_t count;
+	};
+	const float node_area = surface_area(bmin, bmax);
+	float best_cost = std::numeric_limits<float>::max();
+	int best_axis = -1, best_split = 0;
+	for (int a = 0; a < 3; ++a){
+		const float extent = cmax[a] - cmin[a];
+		if (extent <= 0.f){
+			continue;
+		}
+		std::array<Bin, SAH_BINS> bins;
+		for (auto &b : bins){
+			for (int i = 0; i < 3; ++i){
+				b.min[i] = std::numeric_limits<float>::max();
+				b.max[i] = -std::numeric_limits<float>::max();
+			}
+			b.count = 0;
+		}
+		const float scale = SAH_BINS / extent;
+		for (uint32_t i = begin; i < end; ++i){
+			const uint32_t t = order[i];
+			const int b = std::min(static_cast<int>((centroids[3 * t + a] - cmin[a]) * scale), SAH_BINS - 1);
+			for (int j = 0; j < 3; ++j){
+				bins[b].min[j] = std::min(bins[b].min[j], bounds[6 * t + j]);
+				bins[b].max[j] = std::max(bins[b].max[j], bounds[6 * t + 3 + j]);
+			}
+			++bins[b].count;
+		}
+		// Sweep from the right to get the area and count of each right side, then from the
+		// left evaluating each split
+		std::array<float, SAH_BINS> right_area;
+		std::array<uint32_t, SAH_BINS> right_count;
+		Bin acc = bins[SAH_BINS - 1];
+		for (int b = SAH_BINS - 1; b > 0; --b){
+			if (b != SAH_BINS - 1){
+				for (int j = 0; j < 3; ++j){
+					acc.min[j] = std::min(acc.min[j], bins[b].min[j]);
+					acc.max[j] = std::max(acc.max[j], bins[b].max[j]);
+				}
+				acc.count += bins[b].count;
+			}
+			right_area[b] = acc.count > 0 ? surface_area(acc.min, acc.max) : 0.f;
+			right_count[b] = acc.count;
+		}
+		acc = bins[0];
+		for (int b = 1; b < SAH_BINS; ++b){
+			if (acc.count > 0 && right_count[b] > 0){
+				const float cost = SAH_TRAVERSAL_COST
+					+ (surface_area(acc.min, acc.max) * acc.count + right_area[b] * right_count[b]) / node_area;
+				if (cost < best_cost){
+					best_cost = cost;
+					best_axis = a;
+					best_split = b;
+				}
+			}
+			for (int j = 0; j < 3; ++j){
+				acc.min[j] = std::min(acc.min[j], bins[b].min[j]);
+				acc.max[j] = std::max(acc.max[j], bins[b].max[j]);
+			}
+			acc.count += bins[b].count;
+		}
+	}
+	if (count <= MAX_LEAF_TRIANGLES && (best_axis == -1 || best_cost >= count)){
+		nodes[node].offset = begin;
+		nodes[node].count = count;
+		return node;
+	}
+
+	uint32_t mid = begin;
+	if (best_axis != -1){
+		const float scale = SAH_BINS / (cmax[best_axis] - cmin[best_axis]);
+		mid = std::partition(order.begin() + begin, order.begin() + end, [&](const uint32_t t){
+			const int b = std::min(static_cast<int>((centroids[3 * t + best_axis] - cmin[best_axis]) * scale),
+					SAH_BINS - 1);
+			return b < best_split;
+		}) - order.begin();
+	}
+	// All the centroids are in the same place or the split was empty, so just halve the triangles
+	if (mid == begin || mid == end){
+		best_axis = 0;
+		mid = begin + count / 2;
+	}
+	build(order, bounds, centroids, begin, mid, depth + 1);
+	const uint32_t right = build(order, bounds, centroids, mid, end, depth + 1);
+	nodes[node].offset = right;
+	nodes[node].count = 0;
+	nodes[node].axis = best_axis;
+	return node;
+}
+int BVH::occluded(const float origin[3], const float *dx, const float *dy, const float *dz,
+		float t_min, float t_max) const
+{
+	typedef PacketSimd S;
+	typedef S::F F;
+	const int all_rays = (1 << S::WIDTH) - 1;
+	if (nodes.empty()){
+		return 0;
+	}
+	const F ox = S::set1(origin[0]), oy = S::set1(origin[1]), oz = S::set1(origin[2]);
+	const F dir[3] = {S::load(dx), S::load(dy), S::load(dz)};
+	const F one = S::set1(1.f);
+	const F inv_dir[3] = {S::div(one, dir[0]), S::div(one, dir[1]), S::div(one, dir[2])};
+	const F zero = S::set1(0.f), far = S::set1(std::numeric_limits<float>::max()), done = S::set1(-1.f);
+	const F tmin = S::set1(t_min), det_eps = S::set1(1e-12f);
+	// Rays which hit something have tmax set below tmin, so they miss everything after
+	F tmax = S::set1(t_max);
+	int hit = 0;
+
+	// Visit the nearer child first along the direction of the packet's first ray
+	const bool dir_neg[3] = {dx[0] < 0.f, dy[0] < 0.f, dz[0] < 0.f};
+	uint32_t stack[TRAVERSAL_STACK_SIZE];
+	int stack_size = 0;
+	stack[stack_size++] = 0;
+	while (stack_size > 0){
+		const uint32_t n = stack[--stack_size];
+		const BVHNode &node = nodes[n];
+		const F t0x = S::mul(S::sub(S::set1(node.min[0]), ox), inv_dir[0]);
+		const F t1x = S::mul(S::sub(S::set1(node.max[0]), ox), inv_dir[0]);
+		const F t0y = S::mul(S::sub(S::set1(node.min[1]), oy), inv_dir[1]);
+		const F t1y = S::mul(S::sub(S::set1(node.max[1]), oy), inv_dir[1]);
+		const F t0z = S::mul(S::sub(S::set1(node.min[2]), oz), inv_dir[2]);
+		const F t1z = S::mul(S::sub(S::set1(node.max[2]), oz), inv_dir[2]);
+		const F t_near = S::max(S::max(S::max(S::min(t0x, t1x), S::min(t0y, t1y)), S::min(t0z, t1z)), tmin);
+		const F t_far = S::min(S::min(S::min(S::max(t0x, t1x), S::max(t0y, t1y)), S::max(t0z, t1z)), tmax);
+		if (!S::mask_lt(t_near, t_far)){
+			continue;
+		}
+		if (node.count == 0){
+			const uint32_t first = n + 1;
+			// The builder's depth limit keeps the stack from filling up
+			assert(stack_size + 2 <= TRAVERSAL_STACK_SIZE);
+			if (dir_neg[node.axis]){
+				stack[stack_size++] = first;
+				stack[stack_size++] = node.offset;
+			}
+			else {
+				stack[stack_size++] = node.offset;
+				stack[stack_size++] = first;
+			}
+			continue;
+		}
+		for (uint32_t i = node.offset; i < node.offset + node.count; ++i){
+			// Moller-Trumbore, with the terms only depending on the origin computed once
+			// for the whole packet
+			const BVHTriangle &tri = tris[i];
+			const float s[3] = {origin[0] - tri.v0[0], origin[1] - tri.v0[1], origin[2] - tri.v0[2]};
+			const float q[3] = {s[1] * tri.e1[2] - s[2] * tri.e1[1], s[2] * tri.e1[0] - s[0] * tri.e1[2],
+				s[0] * tri.e1[1] - s[1] * tri.e1[0]};
+			const float t_num = tri.e2[0] * q[0] + tri.e2[1] * q[1] + tri.e2[2] * q[2];
+			const F e2x = S::set1(tri.e2[0]), e2y = S::set1(tri.e2[1]), e2z = S::set1(tri.e2[2]);
+			const F px = S::sub(S::mul(dir[1], e2z), S::mul(dir[2], e2y));
+			const F py = S::sub(S::mul(dir[2], e2x), S::mul(dir[0], e2z));
+			const F pz = S::sub(S::mul(dir[0], e2y), S::mul(dir[1], e2x));
+			const F det = S::add(S::add(S::mul(S::set1(tri.e1[0]), px), S::mul(S::set1(tri.e1[1]), py)),
+					S::mul(S::set1(tri.e1[2]), pz));
+			const F inv_det = S::div(one, det);
+			const F u = S::mul(S::add(S::add(S::mul(S::set1(s[0]), px), S::mul(S::set1(s[1]), py)),
+						S::mul(S::set1(s[2]), pz)), inv_det);
+			const F v = S::mul(S::add(S::add(S::mul(dir[0], S::set1(q[0])), S::mul(dir[1], S::set1(q[1]))),
+						S::mul(dir[2], S::set1(q[2]))), inv_det);
+			F t = S::mul(S::set1(t_num), inv_det);
+			// Push the misses out past any tmax
+			t = S::select_lt(u, zero, far, t);
+			t = S::select_lt(v, zero, far, t);
+			t = S::select_lt(one, S::add(u, v), far, t);
+			t = S::select_lt(t, tmin, far, t);
+			t = S::select_lt(S::abs(det), det_eps, far, t);
+			hit |= S::mask_lt(t, tmax);
+			if (hit == all_rays){
+				return hit;
+			}
+			tmax = S::select_lt(t, tmax, done, tmax);
+		}
+	}
+	return hit;
+}
+float BVH::diagonal() const {
+	const float d[3] = {scene_max[0] - scene_min[0], scene_max[1] - scene_min[1], scene_max[2] - scene_min[2]};
+	return std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+}
+size_t BVH::num_nodes() const {
+	return nodes.size();
+}
+size_t BVH::num_triangles() const {
+	return tris.size();
+}
+
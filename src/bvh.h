@@ -0,0 +1,75 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <cstdint>
+#include <vector>
+#include "simd.h"
+
+#ifdef SIMD_HAS_SSE2
+typedef SimdSSE2 PacketSimd;
+#else
+typedef SimdScalar PacketSimd;
+#endif
+
+// Number of rays traced together by BVH::occluded, one per SIMD lane
+const int BVH_PACKET_SIZE = PacketSimd::WIDTH;
+
+// A node of the flattened BVH, 32 bytes so two fit in a cache line
+struct BVHNode {
+	float min[3];
+	// For interior nodes the index of the second child, the first child is the node after
+	// this one. For leaves the index of the first triangle
+	uint32_t offset;
+	float max[3];
+	// Number of triangles in a leaf, 0 for interior nodes
+	uint16_t count;
+	// Axis the node was split on, used to visit the nearer child first
+	uint16_t axis;
+};
+
+// A triangle stored as a vertex and the two edges from it, as used by the intersection test
+struct BVHTriangle {
+	float v0[3], e1[3], e2[3];
+};
+
+/*
+ * A bounding volume hierarchy over a triangle mesh for ray casting on the CPU, built with the
+ * surface area heuristic evaluated over bins of the triangle centroids. Rays are traced in
+ * packets of BVH_PACKET_SIZE sharing an origin, which is what sampling the hemisphere over
+ * a point produces, so each node's box and each triangle are tested against all the packet's
+ * rays at once and the parts of the intersection test depending only on the origin are shared
+ */
+class BVH {
+	std::vector<BVHNode> nodes;
+	std::vector<BVHTriangle> tris;
+	float scene_min[3], scene_max[3];
+
+public:
+	/*
+	 * Build the BVH over the triangles, which are triples of indices into the vertices.
+	 * Vertices are interleaved with stride floats each and the position first
+	 */
+	BVH(const std::vector<float> &vertices, size_t stride, const std::vector<uint32_t> &triangles);
+	/*
+	 * Test which rays of the packet hit a triangle at a distance in [t_min, t_max). The rays
+	 * start at origin and go along (dx[i], dy[i], dz[i]), which needn't be normalized. Returns
+	 * a bitmask of the rays which hit something, ray i in bit i
+	 */
+	int occluded(const float origin[3], const float *dx, const float *dy, const float *dz,
+			float t_min, float t_max) const;
+	// Length of the diagonal of the scene's bounds
+	float diagonal() const;
+	size_t num_nodes() const;
+	size_t num_triangles() const;
+
+private:
+	/*
+	 * Build the subtree over the triangles [begin, end) of order at the depth passed,
+	 * reordering them as it goes, and return its node's index
+	 */
+	uint32_t build(std::vector<uint32_t> &order, const std::vector<float> &bounds,
+			const std::vector<float> &centroids, uint32_t begin, uint32_t end, int depth);
+};
+
+#endif
+
@@ -0,0 +1,89 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <glm/ext.hpp>
+#include "camera_path.h"
+
+bool load_camera_path(const std::string &file, std::vector<CameraKey> &path){
+	std::ifstream fin{file};
+	if (!fin){
+		std::cout << "Failed to open camera path " << file << "\n";
+		return false;
+	}
+	std::string line;
+	for (size_t line_num = 1; std::getline(fin, line); ++line_num){
+		if (line.empty() || line[0] == '#'){
+			continue;
+		}
+		std::istringstream iss{line};
+		CameraKey key{glm::vec3{0}, glm::vec3{0}, glm::vec3{0, 1, 0}};
+		if (!(iss >> key.eye.x >> key.eye.y >> key.eye.z >> key.target.x >> key.target.y >> key.target.z)){
+			// Allow lines with only whitespace
+			if (line.find_first_not_of(" \t\r") == std::string::npos){
+				continue;
+			}
+			std::cout << "Invalid camera keyframe on line " << line_num << " of " << file << "\n";
+			return false;
+		}
+		glm::vec3 up;
+		if (iss >> up.x >> up.y >> up.z){
+			key.up = up;
+		}
+		path.push_back(key);
+	}
+	if (path.empty()){
+		std::cout << "Camera path " << file << " has no keyframes\n";
+		return false;
+	}
+	return true;
+}
+glm::mat4 camera_path_look_at(const std::vector<CameraKey> &path, float t){
+	if (path.size() == 1){
+		return glm::lookAt(path[0].eye, path[0].target, path[0].up);
+	}
+	const float f = glm::clamp(t, 0.f, 1.f) * (path.size() - 1);
+	const size_t i = std::min(static_cast<size_t>(f), path.size() - 2);
+	const float s = f - i;
+	const CameraKey &a = path[i];
+	const CameraKey &b = path[i + 1];
+	return glm::lookAt(glm::mix(a.eye, b.eye, s), glm::mix(a.target, b.target, s),
+			glm::normalize(glm::mix(a.up, b.up, s)));
+}
+
+bool load_view_list(const std::string &file, std::vector<glm::mat4> &views){
+	std::ifstream fin{file};
+	if (!fin){
+		std::cout << "Failed to open view list " << file << "\n";
+		return false;
+	}
+	std::string line;
+	for (size_t line_num = 1; std::getline(fin, line); ++line_num){
+		if (line.empty() || line[0] == '#' || line.find_first_not_of(" \t\r") == std::string::npos){
+			continue;
+		}
+		std::istringstream iss{line};
+		std::vector<float> vals;
+		float x;
+		while (iss >> x){
+			vals.push_back(x);
+		}
+		if (vals.size() == 16){
+			views.push_back(glm::make_mat4(vals.data()));
+		}
+		else if (vals.size() == 6 || vals.size() == 9){
+			const glm::vec3 up = vals.size() == 9 ? glm::vec3{vals[6], vals[7], vals[8]} : glm::vec3{0, 1, 0};
+			views.push_back(glm::lookAt(glm::vec3{vals[0], vals[1], vals[2]}, glm::vec3{vals[3], vals[4], vals[5]}, up));
+		}
+		else {
+			std::cout << "Invalid view on line " << line_num << " of " << file
+				<< ", expected a camera keyframe or 16 matrix values\n";
+			return false;
+		}
+	}
+	if (views.empty()){
+		std::cout << "View list " << file << " has no views\n";
+		return false;
+	}
+	return true;
+}
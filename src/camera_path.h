@@ -0,0 +1,33 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// A keyframe on a scripted camera path
+struct CameraKey {
+	glm::vec3 eye, target, up;
+};
+
+/*
+ * Load a camera path from the file. Each non-empty line that isn't a comment (starts with #)
+ * is a keyframe: eye_x eye_y eye_z target_x target_y target_z [up_x up_y up_z]
+ * If the up vector is omitted +Y is used. Returns false if the file couldn't
+ * be read or had no keyframes
+ */
+bool load_camera_path(const std::string &file, std::vector<CameraKey> &path);
+/*
+ * Get the look at matrix for the camera at t in [0, 1] along the path, linearly
+ * interpolating between the keyframes which are spaced evenly along the path
+ */
+glm::mat4 camera_path_look_at(const std::vector<CameraKey> &path, float t);
+/*
+ * Load a list of view matrices, e.g. for rendering a dataset. Each non-empty line that isn't
+ * a comment is a view, either a camera keyframe as in load_camera_path or the 16 floats of
+ * the view matrix in column major order. Returns false if the file couldn't be read or had no views
+ */
+bool load_view_list(const std::string &file, std::vector<glm::mat4> &views);
+
+#endif
+
@@ -0,0 +1,404 @@
+#include <cmath>
+#include <algorithm>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+#include "cpu_ao.h"
+
+#ifdef CPU_AO_HAS_AVX2
+static bool cpu_has_avx2(){
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7){
+		return false;
+	}
+	// Check the OS saves the YMM registers and that we have FMA
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool fma = (info[2] & (1 << 12)) != 0;
+	if (!osxsave || !fma || (_xgetbv(0) & 6) != 6){
+		return false;
+	}
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return false;
+#endif
+}
+#endif
+static int round_up(int x, int multiple){
+	return ((x + multiple - 1) / multiple) * multiple;
+}
+static void ao_sample_row_scalar(const AOKernelData &d, int y, int x_begin, int x_end, float *sums){
+	ao_sample_row<SimdScalar>(d, y, x_begin, x_end, sums);
+}
+static void blur_row_scalar(const BlurKernelData &d, int y, int x_begin, int x_end){
+	blur_row<SimdScalar>(d, y, x_begin, x_end);
+}
+
+AOBuffer::AOBuffer() : width(0), height(0), stride(0){}
+void AOBuffer::resize(int w, int h){
+	width = w;
+	height = h;
+	// Pad rows so the SIMD kernels can always load a full vector
+	stride = round_up(w + 1, 8);
+	ao.resize(static_cast<size_t>(stride) * height, 0.f);
+	z.resize(static_cast<size_t>(stride) * height, 0.f);
+}
+float AOBuffer::ao_at(int x, int y) const {
+	return ao[static_cast<size_t>(y) * stride + x];
+}
+float AOBuffer::z_at(int x, int y) const {
+	return z[static_cast<size_t>(y) * stride + x];
+}
+
+CpuAO::CpuAO(int width, int height, int threads)
+	: width(width), height(height), pool(threads), proj_scale(0)
+{
+	thread_sums.resize(pool.size());
+	tile_scratch.resize(pool.size());
+
+	ao_sample_row_fn = ao_sample_row_scalar;
+	blur_row_fn = blur_row_scalar;
+	isa_name = "scalar";
+#ifdef SIMD_HAS_SSE2
+	ao_sample_row_fn = ao_sample_row_sse2;
+	blur_row_fn = blur_row_sse2;
+	isa_name = "SSE2";
+#endif
+#ifdef CPU_AO_HAS_AVX2
+	if (cpu_has_avx2()){
+		ao_sample_row_fn = ao_sample_row_avx2;
+		blur_row_fn = blur_row_avx2;
+		isa_name = "AVX2";
+	}
+#endif
+
+	// Setup the pyramid layout. Level 0 is padded out to the 2x2 quads covering the image
+	// and to a multiple of the SIMD width so the kernels never read past the end of a row,
+	// we want the same number of levels as the renderer's depth pyramid
+	kernel_data.quad_width = round_up(width, 2);
+	kernel_data.quad_height = round_up(height, 2);
+	stride = round_up(kernel_data.quad_width, 8);
+	kernel_data.levels = std::min(std::max(static_cast<int>(std::log2(std::max(width, height))), 1),
+			CPU_AO_MAX_LEVELS);
+	int32_t offset = 0;
+	for (int i = 0; i < kernel_data.levels; ++i){
+		kernel_data.level_width[i] = i == 0 ? width : std::max(kernel_data.level_width[i - 1] / 2, 1);
+		kernel_data.level_height[i] = i == 0 ? height : std::max(kernel_data.level_height[i - 1] / 2, 1);
+		kernel_data.level_stride[i] = i == 0 ? stride : kernel_data.level_width[i];
+		kernel_data.level_offset[i] = offset;
+		const int rows = i == 0 ? kernel_data.quad_height : kernel_data.level_height[i];
+		offset += kernel_data.level_stride[i] * rows;
+	}
+	for (int c = 0; c < 2; ++c){
+		pos[c].resize(static_cast<size_t>(stride) * kernel_data.quad_height + CPU_AO_PLANE_PAD, 0.f);
+		kernel_data.pos[c] = pos[c].data();
+	}
+	depth.resize(offset + CPU_AO_PLANE_PAD, 0.f);
+	kernel_data.pos[2] = depth.data();
+	kernel_data.depth = depth.data();
+	for (int c = 0; c < 3; ++c){
+		kernel_data.normal[c] = nullptr;
+	}
+
+	cos_phi.resize(static_cast<size_t>(stride) * kernel_data.quad_height + CPU_AO_PLANE_PAD);
+	sin_phi.resize(cos_phi.size());
+	parallel_for(kernel_data.quad_height, [&](int, int y){
+		for (int x = 0; x < stride; ++x){
+			// The Alchemy AO hash for random per-pixel rotation, parenthesized to match
+			// how GLSL's precedence groups 3 * px.x ^ px.y + px.x * px.y
+			const float phi = static_cast<float>(((3 * x) ^ (y + x * y)) * 10);
+			cos_phi[static_cast<size_t>(y) * stride + x] = static_cast<float>(std::cos(phi));
+			sin_phi[static_cast<size_t>(y) * stride + x] = static_cast<float>(std::sin(phi));
+		}
+	});
+	kernel_data.cos_phi = cos_phi.data();
+	kernel_data.sin_phi = sin_phi.data();
+}
+void CpuAO::set_depth(const float *z, const float *proj){
+	const float scale_x = proj[0];
+	const float scale_y = proj[5];
+	const float offset_x = proj[8];
+	const float offset_y = proj[9];
+	// x = -z * (ndc_x + offset_x) / scale_x with ndc_x = (px + 0.5) / width * 2 - 1
+	kernel_data.recon_ax = -2.f / (width * scale_x);
+	kernel_data.recon_bx = -(1.f / width - 1.f + offset_x) / scale_x;
+	kernel_data.recon_ay = -2.f / (height * scale_y);
+	kernel_data.recon_by = -(1.f / height - 1.f + offset_y) / scale_y;
+	proj_scale = 0.5f * height * scale_y;
+	parallel_for(kernel_data.quad_height, [&](int, int y){
+		// Replicate the last row and column into the padding
+		const int src_y = std::min(y, height - 1);
+		for (int x = 0; x < stride; ++x){
+			const int src_x = std::min(x, width - 1);
+			const float pz = z[static_cast<size_t>(src_y) * width + src_x];
+			const size_t dst = static_cast<size_t>(y) * stride + x;
+			pos[0][dst] = pz * (kernel_data.recon_ax * src_x + kernel_data.recon_bx);
+			pos[1][dst] = pz * (kernel_data.recon_ay * src_y + kernel_data.recon_by);
+			depth[dst] = pz;
+		}
+	});
+	build_pyramid();
+}
+void CpuAO::set_normals(const float *xyz){
+	for (int c = 0; c < 3; ++c){
+		normals[c].resize(static_cast<size_t>(stride) * kernel_data.quad_height + CPU_AO_PLANE_PAD);
+		kernel_data.normal[c] = normals[c].data();
+	}
+	parallel_for(kernel_data.quad_height, [&](int, int y){
+		const int src_y = std::min(y, height - 1);
+		for (int x = 0; x < stride; ++x){
+			const size_t src = (static_cast<size_t>(src_y) * width + std::min(x, width - 1)) * 3;
+			for (int c = 0; c < 3; ++c){
+				normals[c][static_cast<size_t>(y) * stride + x] = xyz[src + c];
+			}
+		}
+	});
+}
+void CpuAO::compute_ao(const AOParams &params, AOBuffer &out){
+	setup_samples(params);
+	out.resize(width, height);
+	parallel_for(kernel_data.quad_height / 2, [&](int thread, int band){
+		const size_t row = static_cast<size_t>(2 * band) * out.stride;
+		ao_band(params, thread, 2 * band, 0, kernel_data.quad_width, out.ao.data() + row,
+				out.z.data() + row, out.stride);
+	});
+}
+void CpuAO::blur(const AOParams &params, const AOBuffer &in, AOBuffer &out, int axis_x, int axis_y){
+	out.resize(in.width, in.height);
+	BlurKernelData d;
+	d.ao_in = in.ao.data();
+	d.z_in = in.z.data();
+	d.in_x = 0;
+	d.in_y = 0;
+	d.in_stride = in.stride;
+	d.ao_out = out.ao.data();
+	d.z_out = out.z.data();
+	d.out_x = 0;
+	d.out_y = 0;
+	d.out_stride = out.stride;
+	d.width = in.width;
+	d.height = in.height;
+	d.axis_x = axis_x;
+	d.axis_y = axis_y;
+	d.filter_scale = params.filter_scale;
+	d.edge_sharpness = params.edge_sharpness;
+	parallel_for(in.height, [&](int, int y){
+		blur_row_fn(d, y, 0, in.width);
+	});
+}
+void CpuAO::render(const AOParams &params, AOBuffer &out, AOBuffer &scratch){
+	compute_ao(params, out);
+	blur(params, out, scratch, 0, 1);
+	blur(params, scratch, out, 1, 0);
+}
+void CpuAO::render_tiled(const AOParams &params, AOBuffer &out, int tile_width, int tile_height){
+	setup_samples(params);
+	out.resize(width, height);
+	// Keep tiles on the 2x2 quads so each tile's AO matches the full-screen pass
+	tile_width = round_up(std::max(tile_width, 2), 2);
+	tile_height = round_up(std::max(tile_height, 2), 2);
+	const int reach = CPU_AO_BLUR_RADIUS * params.filter_scale;
+	const int tiles_x = (width + tile_width - 1) / tile_width;
+	const int tiles_y = (height + tile_height - 1) / tile_height;
+
+	BlurKernelData blur_data;
+	blur_data.width = width;
+	blur_data.height = height;
+	blur_data.filter_scale = params.filter_scale;
+	blur_data.edge_sharpness = params.edge_sharpness;
+
+	parallel_for(tiles_x * tiles_y, [&](int thread, int tile){
+		const TileRegion r = tile_region(tile, tiles_x, tile_width, tile_height, reach);
+		const int ao_stride = round_up(r.ao_x1 - r.ao_x0 + 1, 8);
+		TileScratch &scratch = tile_scratch[thread];
+		const size_t ao_size = static_cast<size_t>(ao_stride) * (r.ao_y1 - r.ao_y0);
+		if (scratch.ao.size() < ao_size){
+			scratch.ao.resize(ao_size);
+			scratch.z.resize(ao_size);
+		}
+		const size_t blur_size = static_cast<size_t>(ao_stride) * (r.y1 - r.y0);
+		if (scratch.blur_ao.size() < blur_size){
+			scratch.blur_ao.resize(blur_size);
+			scratch.blur_z.resize(blur_size);
+		}
+
+		for (int y = r.ao_y0; y < r.ao_y1; y += 2){
+			const size_t row = static_cast<size_t>(y - r.ao_y0) * ao_stride;
+			ao_band(params, thread, y, r.ao_x0, r.ao_x1, scratch.ao.data() + row,
+					scratch.z.data() + row, ao_stride);
+		}
+
+		// The first blur pass is along y over the tile rows and the width of the halo
+		// the second pass along x needs
+		BlurKernelData d = blur_data;
+		d.ao_in = scratch.ao.data();
+		d.z_in = scratch.z.data();
+		d.in_x = r.ao_x0;
+		d.in_y = r.ao_y0;
+		d.in_stride = ao_stride;
+		d.ao_out = scratch.blur_ao.data();
+		d.z_out = scratch.blur_z.data();
+		d.out_x = r.ao_x0;
+		d.out_y = r.y0;
+		d.out_stride = ao_stride;
+		d.axis_x = 0;
+		d.axis_y = 1;
+		const int blur_x1 = std::min(r.ao_x1, width);
+		for (int y = r.y0; y < r.y1; ++y){
+			blur_row_fn(d, y, r.ao_x0, blur_x1);
+		}
+
+		d.ao_in = scratch.blur_ao.data();
+		d.z_in = scratch.blur_z.data();
+		d.in_y = r.y0;
+		d.ao_out = out.ao.data();
+		d.z_out = out.z.data();
+		d.out_x = 0;
+		d.out_y = 0;
+		d.out_stride = out.stride;
+		d.axis_x = 1;
+		d.axis_y = 0;
+		for (int y = r.y0; y < r.y1; ++y){
+			blur_row_fn(d, y, r.x0, r.x1);
+		}
+	});
+}
+double CpuAO::tile_overhead(const AOParams &params, int tile_width, int tile_height) const {
+	tile_width = round_up(std::max(tile_width, 2), 2);
+	tile_height = round_up(std::max(tile_height, 2), 2);
+	const int reach = CPU_AO_BLUR_RADIUS * params.filter_scale;
+	const int tiles_x = (width + tile_width - 1) / tile_width;
+	const int tiles_y = (height + tile_height - 1) / tile_height;
+	double ao_pixels = 0;
+	for (int i = 0; i < tiles_x * tiles_y; ++i){
+		const TileRegion r = tile_region(i, tiles_x, tile_width, tile_height, reach);
+		ao_pixels += static_cast<double>(r.ao_x1 - r.ao_x0) * (r.ao_y1 - r.ao_y0);
+	}
+	return ao_pixels / (static_cast<double>(width) * height);
+}
+int CpuAO::get_width() const {
+	return width;
+}
+int CpuAO::get_height() const {
+	return height;
+}
+int CpuAO::threads() const {
+	return pool.size();
+}
+const char* CpuAO::isa() const {
+	return isa_name;
+}
+void CpuAO::build_pyramid(){
+	// Each texel takes one of the 2x2 texels below it on a rotated grid instead of
+	// averaging them, so depths aren't blended across edges, matching depth_mip_frag.glsl
+	for (int i = 1; i < kernel_data.levels; ++i){
+		const int prev_w = kernel_data.level_width[i - 1];
+		const int prev_h = kernel_data.level_height[i - 1];
+		const int prev_stride = kernel_data.level_stride[i - 1];
+		const float *prev = depth.data() + kernel_data.level_offset[i - 1];
+		const int w = kernel_data.level_width[i];
+		const int level_stride = kernel_data.level_stride[i];
+		float *level = depth.data() + kernel_data.level_offset[i];
+		parallel_for(kernel_data.level_height[i], [&](int, int y){
+			for (int x = 0; x < w; ++x){
+				const int src_x = std::min(2 * x + (y & 1), prev_w - 1);
+				const int src_y = std::min(2 * y + (x & 1), prev_h - 1);
+				level[y * level_stride + x] = prev[src_y * prev_stride + src_x];
+			}
+		});
+	}
+}
+void CpuAO::setup_samples(const AOParams &params){
+	const int n_samples = std::max(params.n_samples, 1);
+	// Precompute the unrotated spiral for the samples, each pixel's kernel rotates it by phi
+	sample_alpha.resize(n_samples);
+	sample_cos.resize(n_samples);
+	sample_sin.resize(n_samples);
+	const double TAU = 6.2831853071795864;
+	for (int i = 0; i < n_samples; ++i){
+		sample_alpha[i] = 1.f / n_samples * (i + 0.5f);
+		const double theta = TAU * sample_alpha[i] * params.turns;
+		sample_cos[i] = static_cast<float>(std::cos(theta));
+		sample_sin[i] = static_cast<float>(std::sin(theta));
+	}
+	kernel_data.sample_alpha = sample_alpha.data();
+	kernel_data.sample_cos = sample_cos.data();
+	kernel_data.sample_sin = sample_sin.data();
+	kernel_data.n_samples = n_samples;
+	kernel_data.use_rendered_normals = params.use_rendered_normals && kernel_data.normal[0] != nullptr;
+	kernel_data.screen_ball_radius = params.ball_radius * proj_scale;
+	kernel_data.beta = params.beta;
+}
+void CpuAO::ao_band(const AOParams &params, int thread, int y0, int x_begin, int x_end,
+		float *ao, float *z, int out_stride)
+{
+	const int n = x_end - x_begin;
+	const int sums_stride = round_up(n, 8);
+	std::vector<float> &sums = thread_sums[thread];
+	if (sums.size() < 2 * static_cast<size_t>(sums_stride)){
+		sums.resize(2 * static_cast<size_t>(sums_stride));
+	}
+	const float ao_scale = 2.f * params.sigma / kernel_data.n_samples;
+	float *rows[2] = {sums.data(), sums.data() + sums_stride};
+	const float *z_rows[2] = {depth.data() + y0 * stride + x_begin, depth.data() + (y0 + 1) * stride + x_begin};
+	for (int r = 0; r < 2; ++r){
+		ao_sample_row_fn(kernel_data, y0 + r, x_begin, x_end, rows[r]);
+		for (int x = 0; x < n; ++x){
+			// Pixels with no geometry rendered to them are left unoccluded
+			if (z_rows[r][x] < 0.f){
+				rows[r][x] = std::pow(std::max(0.f, 1.f - ao_scale * rows[r][x]), params.kappa);
+			}
+			else {
+				rows[r][x] = 1.f;
+			}
+		}
+	}
+	// Do the same little bit of filtering within each 2x2 quad that the shader
+	// does with dFdx/dFdy, respecting depth edges. Subtracting half the quad
+	// derivative from each pixel just averages the pair
+	for (int r = 0; r < 2; ++r){
+		for (int x = 0; x < n; x += 2){
+			if (std::abs(z_rows[r][x + 1] - z_rows[r][x]) < 0.02f){
+				rows[r][x] = rows[r][x + 1] = 0.5f * (rows[r][x] + rows[r][x + 1]);
+			}
+		}
+	}
+	for (int x = 0; x < n; ++x){
+		if (std::abs(z_rows[1][x] - z_rows[0][x]) < 0.02f){
+			rows[0][x] = rows[1][x] = 0.5f * (rows[0][x] + rows[1][x]);
+		}
+	}
+	const int out_width = std::min(x_end, width) - x_begin;
+	for (int r = 0; r < 2 && y0 + r < height; ++r){
+		float *ao_out = ao + static_cast<size_t>(r) * out_stride;
+		float *z_out = z + static_cast<size_t>(r) * out_stride;
+		for (int x = 0; x < out_width; ++x){
+			ao_out[x] = rows[r][x];
+			z_out[x] = z_rows[r][x] / CPU_AO_FAR_PLANE;
+		}
+	}
+}
+CpuAO::TileRegion CpuAO::tile_region(int tile, int tiles_x, int tile_width, int tile_height, int reach) const {
+	TileRegion r;
+	r.x0 = (tile % tiles_x) * tile_width;
+	r.y0 = (tile / tiles_x) * tile_height;
+	r.x1 = std::min(r.x0 + tile_width, width);
+	r.y1 = std::min(r.y0 + tile_height, height);
+	// Grow the tile by the blur's reach, snapped out to the 2x2 quads the AO is filtered over
+	r.ao_x0 = std::max(r.x0 - reach, 0) & ~1;
+	r.ao_y0 = std::max(r.y0 - reach, 0) & ~1;
+	r.ao_x1 = std::min(round_up(r.x1 + reach, 2), kernel_data.quad_width);
+	r.ao_y1 = std::min(round_up(r.y1 + reach, 2), kernel_data.quad_height);
+	return r;
+}
+void CpuAO::parallel_for(int n, const std::function<void(int, int)> &f){
+	pool.parallel_for(n, f);
+}
+
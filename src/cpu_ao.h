@@ -0,0 +1,141 @@
+#ifndef CPU_AO_H
+#define CPU_AO_H
+
+#include <array>
+#include <functional>
+#include <vector>
+#include "ao_params.h"
+#include "cpu_ao_kernel.h"
+#include "thread_pool.h"
+
+// The far plane distance used to pack depth into the AO output, matching ao_sample_frag.glsl
+const float CPU_AO_FAR_PLANE = -1000.f;
+
+// The default tile size used by CpuAO::render_tiled. The AO and blur intermediates for a
+// tile and its halo take ~600KB, fitting in a 1MB L2, while keeping the AO recomputed in
+// the halos to ~17% with the default filter scale
+const int CPU_AO_TILE_WIDTH = 256;
+const int CPU_AO_TILE_HEIGHT = 128;
+
+// AO values and the packed depth key used by the bilateral blur, stored as separate planes
+// with rows padded to stride floats
+struct AOBuffer {
+	int width, height, stride;
+	std::vector<float> ao, z;
+
+	AOBuffer();
+	void resize(int width, int height);
+	float ao_at(int x, int y) const;
+	float z_at(int x, int y) const;
+};
+
+/*
+ * A CPU implementation of the AO sample and bilateral blur passes done by ao_sample_frag.glsl
+ * and blur_frag.glsl, for rendering AO on machines without a GPU. The per-pixel spiral
+ * sampling loop is vectorized with AVX2 if the CPU supports it, falling back to SSE2,
+ * and the work is spread across a work-stealing thread pool, either as full-screen passes
+ * over rows like the GPU or as tiles which fuse the AO and blur passes
+ */
+class CpuAO {
+	// A tile of the output image and the region around it we compute AO for to cover
+	// the footprint of the blur
+	struct TileRegion {
+		int x0, y0, x1, y1;
+		int ao_x0, ao_y0, ao_x1, ao_y1;
+	};
+	// Per-thread scratch space for the AO and first blur pass of the tile being rendered
+	struct TileScratch {
+		std::vector<float> ao, z, blur_ao, blur_z;
+	};
+
+	int width, height, stride;
+	WorkStealingPool pool;
+	// Planes for the x and y components of the level 0 camera space positions, z is
+	// level 0 of the depth pyramid
+	std::array<std::vector<float>, 2> pos;
+	std::vector<float> depth;
+	std::array<std::vector<float>, 3> normals;
+	AOKernelData kernel_data;
+	// Size in pixels of a 1m object at z = -1m, from the projection matrix passed to set_depth
+	float proj_scale;
+	std::vector<float> sample_alpha, sample_cos, sample_sin;
+	// The per-pixel rotation only depends on the pixel so we compute its cos/sin once
+	std::vector<float> cos_phi, sin_phi;
+	// Per-thread scratch space for the rows of AO sums being computed
+	std::vector<std::vector<float>> thread_sums;
+	std::vector<TileScratch> tile_scratch;
+	void (*ao_sample_row_fn)(const AOKernelData&, int, int, int, float*);
+	void (*blur_row_fn)(const BlurKernelData&, int, int, int);
+	const char *isa_name;
+
+public:
+	/*
+	 * Setup the AO renderer for images of width x height, using the number of threads
+	 * passed or one per hardware thread if threads is 0
+	 */
+	CpuAO(int width, int height, int threads = 0);
+	/*
+	 * Set the linear camera space depth image and the column-major projection matrix
+	 * used to render it, rows go bottom to top like a texture read back from GL. Builds
+	 * the depth pyramid used for sampling, positions are reconstructed from the depth
+	 */
+	void set_depth(const float *z, const float *proj);
+	/*
+	 * Set the camera space normals from an interleaved RGB float image, these are
+	 * used instead of the position derivatives if params.use_rendered_normals is set
+	 */
+	void set_normals(const float *xyz);
+	/*
+	 * Compute the noisy AO values for the positions set, like the AO sample pass
+	 */
+	void compute_ao(const AOParams &params, AOBuffer &out);
+	/*
+	 * Run one pass of the bilateral blur on in, writing the result to out
+	 */
+	void blur(const AOParams &params, const AOBuffer &in, AOBuffer &out, int axis_x, int axis_y);
+	/*
+	 * Run the full AO pipeline as done by the renderer: AO samples followed by
+	 * the two blur passes. The result is written to out, scratch is used for the
+	 * intermediate blur result
+	 */
+	void render(const AOParams &params, AOBuffer &out, AOBuffer &scratch);
+	/*
+	 * Run the same pipeline as render but fused per tile of tile_width x tile_height
+	 * pixels: each thread computes the AO for a tile plus the halo needed by the blur,
+	 * then blurs it on both axes while it's still in cache. The AO in the halo is
+	 * computed again by the neighbouring tiles, but the sample taps into the position
+	 * pyramid are read in place so need no halo. The result matches render
+	 */
+	void render_tiled(const AOParams &params, AOBuffer &out, int tile_width = CPU_AO_TILE_WIDTH,
+			int tile_height = CPU_AO_TILE_HEIGHT);
+	/*
+	 * Get the number of AO samples computed by render_tiled relative to the image size,
+	 * i.e. the extra work spent on the tile halos
+	 */
+	double tile_overhead(const AOParams &params, int tile_width = CPU_AO_TILE_WIDTH,
+			int tile_height = CPU_AO_TILE_HEIGHT) const;
+	int get_width() const;
+	int get_height() const;
+	int threads() const;
+	// The name of the instruction set being used by the kernels
+	const char* isa() const;
+
+private:
+	// Build the depth mip levels from level 0 with the rotated grid subsample
+	void build_pyramid();
+	// Setup the kernel data for the sample pattern and parameters being rendered with
+	void setup_samples(const AOParams &params);
+	/*
+	 * Compute the final AO values for the two rows starting at the even row y0, over
+	 * the even span [x_begin, x_end). The rows within the image are written to ao and z,
+	 * which point to pixel (x_begin, y0) of a buffer with rows of out_stride floats
+	 */
+	void ao_band(const AOParams &params, int thread, int y0, int x_begin, int x_end,
+			float *ao, float *z, int out_stride);
+	TileRegion tile_region(int tile, int tiles_x, int tile_width, int tile_height, int reach) const;
+	// Run f(i) for i in [0, n) across our threads
+	void parallel_for(int n, const std::function<void(int thread, int i)> &f);
+};
+
+#endif
+
@@ -0,0 +1,13 @@
+// This file is compiled with AVX2 and FMA enabled, CpuAO only calls into it after
+// checking the CPU supports them
+#include "cpu_ao_kernel.h"
+
+#ifdef __AVX2__
+void ao_sample_row_avx2(const AOKernelData &d, int y, int x_begin, int x_end, float *sums){
+	ao_sample_row<SimdAVX2>(d, y, x_begin, x_end, sums);
+}
+void blur_row_avx2(const BlurKernelData &d, int y, int x_begin, int x_end){
+	blur_row<SimdAVX2>(d, y, x_begin, x_end);
+}
+#endif
+
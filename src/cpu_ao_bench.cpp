@@ -0,0 +1,255 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "ao_params.h"
+#include "float_image.h"
+#include "cpu_ao.h"
+
+// Error of the CPU AO values against the GPU's golden output
+struct AOError {
+	double mean_abs, rmse, max_abs, frac_over_tenth;
+	size_t pixels;
+};
+
+/*
+ * Compare the AO channel of the CPU result to the golden image, skipping pixels with no
+ * geometry (camera space z == 0) in the golden depth
+ */
+static AOError compare_ao(const AOBuffer &cpu, const FloatImage &golden, const FloatImage &depth){
+	AOError err{0, 0, 0, 0, 0};
+	for (int y = 0; y < cpu.height; ++y){
+		for (int x = 0; x < cpu.width; ++x){
+			const size_t px = static_cast<size_t>(y) * cpu.width + x;
+			if (depth.data[px] >= 0.f){
+				continue;
+			}
+			const double diff = std::abs(cpu.ao_at(x, y) - golden.data[px * golden.channels]);
+			err.mean_abs += diff;
+			err.rmse += diff * diff;
+			err.max_abs = std::max(err.max_abs, diff);
+			err.frac_over_tenth += diff > 0.1 ? 1 : 0;
+			++err.pixels;
+		}
+	}
+	if (err.pixels > 0){
+		err.mean_abs /= err.pixels;
+		err.rmse = std::sqrt(err.rmse / err.pixels);
+		err.frac_over_tenth /= err.pixels;
+	}
+	return err;
+}
+static void print_error(const std::string &name, const AOError &err){
+	std::printf("%s vs GLSL: mean abs err %.4f, RMSE %.4f, max abs err %.4f, %.2f%% of %zu pixels off by > 0.1\n",
+			name.c_str(), err.mean_abs, err.rmse, err.max_abs, 100.0 * err.frac_over_tenth, err.pixels);
+}
+/*
+ * Ray cast a simple scene of a floor, back wall and some spheres to get camera space
+ * depth for benchmarking without a golden dump from the renderer. The column-major
+ * projection matrix matching the rays is written to proj
+ */
+static FloatImage make_synthetic_scene(int width, int height, FloatImage &proj){
+	FloatImage img{width, height, 1, std::vector<float>(static_cast<size_t>(width) * height, 0.f)};
+	const float tan_half_fov = std::tan(75.f * 3.14159265f / 360.f);
+	const float aspect = static_cast<float>(width) / height;
+	proj = FloatImage{4, 4, 1, std::vector<float>(16, 0.f)};
+	proj.data[0] = 1.f / (tan_half_fov * aspect);
+	proj.data[5] = 1.f / tan_half_fov;
+	proj.data[10] = -1001.f / 999.f;
+	proj.data[11] = -1.f;
+	proj.data[14] = -2000.f / 999.f;
+	const float spheres[][4] = {
+		{-4, -1.5f, -14, 1.5f}, {0, -1, -18, 2}, {3.5f, -2, -12, 1}, {7, 0, -25, 3}, {-8, 1, -30, 4}
+	};
+	for (int y = 0; y < height; ++y){
+		for (int x = 0; x < width; ++x){
+			const float dx = ((x + 0.5f) / width * 2.f - 1.f) * tan_half_fov * aspect;
+			const float dy = ((y + 0.5f) / height * 2.f - 1.f) * tan_half_fov;
+			// Ray direction is (dx, dy, -1), so t gives the distance along -z
+			float t_hit = 1000.f;
+			if (dy < 0){
+				t_hit = std::min(t_hit, -3.f / dy);
+			}
+			t_hit = std::min(t_hit, 40.f);
+			for (const auto &s : spheres){
+				const float ox = -s[0], oy = -s[1], oz = -s[2];
+				const float a = dx * dx + dy * dy + 1.f;
+				const float b = 2.f * (ox * dx + oy * dy - oz);
+				const float c = ox * ox + oy * oy + oz * oz - s[3] * s[3];
+				const float disc = b * b - 4 * a * c;
+				if (disc >= 0){
+					const float t = (-b - std::sqrt(disc)) / (2 * a);
+					if (t > 0 && t < t_hit){
+						t_hit = t;
+					}
+				}
+			}
+			img.data[static_cast<size_t>(y) * width + x] = -t_hit;
+		}
+	}
+	return img;
+}
+template<typename F>
+static double time_ms(int iters, const F &f){
+	const auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < iters; ++i){
+		f();
+	}
+	const auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count() / iters;
+}
+/*
+ * Time the full-screen and tiled pipelines with 1, 2, 4, ... threads up to max_threads
+ * and print the throughput and parallel efficiency of each relative to a single thread
+ */
+static void report_scaling(const FloatImage &depth, const FloatImage &proj, const FloatImage &normals,
+		const AOParams &params, int max_threads, int iters, int tile_width, int tile_height)
+{
+	std::vector<int> thread_counts;
+	for (int t = 1; t < max_threads; t *= 2){
+		thread_counts.push_back(t);
+	}
+	thread_counts.push_back(max_threads);
+
+	const double mpix = static_cast<double>(depth.width) * depth.height * 1e-6;
+	double base_passes = 0, base_tiled = 0;
+	std::printf("threads, passes Mpix/s, speedup, efficiency, tiled Mpix/s, speedup, efficiency\n");
+	for (int t : thread_counts){
+		CpuAO cpu_ao{depth.width, depth.height, t};
+		cpu_ao.set_depth(depth.data.data(), proj.data.data());
+		if (!normals.data.empty()){
+			cpu_ao.set_normals(normals.data.data());
+		}
+		AOBuffer out, scratch;
+		cpu_ao.render(params, out, scratch);
+		cpu_ao.render_tiled(params, out, tile_width, tile_height);
+		const double passes = mpix / (time_ms(iters, [&](){ cpu_ao.render(params, out, scratch); }) * 1e-3);
+		const double tiled = mpix / (time_ms(iters, [&](){
+			cpu_ao.render_tiled(params, out, tile_width, tile_height);
+		}) * 1e-3);
+		if (t == 1){
+			base_passes = passes;
+			base_tiled = tiled;
+		}
+		std::printf("%d, %.1f, %.2fx, %.0f%%, %.1f, %.2fx, %.0f%%\n", t, passes, passes / base_passes,
+				100.0 * passes / (base_passes * t), tiled, tiled / base_tiled, 100.0 * tiled / (base_tiled * t));
+	}
+}
+
+int main(int argc, char **argv){
+	std::string golden_prefix;
+	int threads = 0, iters = 10, width = 1280, height = 720;
+	int tile_width = CPU_AO_TILE_WIDTH, tile_height = CPU_AO_TILE_HEIGHT;
+	bool scaling = false;
+	for (int i = 1; i < argc; ++i){
+		const std::string arg = argv[i];
+		if (arg == "-h" || arg == "--help"){
+			std::cout << "Usage: ./cpu_ao_bench [golden_prefix] [--threads N] [--iters N] [--size WxH]\n"
+				<< "\t[--tile WxH] [--scaling]\n"
+				<< "If the golden prefix from a --dump of the renderer is passed the AO is computed\n"
+				<< "on its depth and compared against the GLSL output, otherwise a synthetic\n"
+				<< "scene of the size passed is used. --scaling reports the throughput of the\n"
+				<< "full-screen and tiled pipelines from 1 thread up to --threads (default all)\n";
+			return 0;
+		}
+		if (arg == "--scaling"){
+			scaling = true;
+			continue;
+		}
+		if (arg[0] != '-'){
+			golden_prefix = arg;
+			continue;
+		}
+		if (i + 1 >= argc){
+			std::cout << "Missing value for argument " << arg << "\n";
+			return 1;
+		}
+		if (arg == "--threads"){
+			threads = std::stoi(argv[++i]);
+		}
+		else if (arg == "--iters"){
+			iters = std::max(std::stoi(argv[++i]), 1);
+		}
+		else if (arg == "--size"){
+			if (std::sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0){
+				std::cout << "Invalid size " << argv[i] << ", expected WxH\n";
+				return 1;
+			}
+		}
+		else if (arg == "--tile"){
+			if (std::sscanf(argv[++i], "%dx%d", &tile_width, &tile_height) != 2 || tile_width <= 0 || tile_height <= 0){
+				std::cout << "Invalid tile size " << argv[i] << ", expected WxH\n";
+				return 1;
+			}
+		}
+		else {
+			std::cout << "Unrecognized argument " << arg << "\n";
+			return 1;
+		}
+	}
+
+	AOParams params = DEFAULT_AO_PARAMS;
+	FloatImage depth, proj, normals, golden_ao, golden_blur;
+	const bool have_golden = !golden_prefix.empty();
+	if (have_golden){
+		if (!load_float_image(golden_prefix + "_depth.fimg", depth)
+				|| !load_float_image(golden_prefix + "_proj.fimg", proj)
+				|| !load_float_image(golden_prefix + "_ao.fimg", golden_ao)
+				|| !load_float_image(golden_prefix + "_ao_blur.fimg", golden_blur)
+				|| !load_ao_params(golden_prefix + "_params.txt", params)){
+			return 1;
+		}
+		if (params.use_rendered_normals && !load_float_image(golden_prefix + "_normals.fimg", normals)){
+			return 1;
+		}
+		width = depth.width;
+		height = depth.height;
+	}
+	else {
+		depth = make_synthetic_scene(width, height, proj);
+	}
+
+	CpuAO cpu_ao{width, height, threads};
+	std::cout << "CPU AO on " << width << "x" << height << " using " << cpu_ao.isa()
+		<< " with " << cpu_ao.threads() << " threads, " << params.n_samples << " samples/pixel\n";
+
+	const double pyramid_ms = time_ms(iters, [&](){ cpu_ao.set_depth(depth.data.data(), proj.data.data()); });
+	if (!normals.data.empty()){
+		cpu_ao.set_normals(normals.data.data());
+	}
+	AOBuffer ao, blurred, scratch;
+	// Run once to warm up the caches and allocate the buffers
+	cpu_ao.render(params, blurred, scratch);
+
+	const double ao_ms = time_ms(iters, [&](){ cpu_ao.compute_ao(params, ao); });
+	const double blur_ms = time_ms(iters, [&](){
+		cpu_ao.blur(params, ao, scratch, 0, 1);
+		cpu_ao.blur(params, scratch, blurred, 1, 0);
+	});
+	const double mpix = static_cast<double>(width) * height * 1e-6;
+	std::printf("pyramid: %.3f ms (%.1f Mpixels/s)\n", pyramid_ms, mpix / (pyramid_ms * 1e-3));
+	std::printf("ao sample: %.3f ms (%.1f Mpixels/s)\n", ao_ms, mpix / (ao_ms * 1e-3));
+	std::printf("blur (both axes): %.3f ms (%.1f Mpixels/s)\n", blur_ms, mpix / (blur_ms * 1e-3));
+	std::printf("total: %.3f ms (%.1f Mpixels/s)\n", pyramid_ms + ao_ms + blur_ms,
+			mpix / ((pyramid_ms + ao_ms + blur_ms) * 1e-3));
+	AOBuffer tiled;
+	const double tiled_ms = time_ms(iters, [&](){ cpu_ao.render_tiled(params, tiled, tile_width, tile_height); });
+	std::printf("tiled ao + blur (%dx%d tiles, %.2fx AO work): %.3f ms (%.1f Mpixels/s)\n", tile_width, tile_height,
+			cpu_ao.tile_overhead(params, tile_width, tile_height), tiled_ms, mpix / (tiled_ms * 1e-3));
+
+	if (have_golden){
+		// The per-pixel rotation is computed differently enough from the GPU's cos/sin of large
+		// angles that individual samples differ, so we compare the error statistics
+		print_error("AO sample", compare_ao(ao, golden_ao, depth));
+		print_error("Blurred AO", compare_ao(blurred, golden_blur, depth));
+		print_error("Tiled AO", compare_ao(tiled, golden_blur, depth));
+	}
+	if (scaling){
+		report_scaling(depth, proj, normals, params, cpu_ao.threads(), iters, tile_width, tile_height);
+	}
+	return 0;
+}
+
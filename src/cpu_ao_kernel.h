@@ -0,0 +1,254 @@
+#ifndef CPU_AO_KERNEL_H
+#define CPU_AO_KERNEL_H
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include "simd.h"
+
+// The level tables must hold 16 entries for SIMD lookups
+#define CPU_AO_MAX_LEVELS 16
+// Blur radius and gaussian weights, matching blur_frag.glsl
+#define CPU_AO_BLUR_RADIUS 4
+// Floats of padding after each plane so a SIMD load starting in the last row stays in bounds
+#define CPU_AO_PLANE_PAD 8
+const float CPU_AO_GAUSSIAN[CPU_AO_BLUR_RADIUS + 1] = {0.153170f, 0.144893f, 0.122649f, 0.092902f, 0.062970f};
+
+// Inputs to the AO sampling kernel, all pointers are owned by CpuAO
+struct AOKernelData {
+	// Planes for the x, y and z components of the level 0 camera space positions
+	const float *pos[3];
+	// The linear depth pyramid, each level is packed one after the other starting at
+	// level_offset[level] with level 0 shared with pos[2]
+	const float *depth;
+	// Planes for the x, y and z components of the level 0 camera space normals,
+	// only valid if we're using the rendered normals
+	const float *normal[3];
+	int32_t level_offset[CPU_AO_MAX_LEVELS];
+	int32_t level_width[CPU_AO_MAX_LEVELS];
+	int32_t level_height[CPU_AO_MAX_LEVELS];
+	int32_t level_stride[CPU_AO_MAX_LEVELS];
+	int levels;
+	// The quad aligned width and height we compute, these may be one past the image
+	// size but the level 0 planes are padded to cover them
+	int quad_width, quad_height;
+	int use_rendered_normals, n_samples;
+	// ball_radius * projection scale, the radius of the sample ball at z = -1
+	float screen_ball_radius;
+	// Reconstruct the camera space x, y at pixel p and depth z as z * (recon_a * p + recon_b),
+	// from the projection matrix and accounting for the pixel center
+	float recon_ax, recon_bx, recon_ay, recon_by;
+	float beta;
+	// Per-sample radius fraction and the cos/sin of the unrotated spiral angle
+	const float *sample_alpha, *sample_cos, *sample_sin;
+	// Per-pixel cos/sin of the random rotation phi, with the same layout as level 0
+	const float *cos_phi, *sin_phi;
+};
+
+/*
+ * Inputs to the bilateral blur kernel. The input and output buffers can each hold just a
+ * window of the image, with their first element being pixel (in_x, in_y) or (out_x, out_y)
+ */
+struct BlurKernelData {
+	const float *ao_in, *z_in;
+	float *ao_out, *z_out;
+	int in_x, in_y, in_stride;
+	int out_x, out_y, out_stride;
+	// The full image size, fetches outside of it read zero
+	int width, height;
+	int axis_x, axis_y, filter_scale;
+	float edge_sharpness;
+};
+
+// The kernels instantiated for each ISA, the AVX2 ones are only built when compiling for x86
+void ao_sample_row_sse2(const AOKernelData &d, int y, int x_begin, int x_end, float *sums);
+void blur_row_sse2(const BlurKernelData &d, int y, int x_begin, int x_end);
+void ao_sample_row_avx2(const AOKernelData &d, int y, int x_begin, int x_end, float *sums);
+void blur_row_avx2(const BlurKernelData &d, int y, int x_begin, int x_end);
+
+/*
+ * Compute the sum of the Alchemy AO estimator terms for the pixels [x_begin, x_end) of row y,
+ * pixel x is written to sums[x - x_begin]. x_begin must be even so SIMD lanes line up with
+ * the 2x2 quads, and sums is written in whole vectors so must be padded to the SIMD width.
+ * This is the sample loop of ao_sample_frag.glsl with each SIMD lane processing one pixel
+ */
+template<typename S>
+void ao_sample_row(const AOKernelData &d, int y, int x_begin, int x_end, float *sums){
+	typedef typename S::F F;
+	typedef typename S::I I;
+	const int stride = d.level_stride[0];
+	const int y0 = y & ~1;
+	const float *pos_row[3], *pos_y0[3], *pos_y1[3];
+	for (int c = 0; c < 3; ++c){
+		pos_row[c] = d.pos[c] + y * stride;
+		pos_y0[c] = d.pos[c] + y0 * stride;
+		pos_y1[c] = d.pos[c] + (y0 + 1) * stride;
+	}
+	const I max_mip = S::set1i(d.levels - 1);
+	const I zero_i = S::set1i(0);
+	const I four = S::set1i(4);
+	const I py = S::set1i(y);
+	const F zero = S::set1(0.f);
+	const F eps = S::set1(0.01f);
+	const F beta = S::set1(d.beta);
+	const F neg_radius = S::set1(-d.screen_ball_radius);
+	const F recon_ax = S::set1(d.recon_ax);
+	const F recon_bx = S::set1(d.recon_bx);
+	const F recon_ay = S::set1(d.recon_ay);
+	const F recon_by = S::set1(d.recon_by);
+
+	for (int x = x_begin; x < x_end; x += S::WIDTH){
+		F p[3];
+		for (int c = 0; c < 3; ++c){
+			p[c] = S::load(pos_row[c] + x);
+		}
+
+		F n[3];
+		if (d.use_rendered_normals){
+			for (int c = 0; c < 3; ++c){
+				n[c] = S::load(d.normal[c] + y * stride + x);
+			}
+		}
+		else {
+			F dx[3], dy[3];
+			for (int c = 0; c < 3; ++c){
+				dx[c] = S::quad_dx(pos_row[c], x);
+				dy[c] = S::sub(S::load(pos_y1[c] + x), S::load(pos_y0[c] + x));
+			}
+			n[0] = S::sub(S::mul(dx[1], dy[2]), S::mul(dx[2], dy[1]));
+			n[1] = S::sub(S::mul(dx[2], dy[0]), S::mul(dx[0], dy[2]));
+			n[2] = S::sub(S::mul(dx[0], dy[1]), S::mul(dx[1], dy[0]));
+		}
+		const F inv_len = S::div(S::set1(1.f), S::sqrt(S::add(S::add(S::mul(n[0], n[0]),
+							S::mul(n[1], n[1])), S::mul(n[2], n[2]))));
+		// The normal is biased by the depth in the estimator, fold it in here once
+		F nb[3];
+		for (int c = 0; c < 3; ++c){
+			nb[c] = S::add(S::mul(n[c], inv_len), S::mul(p[2], beta));
+		}
+
+		const F cphi = S::load(d.cos_phi + y * stride + x);
+		const F sphi = S::load(d.sin_phi + y * stride + x);
+		const F screen_radius = S::div(neg_radius, p[2]);
+		const I px = S::addi(S::set1i(x), S::iota());
+
+		F sum = zero;
+		for (int i = 0; i < d.n_samples; ++i){
+			const F h = S::mul(screen_radius, S::set1(d.sample_alpha[i]));
+			// Rotate the spiral direction for this sample by phi
+			const F ca = S::set1(d.sample_cos[i]);
+			const F sa = S::set1(d.sample_sin[i]);
+			const F ux = S::sub(S::mul(ca, cphi), S::mul(sa, sphi));
+			const F uy = S::add(S::mul(sa, cphi), S::mul(ca, sphi));
+			// findMSB(int(h)) - 4 is the exponent of h - 4 for h >= 1, and for h < 1 both
+			// clamp to level 0
+			const I m = S::mini(S::maxi(S::subi(S::exponent(h), four), zero_i), max_mip);
+			const I tap_x = S::addi(S::cvtt(S::mul(h, ux)), px);
+			const I tap_y = S::addi(S::cvtt(S::mul(h, uy)), py);
+			I sx = S::srav(tap_x, m);
+			I sy = S::srav(tap_y, m);
+			sx = S::mini(S::maxi(sx, zero_i), S::subi(S::lookup16(d.level_width, m), S::set1i(1)));
+			sy = S::mini(S::maxi(sy, zero_i), S::subi(S::lookup16(d.level_height, m), S::set1i(1)));
+			const I idx = S::addi(S::lookup16(d.level_offset, m),
+					S::addi(S::muli(sy, S::lookup16(d.level_stride, m)), sx));
+
+			// Only depth is stored in the pyramid, the tap's position is rebuilt at its
+			// full resolution screen position like the shader does
+			const F qz = S::gather(d.depth, idx);
+			const F vx = S::sub(S::mul(qz, S::add(S::mul(recon_ax, S::cvtf(tap_x)), recon_bx)), p[0]);
+			const F vy = S::sub(S::mul(qz, S::add(S::mul(recon_ay, S::cvtf(tap_y)), recon_by)), p[1]);
+			const F vz = S::sub(qz, p[2]);
+			const F num = S::add(S::add(S::mul(vx, nb[0]), S::mul(vy, nb[1])), S::mul(vz, nb[2]));
+			const F den = S::add(S::add(S::add(S::mul(vx, vx), S::mul(vy, vy)), S::mul(vz, vz)), eps);
+			sum = S::add(sum, S::div(S::max(zero, num), den));
+		}
+		S::store(sums + x - x_begin, sum);
+	}
+}
+
+/*
+ * Compute the blurred AO value for a single pixel, matching blur_frag.glsl. Fetches outside
+ * the image read zero as they would with robust texture access on the GPU
+ */
+inline void blur_pixel(const BlurKernelData &d, int x, int y){
+	const size_t center = static_cast<size_t>(y - d.in_y) * d.in_stride + x - d.in_x;
+	const float z_pos = d.z_in[center];
+	float weight = CPU_AO_GAUSSIAN[0];
+	float sum = weight * d.ao_in[center];
+	const float sharpness = d.edge_sharpness * 400.f;
+	for (int i = -CPU_AO_BLUR_RADIUS; i <= CPU_AO_BLUR_RADIUS; ++i){
+		if (i == 0){
+			continue;
+		}
+		const int px = x + d.axis_x * i * d.filter_scale;
+		const int py = y + d.axis_y * i * d.filter_scale;
+		float ao = 0, z = 0;
+		if (px >= 0 && px < d.width && py >= 0 && py < d.height){
+			const size_t idx = static_cast<size_t>(py - d.in_y) * d.in_stride + px - d.in_x;
+			ao = d.ao_in[idx];
+			z = d.z_in[idx];
+		}
+		float w = 0.3f + CPU_AO_GAUSSIAN[std::abs(i)];
+		w *= std::max(0.f, 1.f - sharpness * std::abs(z_pos - z));
+		sum += ao * w;
+		weight += w;
+	}
+	const size_t out = static_cast<size_t>(y - d.out_y) * d.out_stride + x - d.out_x;
+	d.ao_out[out] = sum / (weight + 0.0001f);
+	d.z_out[out] = z_pos;
+}
+
+/*
+ * Blur the pixels [x_begin, x_end) of row y along the kernel's axis, SIMD lanes process
+ * neighbouring pixels in the row. The input must cover the blur footprint of these pixels
+ * that lies within the image. Spans whose footprint leaves the image fall back to the
+ * scalar path
+ */
+template<typename S>
+void blur_row(const BlurKernelData &d, int y, int x_begin, int x_end){
+	typedef typename S::F F;
+	const int reach = CPU_AO_BLUR_RADIUS * d.filter_scale;
+	const F zero = S::set1(0.f);
+	const F one = S::set1(1.f);
+	const F sharpness = S::set1(d.edge_sharpness * 400.f);
+	const F eps = S::set1(0.0001f);
+	const float *ao_row = d.ao_in + static_cast<size_t>(y - d.in_y) * d.in_stride - d.in_x;
+	const float *z_row = d.z_in + static_cast<size_t>(y - d.in_y) * d.in_stride - d.in_x;
+	float *ao_out = d.ao_out + static_cast<size_t>(y - d.out_y) * d.out_stride - d.out_x;
+	float *z_out = d.z_out + static_cast<size_t>(y - d.out_y) * d.out_stride - d.out_x;
+	for (int x = x_begin; x < x_end; x += S::WIDTH){
+		const bool in_bounds = x + S::WIDTH <= x_end
+			&& (d.axis_x == 0 || (x - reach >= 0 && x + S::WIDTH - 1 + reach < d.width));
+		if (!in_bounds){
+			for (int l = x; l < std::min(x + S::WIDTH, x_end); ++l){
+				blur_pixel(d, l, y);
+			}
+			continue;
+		}
+		const F z_pos = S::load(z_row + x);
+		F weight = S::set1(CPU_AO_GAUSSIAN[0]);
+		F sum = S::mul(weight, S::load(ao_row + x));
+		for (int i = -CPU_AO_BLUR_RADIUS; i <= CPU_AO_BLUR_RADIUS; ++i){
+			if (i == 0){
+				continue;
+			}
+			const int px = x + d.axis_x * i * d.filter_scale;
+			const int py = y + d.axis_y * i * d.filter_scale;
+			F ao = zero, z = zero;
+			if (py >= 0 && py < d.height){
+				const size_t idx = static_cast<size_t>(py - d.in_y) * d.in_stride + px - d.in_x;
+				ao = S::load(d.ao_in + idx);
+				z = S::load(d.z_in + idx);
+			}
+			const F g = S::set1(0.3f + CPU_AO_GAUSSIAN[std::abs(i)]);
+			const F w = S::mul(g, S::max(zero, S::sub(one, S::mul(sharpness, S::abs(S::sub(z_pos, z))))));
+			sum = S::add(sum, S::mul(ao, w));
+			weight = S::add(weight, w);
+		}
+		S::store(ao_out + x, S::div(sum, S::add(weight, eps)));
+		S::store(z_out + x, z_pos);
+	}
+}
+
+#endif
+
@@ -0,0 +1,11 @@
+#include "cpu_ao_kernel.h"
+
+#ifdef SIMD_HAS_SSE2
+void ao_sample_row_sse2(const AOKernelData &d, int y, int x_begin, int x_end, float *sums){
+	ao_sample_row<SimdSSE2>(d, y, x_begin, x_end, sums);
+}
+void blur_row_sse2(const BlurKernelData &d, int y, int x_begin, int x_end){
+	blur_row<SimdSSE2>(d, y, x_begin, x_end);
+}
+#endif
+
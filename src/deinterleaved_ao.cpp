@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <iostream>
+#include "deinterleaved_ao.h"
+
+DeinterleavedAO::DeinterleavedAO(const std::string &shader_path, bool compact_gbuffer, int depth_unit,
+		int normals_unit, int first_unit)
+	: first_unit(first_unit), width(0), height(0), deinterleave_program(0), reinterleave_program(0),
+	deinterleave_level_unif(-1), deinterleave_layer_unif(-1),
+	ao_shaders(shader_path, compact_gbuffer, first_unit, normals_unit, AO_LAYOUT_DEINTERLEAVED), ao_variant(nullptr),
+	textures({0, 0}), ao_format(compact_gbuffer ? GL_RG16 : GL_RG32F)
+{
+	const std::vector<GLint> programs = load_programs({
+		{std::make_pair(GL_VERTEX_SHADER, shader_path + "ao_sample_vert.glsl"),
+			std::make_pair(GL_FRAGMENT_SHADER, shader_path + "depth_deinterleave_frag.glsl")},
+		{std::make_pair(GL_VERTEX_SHADER, shader_path + "ao_sample_vert.glsl"),
+			std::make_pair(GL_FRAGMENT_SHADER, shader_path + "ao_reinterleave_frag.glsl")}});
+	deinterleave_program = programs[0] != -1 ? programs[0] : 0;
+	reinterleave_program = programs[1] != -1 ? programs[1] : 0;
+	if (deinterleave_program != 0){
+		glUseProgram(deinterleave_program);
+		glUniform1i(glGetUniformLocation(deinterleave_program, "depth_in"), depth_unit);
+		deinterleave_level_unif = glGetUniformLocation(deinterleave_program, "level");
+		deinterleave_layer_unif = glGetUniformLocation(deinterleave_program, "layer");
+	}
+	if (reinterleave_program != 0){
+		glUseProgram(reinterleave_program);
+		glUniform1i(glGetUniformLocation(reinterleave_program, "ao_layers"), first_unit + 1);
+	}
+	glGenFramebuffers(depth_fbos.size(), depth_fbos.data());
+	glGenFramebuffers(ao_fbos.size(), ao_fbos.data());
+}
+DeinterleavedAO::~DeinterleavedAO(){
+	if (textures[0] != 0){
+		glDeleteTextures(textures.size(), textures.data());
+	}
+	glDeleteFramebuffers(depth_fbos.size(), depth_fbos.data());
+	glDeleteFramebuffers(ao_fbos.size(), ao_fbos.data());
+	for (const GLuint p : {deinterleave_program, reinterleave_program}){
+		if (p != 0){
+			glDeleteProgram(p);
+		}
+	}
+}
+bool DeinterleavedAO::is_valid() const {
+	return deinterleave_program != 0 && reinterleave_program != 0;
+}
+const AOVariant* DeinterleavedAO::update_variant(const AOParams &params, bool sample_heatmap){
+	if (!is_valid()){
+		return nullptr;
+	}
+	ao_shaders.poll();
+	// Only wait for the variant if we don't have one to draw with in the meantime
+	if (const AOVariant *v = ao_shaders.get(params, sample_heatmap, ao_variant == nullptr)){
+		ao_variant = v;
+	}
+	return ao_variant;
+}
+bool DeinterleavedAO::render(int ao_level, int width, int height, float phi_offset, GLuint out_fbo){
+	if (!is_valid() || !ao_variant){
+		return false;
+	}
+	if (width != this->width || height != this->height){
+		setup_targets(width, height);
+	}
+	const int layer_width = (width + AO_DEINTERLEAVE_FACTOR - 1) / AO_DEINTERLEAVE_FACTOR;
+	const int layer_height = (height + AO_DEINTERLEAVE_FACTOR - 1) / AO_DEINTERLEAVE_FACTOR;
+
+	glViewport(0, 0, layer_width, layer_height);
+	glUseProgram(deinterleave_program);
+	glUniform1i(deinterleave_level_unif, ao_level);
+	for (int i = 0; i < AO_DEINTERLEAVE_LAYERS; ++i){
+		glBindFramebuffer(GL_FRAMEBUFFER, depth_fbos[i]);
+		glUniform1i(deinterleave_layer_unif, i);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	}
+
+	// Every texel of the layers is written so they don't need clearing
+	glUseProgram(ao_variant->program);
+	glUniform1i(ao_variant->ao_level_unif, ao_level);
+	glUniform1f(ao_variant->phi_offset_unif, phi_offset);
+	for (int i = 0; i < AO_DEINTERLEAVE_LAYERS; ++i){
+		glBindFramebuffer(GL_FRAMEBUFFER, ao_fbos[i]);
+		glUniform1i(ao_variant->layer_unif, i);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	}
+
+	glViewport(0, 0, width, height);
+	glBindFramebuffer(GL_FRAMEBUFFER, out_fbo);
+	glUseProgram(reinterleave_program);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	return true;
+}
+size_t DeinterleavedAO::num_variants() const {
+	return ao_shaders.size();
+}
+size_t DeinterleavedAO::num_building() const {
+	return ao_shaders.num_building();
+}
+void DeinterleavedAO::poll(){
+	ao_shaders.poll();
+}
+void DeinterleavedAO::setup_targets(int width, int height){
+	if (textures[0] != 0){
+		glDeleteTextures(textures.size(), textures.data());
+	}
+	this->width = width;
+	this->height = height;
+	const int layer_width = (width + AO_DEINTERLEAVE_FACTOR - 1) / AO_DEINTERLEAVE_FACTOR;
+	const int layer_height = (height + AO_DEINTERLEAVE_FACTOR - 1) / AO_DEINTERLEAVE_FACTOR;
+	glGenTextures(textures.size(), textures.data());
+	const std::array<GLenum, 2> formats = {GL_R32F, ao_format};
+	for (size_t i = 0; i < textures.size(); ++i){
+		glActiveTexture(GL_TEXTURE0 + first_unit + i);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, textures[i]);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, formats[i], layer_width, layer_height, AO_DEINTERLEAVE_LAYERS);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		const auto &fbos = i == 0 ? depth_fbos : ao_fbos;
+		for (int l = 0; l < AO_DEINTERLEAVE_LAYERS; ++l){
+			glBindFramebuffer(GL_FRAMEBUFFER, fbos[l]);
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, textures[i], 0, l);
+			glDrawBuffer(GL_COLOR_ATTACHMENT0);
+		}
+	}
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){
+		std::cout << "DeinterleavedAO: layer framebuffers are incomplete\n";
+	}
+}
+
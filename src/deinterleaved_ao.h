@@ -0,0 +1,77 @@
+#ifndef DEINTERLEAVED_AO_H
+#define DEINTERLEAVED_AO_H
+
+#include <array>
+#include <string>
+#include "glt/gl_core_4_5.h"
+#include "ao_params.h"
+#include "shader_variants.h"
+
+// Side of the blocks of pixels split across the layers, and the number of layers
+const int AO_DEINTERLEAVE_FACTOR = 4;
+const int AO_DEINTERLEAVE_LAYERS = AO_DEINTERLEAVE_FACTOR * AO_DEINTERLEAVE_FACTOR;
+
+/*
+ * Computes the AO on deinterleaved depth to keep the AO pass' texture fetches coherent at
+ * large radii. A level of the depth pyramid is split into 16 quarter resolution layers of a
+ * 2D array, layer x + 4y holding the pixels at (x, y) of each 4x4 block. The AO is computed
+ * on each layer with one rotation of the sample spiral shared by all its pixels, so
+ * neighbouring pixels in a layer fetch neighbouring texels, and then gathered back into
+ * screen order. The 16 rotations in each block leave the same kind of noise as the per-pixel
+ * rotation, which the blur removes. Each layer is drawn on its own with the layer index in a
+ * uniform, so the offset and rotation are uniform across the draw. The Viewing and AO params
+ * blocks must be bound by the caller, and a vertex array bound as the passes are drawn
+ * without attributes
+ */
+class DeinterleavedAO {
+	int first_unit, width, height;
+	GLuint deinterleave_program, reinterleave_program;
+	GLint deinterleave_level_unif, deinterleave_layer_unif;
+	AOShaderCache ao_shaders;
+	// The variant last drawn with, kept while the one for new params is built in the background
+	const AOVariant *ao_variant;
+	// Deinterleaved linear depth and AO arrays, allocated for the AO resolution on first use
+	std::array<GLuint, 2> textures;
+	// Framebuffers rendering to each layer of the depth and AO arrays
+	std::array<GLuint, AO_DEINTERLEAVE_LAYERS> depth_fbos, ao_fbos;
+	GLenum ao_format;
+
+public:
+	/*
+	 * Setup the programs to compute AO from the depth pyramid and normals on the units passed.
+	 * The deinterleaved depth and AO arrays are bound to first_unit and the unit after it
+	 */
+	DeinterleavedAO(const std::string &shader_path, bool compact_gbuffer, int depth_unit, int normals_unit,
+			int first_unit);
+	~DeinterleavedAO();
+	DeinterleavedAO(const DeinterleavedAO&) = delete;
+	DeinterleavedAO& operator=(const DeinterleavedAO&) = delete;
+	// Check if the deinterleave and reinterleave programs compiled
+	bool is_valid() const;
+	/*
+	 * Pick the AO shader variant for the params, keeping the last one while the new one is
+	 * built in the background. Returns the variant render will draw with, so the caller can
+	 * match the sample pattern and heatmap to it, or null if none has compiled
+	 */
+	const AOVariant* update_variant(const AOParams &params, bool sample_heatmap);
+	/*
+	 * Compute the AO at level ao_level of the depth pyramid, which is width x height, with the
+	 * variant picked by update_variant and write it in screen order to out_fbo. The arrays are
+	 * reallocated if the size changed. Returns false if there's no variant to draw with, in
+	 * which case nothing is written
+	 */
+	bool render(int ao_level, int width, int height, float phi_offset, GLuint out_fbo);
+	// The number of AO shader variants compiled
+	size_t num_variants() const;
+	// The number of AO shader variants being built in the background
+	size_t num_building() const;
+	// Finish the AO shader variants built in the background, see AOShaderCache::poll. Done by
+	// update_variant, so only needed while it's not being called
+	void poll();
+
+private:
+	void setup_targets(int width, int height);
+};
+
+#endif
+
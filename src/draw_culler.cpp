@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include "glt/draw_elems_indirect_cmd.h"
+#include "shader_variants.h"
+#include "draw_culler.h"
+
+static const GLuint CULL_WORK_GROUP_SIZE = 64;
+
+DrawCuller::DrawCuller(const std::string &shader_path, glt::BufferAllocator &allocator, const ModelGeometry &geom,
+		const std::unordered_map<std::string, glt::ModelMatInfo> &model_info,
+		const glt::SubBuffer &draw_cmds, float model_scale, MultiDrawElementsIndirectCountFn multi_draw_count)
+	: draw_cmds(draw_cmds), num_draws(model_info.size()), total_triangles(0), multi_draw_count(multi_draw_count),
+	culled(false), readback_buf(0), readback_slot(0)
+{
+	program = load_program_variant({std::make_pair(GL_COMPUTE_SHADER, shader_path + "cull_comp.glsl")}, {});
+	if (program == -1){
+		std::cout << "Failed to load the culling shader, culling will be disabled\n";
+	}
+	num_draws_unif = glGetUniformLocation(program, "num_draws");
+	compact_unif = glGetUniformLocation(program, "compact");
+
+	std::vector<DrawBounds> bounds;
+	for (const auto &m : model_info){
+		DrawBounds b;
+		std::fill(b.lower, b.lower + 4, std::numeric_limits<float>::max());
+		std::fill(b.upper, b.upper + 4, std::numeric_limits<float>::lowest());
+		for (size_t i = m.second.index_offset; i < m.second.index_offset + m.second.indices; ++i){
+			const float *p = &geom.vertices[(m.second.vert_offset + geom.indices[i]) * MODEL_VERTEX_FLOATS];
+			for (size_t c = 0; c < 3; ++c){
+				b.lower[c] = std::min(b.lower[c], p[c] * model_scale);
+				b.upper[c] = std::max(b.upper[c], p[c] * model_scale);
+			}
+		}
+		b.lower[3] = b.upper[3] = 0;
+		bounds.push_back(b);
+		total_triangles += m.second.indices / 3;
+	}
+	last_stats = CullStats{num_draws, total_triangles, num_draws, total_triangles};
+
+	GLint ssbo_alignment = 0;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &ssbo_alignment);
+	bounds_buf = allocator.alloc(bounds.size() * sizeof(DrawBounds), ssbo_alignment);
+	{
+		DrawBounds *b = static_cast<DrawBounds*>(bounds_buf.map(GL_SHADER_STORAGE_BUFFER,
+					GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_WRITE_BIT));
+		std::copy(bounds.begin(), bounds.end(), b);
+		bounds_buf.unmap(GL_SHADER_STORAGE_BUFFER);
+	}
+	culled_cmds = allocator.alloc(num_draws * sizeof(glt::DrawElemsIndirectCmd), ssbo_alignment);
+	counters = allocator.alloc(2 * sizeof(GLuint), ssbo_alignment);
+
+	glGenBuffers(1, &readback_buf);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, readback_buf);
+	glBufferData(GL_COPY_WRITE_BUFFER, readback_fences.size() * 2 * sizeof(GLuint), nullptr, GL_STREAM_READ);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	readback_fences.fill(nullptr);
+}
+DrawCuller::~DrawCuller(){
+	for (auto &f : readback_fences){
+		if (f){
+			glDeleteSync(f);
+		}
+	}
+	glDeleteBuffers(1, &readback_buf);
+	if (program != -1){
+		glDeleteProgram(program);
+	}
+}
+void DrawCuller::cull(bool enabled){
+	culled = enabled && program != -1;
+	if (!culled){
+		last_stats = CullStats{num_draws, total_triangles, num_draws, total_triangles};
+		return;
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, counters.buffer);
+	glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, counters.offset, counters.size, GL_RED_INTEGER,
+			GL_UNSIGNED_INT, nullptr);
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 7, bounds_buf.buffer, bounds_buf.offset, bounds_buf.size);
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 8, draw_cmds.buffer, draw_cmds.offset, draw_cmds.size);
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 9, culled_cmds.buffer, culled_cmds.offset, culled_cmds.size);
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 10, counters.buffer, counters.offset, counters.size);
+	glUseProgram(program);
+	glUniform1ui(num_draws_unif, num_draws);
+	glUniform1i(compact_unif, multi_draw_count != nullptr);
+	glDispatchCompute((num_draws + CULL_WORK_GROUP_SIZE - 1) / CULL_WORK_GROUP_SIZE, 1, 1);
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	// Collect the counters copied out when this slot was last used, which the GPU should
+	// be long done with, before copying this frame's in
+	GLsync &fence = readback_fences[readback_slot];
+	const GLintptr slot_offset = readback_slot * 2 * sizeof(GLuint);
+	glBindBuffer(GL_COPY_READ_BUFFER, counters.buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, readback_buf);
+	if (fence){
+		GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		while (status == GL_TIMEOUT_EXPIRED){
+			status = glClientWaitSync(fence, 0, 1000000);
+		}
+		glDeleteSync(fence);
+		GLuint visible[2] = {0, 0};
+		glGetBufferSubData(GL_COPY_WRITE_BUFFER, slot_offset, sizeof(visible), visible);
+		last_stats = CullStats{num_draws, total_triangles, visible[0], visible[1]};
+	}
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, counters.offset, slot_offset, 2 * sizeof(GLuint));
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readback_slot = (readback_slot + 1) % readback_fences.size();
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+void DrawCuller::draw() const {
+	const glt::SubBuffer &cmds = culled ? culled_cmds : draw_cmds;
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cmds.buffer);
+	if (culled && multi_draw_count){
+		glBindBuffer(GL_PARAMETER_BUFFER_ARB, counters.buffer);
+		multi_draw_count(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void*>(cmds.offset), counters.offset,
+				num_draws, sizeof(glt::DrawElemsIndirectCmd));
+	}
+	else {
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void*>(cmds.offset),
+				num_draws, sizeof(glt::DrawElemsIndirectCmd));
+	}
+}
+bool DrawCuller::has_draw_count() const {
+	return multi_draw_count != nullptr;
+}
+const CullStats& DrawCuller::stats() const {
+	return last_stats;
+}
+
@@ -0,0 +1,79 @@
+#ifndef DRAW_CULLER_H
+#define DRAW_CULLER_H
+
+#include <array>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "glt/gl_core_4_5.h"
+#include "glt/buffer_allocator.h"
+#include "glt/load_models.h"
+#include "model_geometry.h"
+
+#ifndef GL_PARAMETER_BUFFER_ARB
+#define GL_PARAMETER_BUFFER_ARB 0x80EE
+#endif
+
+// glMultiDrawElementsIndirectCount from GL 4.6 or ARB_indirect_parameters
+typedef void (APIENTRY *MultiDrawElementsIndirectCountFn)(GLenum mode, GLenum type, const void *indirect,
+		GLintptr drawcount, GLsizei maxdrawcount, GLsizei stride);
+
+// Bounds of a draw's geometry, padded to vec4s to match Bounds in cull_comp.glsl
+struct DrawBounds {
+	float lower[4], upper[4];
+};
+
+// The number of draws and triangles submitted and how many of them passed culling
+struct CullStats {
+	size_t draws, triangles, visible_draws, visible_triangles;
+};
+
+/*
+ * Culls the scene's draws against the view frustum in a compute shader, which writes the
+ * visible draws to a compacted list of indirect draw commands along with their count. The
+ * count is read on the GPU by glMultiDrawElementsIndirectCount if it's available, otherwise
+ * culled draws keep their place in the list with an instance count of 0. The bounds of each
+ * draw are computed once at load from the model's geometry
+ */
+class DrawCuller {
+	GLint program;
+	GLint num_draws_unif, compact_unif;
+	glt::SubBuffer draw_cmds, bounds_buf, culled_cmds, counters;
+	size_t num_draws, total_triangles;
+	MultiDrawElementsIndirectCountFn multi_draw_count;
+	// If the draws were culled this frame
+	bool culled;
+	// The counters are copied into a ring to be read back a few frames later without stalling
+	GLuint readback_buf;
+	std::array<GLsync, 3> readback_fences;
+	size_t readback_slot;
+	CullStats last_stats;
+
+public:
+	/*
+	 * Setup culling of the draw commands, which draw the models in model_info in order.
+	 * The model's positions are scaled by model_scale in the vertex shader
+	 */
+	DrawCuller(const std::string &shader_path, glt::BufferAllocator &allocator, const ModelGeometry &geom,
+			const std::unordered_map<std::string, glt::ModelMatInfo> &model_info,
+			const glt::SubBuffer &draw_cmds, float model_scale, MultiDrawElementsIndirectCountFn multi_draw_count);
+	~DrawCuller();
+	DrawCuller(const DrawCuller&) = delete;
+	DrawCuller& operator=(const DrawCuller&) = delete;
+	/*
+	 * Cull the draws against the frustum of the Viewing block currently bound, if enabled,
+	 * so that draw only submits the visible ones this frame
+	 */
+	void cull(bool enabled);
+	/*
+	 * Draw the scene with the program, VAO and framebuffer currently bound
+	 */
+	void draw() const;
+	// If glMultiDrawElementsIndirectCount is used to draw the compacted commands
+	bool has_draw_count() const;
+	// The stats of the most recent frame we've read back, a few frames behind
+	const CullStats& stats() const;
+};
+
+#endif
+
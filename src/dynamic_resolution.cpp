@@ -0,0 +1,62 @@
+#include <algorithm>
+#include <cmath>
+#include "dynamic_resolution.h"
+
+// Weight of the newest frame in the smoothed frame time
+static const double SMOOTHING = 0.1;
+// Frames to wait after changing the scale, enough for the timer query ring to drain
+// and the smoothed time to settle at the new resolution
+static const size_t SETTLE_FRAMES = 30;
+// Don't chase the target if we're within this fraction below it
+static const double HEADROOM = 0.85;
+static const float SCALE_STEP = 1.f / 16.f;
+static const float MAX_CHANGE = 0.125f;
+
+DynamicResolution::DynamicResolution(float target_ms, float min_scale, float max_scale)
+	: target_ms(target_ms), min_scale(min_scale), max_scale(max_scale), scale(max_scale),
+	smoothed_ms(0), frames_since_change(0)
+{}
+bool DynamicResolution::update(double gpu_ms){
+	if (gpu_ms <= 0){
+		return false;
+	}
+	++frames_since_change;
+	// Only average times measured at the current resolution
+	if (frames_since_change <= SETTLE_FRAMES / 2){
+		smoothed_ms = gpu_ms;
+		return false;
+	}
+	smoothed_ms += SMOOTHING * (gpu_ms - smoothed_ms);
+	if (frames_since_change < SETTLE_FRAMES
+			|| (smoothed_ms <= target_ms && smoothed_ms >= HEADROOM * target_ms)){
+		return false;
+	}
+	const float ideal = scale * static_cast<float>(std::sqrt(target_ms / smoothed_ms));
+	float next = std::max(std::min(ideal, scale + MAX_CHANGE), scale - MAX_CHANGE);
+	// Round down so we land under the target rather than overshooting it
+	next = std::floor(next / SCALE_STEP + 1e-3f) * SCALE_STEP;
+	next = std::max(std::min(next, max_scale), min_scale);
+	if (next == scale){
+		return false;
+	}
+	scale = next;
+	frames_since_change = 0;
+	return true;
+}
+void DynamicResolution::set_scale(float s){
+	scale = std::max(std::min(s, max_scale), min_scale);
+	frames_since_change = 0;
+}
+void DynamicResolution::set_target(float ms){
+	target_ms = ms;
+}
+float DynamicResolution::get_scale() const {
+	return scale;
+}
+float DynamicResolution::get_target() const {
+	return target_ms;
+}
+double DynamicResolution::frame_ms() const {
+	return smoothed_ms;
+}
+
@@ -0,0 +1,37 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <cstddef>
+
+/*
+ * Picks the scale of the internal render resolution to hold the GPU frame time near a
+ * target. The measured times are smoothed and, since the cost of most passes goes with
+ * the pixel count, the scale is moved towards scale * sqrt(target / measured). Changes are
+ * snapped to steps of 1/16 and limited in size, and after each change we wait for the
+ * times of frames at the new resolution to come back before changing it again, so the
+ * render targets aren't reallocated every frame
+ */
+class DynamicResolution {
+	float target_ms, min_scale, max_scale, scale;
+	double smoothed_ms;
+	// Frames measured since the scale last changed
+	size_t frames_since_change;
+
+public:
+	DynamicResolution(float target_ms, float min_scale = 0.5f, float max_scale = 1.f);
+	/*
+	 * Update the controller with the GPU time of a frame in milliseconds, returns true
+	 * if the scale changed
+	 */
+	bool update(double gpu_ms);
+	// Set the scale directly, e.g. when the controller is turned off
+	void set_scale(float s);
+	void set_target(float ms);
+	float get_scale() const;
+	float get_target() const;
+	// The smoothed GPU frame time
+	double frame_ms() const;
+};
+
+#endif
+
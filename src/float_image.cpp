@@ -0,0 +1,44 @@
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "float_image.h"
+
+bool save_float_image(const std::string &file, const FloatImage &img){
+	std::ofstream fout{file, std::ios::binary};
+	if (!fout){
+		std::cout << "Failed to open " << file << " for writing\n";
+		return false;
+	}
+	const int32_t header[3] = {img.width, img.height, img.channels};
+	fout.write("FIMG", 4);
+	fout.write(reinterpret_cast<const char*>(header), sizeof(header));
+	fout.write(reinterpret_cast<const char*>(img.data.data()), img.data.size() * sizeof(float));
+	return static_cast<bool>(fout);
+}
+bool load_float_image(const std::string &file, FloatImage &img){
+	std::ifstream fin{file, std::ios::binary};
+	if (!fin){
+		std::cout << "Failed to open " << file << "\n";
+		return false;
+	}
+	char tag[4];
+	int32_t header[3];
+	fin.read(tag, 4);
+	fin.read(reinterpret_cast<char*>(header), sizeof(header));
+	if (!fin || std::memcmp(tag, "FIMG", 4) != 0 || header[0] <= 0 || header[1] <= 0 || header[2] <= 0){
+		std::cout << file << " is not a valid float image\n";
+		return false;
+	}
+	img.width = header[0];
+	img.height = header[1];
+	img.channels = header[2];
+	img.data.resize(static_cast<size_t>(img.width) * img.height * img.channels);
+	fin.read(reinterpret_cast<char*>(img.data.data()), img.data.size() * sizeof(float));
+	if (!fin){
+		std::cout << file << " is truncated\n";
+		return false;
+	}
+	return true;
+}
+
@@ -0,0 +1,22 @@
+#ifndef FLOAT_IMAGE_H
+#define FLOAT_IMAGE_H
+
+#include <string>
+#include <vector>
+
+// A raw float image with interleaved channels, used to dump render targets from the
+// GL renderer so they can be used as golden references for the CPU AO implementation
+struct FloatImage {
+	int width, height, channels;
+	std::vector<float> data;
+};
+
+/*
+ * Save/load the image, the file is a "FIMG" tag followed by the width, height and
+ * channels as 32 bit ints and then the float data, all little endian
+ */
+bool save_float_image(const std::string &file, const FloatImage &img);
+bool load_float_image(const std::string &file, FloatImage &img);
+
+#endif
+
@@ -0,0 +1,48 @@
+#include "gl_caps.h"
+#include "fragment_counter.h"
+
+FragmentCounter::FragmentCounter(size_t frames_in_flight)
+	: queries(frames_in_flight, 0), issued(frames_in_flight, false), frame(0),
+	supported(gl_version_at_least(4, 6) || gl_has_extension("GL_ARB_pipeline_statistics_query")),
+	last_count(0)
+{
+	if (supported){
+		glGenQueries(queries.size(), queries.data());
+	}
+}
+FragmentCounter::~FragmentCounter(){
+	if (supported){
+		glDeleteQueries(queries.size(), queries.data());
+	}
+}
+void FragmentCounter::begin(){
+	if (!supported){
+		return;
+	}
+	const size_t q = frame % queries.size();
+	glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB, queries[q]);
+	issued[q] = true;
+}
+void FragmentCounter::end(){
+	if (supported){
+		glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB);
+	}
+}
+void FragmentCounter::end_frame(){
+	++frame;
+	const size_t q = frame % queries.size();
+	if (issued[q]){
+		// By now the GPU should be done with the frame so this won't block
+		GLuint64 count = 0;
+		glGetQueryObjectui64v(queries[q], GL_QUERY_RESULT, &count);
+		last_count = count;
+		issued[q] = false;
+	}
+}
+bool FragmentCounter::is_supported() const {
+	return supported;
+}
+uint64_t FragmentCounter::last() const {
+	return last_count;
+}
+
@@ -0,0 +1,48 @@
+#ifndef FRAGMENT_COUNTER_H
+#define FRAGMENT_COUNTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "glt/gl_core_4_5.h"
+
+#ifndef GL_FRAGMENT_SHADER_INVOCATIONS_ARB
+#define GL_FRAGMENT_SHADER_INVOCATIONS_ARB 0x82F4
+#endif
+
+/*
+ * Counts the fragment shader invocations of a pass with the pipeline statistics queries
+ * from GL 4.6 or ARB_pipeline_statistics_query. Like the PassTimer the queries are kept
+ * in a ring a few frames deep and read back when their slot is about to be re-used, so
+ * the count lags a few frames behind. Does nothing if the queries aren't supported
+ */
+class FragmentCounter {
+	std::vector<GLuint> queries;
+	std::vector<bool> issued;
+	size_t frame;
+	bool supported;
+	uint64_t last_count;
+
+public:
+	FragmentCounter(size_t frames_in_flight = 3);
+	~FragmentCounter();
+	FragmentCounter(const FragmentCounter&) = delete;
+	FragmentCounter& operator=(const FragmentCounter&) = delete;
+	/*
+	 * Start/stop counting the fragments shaded by the pass, at most one pass can be
+	 * counted each frame
+	 */
+	void begin();
+	void end();
+	/*
+	 * Mark the end of the frame, reading back the count of the oldest frame in the
+	 * ring if it's now going to be re-used
+	 */
+	void end_frame();
+	bool is_supported() const;
+	// The count from the most recent frame we've read back
+	uint64_t last() const;
+};
+
+#endif
+
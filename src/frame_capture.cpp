@@ -0,0 +1,255 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#ifndef _WIN32
+#include <csignal>
+#endif
+#include "float_image.h"
+#include "png_image.h"
+#include "frame_capture.h"
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+FrameCapture::FrameCapture(const CaptureConfig &config, bool drop_frames)
+	: config(config), drop_frames(drop_frames), next_pbo(0), captured(0), dropped(0), written(0), failed(0),
+	raw_width(0), raw_height(0), stream(nullptr), pipe(false), quit(false)
+{
+	// The PNGs drop the final frame's alpha, raw frames keep it so they're 4 byte aligned
+	// RGBA as encoders expect. The float images read the targets as floats
+	if (config.source == CAPTURE_AO){
+		channels = 1;
+		pixel_format = GL_RED;
+	}
+	else {
+		channels = config.format == CAPTURE_RAW ? 4 : 3;
+		pixel_format = channels == 4 ? GL_RGBA : GL_RGB;
+	}
+	pixel_type = config.format == CAPTURE_FIMG ? GL_FLOAT : GL_UNSIGNED_BYTE;
+	pixel_bytes = channels * (config.format == CAPTURE_FIMG ? sizeof(float) : 1);
+
+	if (config.format == CAPTURE_RAW){
+		if (!config.output.empty() && config.output[0] == '|'){
+#ifndef _WIN32
+			// Don't get killed if the command exits before we're done writing to it
+			std::signal(SIGPIPE, SIG_IGN);
+#endif
+			stream = popen(config.output.substr(1).c_str(), "w");
+			pipe = true;
+		}
+		else {
+			stream = std::fopen(config.output.c_str(), "wb");
+		}
+		if (!stream){
+			std::cout << "FrameCapture: failed to open " << config.output << " for raw frames\n";
+		}
+	}
+	for (auto &p : pbos){
+		glGenBuffers(1, &p.buffer);
+		p.capacity = 0;
+		p.fence = 0;
+		p.frame = 0;
+		p.width = 0;
+		p.height = 0;
+	}
+	writer = std::thread([this](){ write_loop(); });
+}
+FrameCapture::~FrameCapture(){
+	finish();
+}
+bool FrameCapture::is_valid() const {
+	return config.format != CAPTURE_RAW || stream != nullptr;
+}
+void FrameCapture::capture(GLuint fbo, GLenum read_buffer, int width, int height){
+	if (!writer.joinable()){
+		return;
+	}
+	// Hand the frames the GPU is done copying to the writer, oldest first
+	for (int i = 0; i < CAPTURE_PBOS; ++i){
+		PixelBuffer &p = pbos[(next_pbo + i) % CAPTURE_PBOS];
+		if (p.fence && !retire(p, false)){
+			break;
+		}
+	}
+	// If the GPU is a whole ring of frames behind we have to wait for it
+	PixelBuffer &p = pbos[next_pbo];
+	retire(p, true);
+
+	if (captured == 0 && config.format == CAPTURE_RAW){
+		std::cout << "Capturing " << width << "x" << height << " " << (channels == 1 ? "gray" : "rgba")
+			<< " raw frames to " << config.output << "\n";
+	}
+	const size_t bytes = static_cast<size_t>(width) * height * pixel_bytes;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, p.buffer);
+	if (bytes > p.capacity){
+		glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+		p.capacity = bytes;
+	}
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+	glReadBuffer(read_buffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, pixel_format, pixel_type, nullptr);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	p.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	p.frame = captured++;
+	p.width = width;
+	p.height = height;
+	next_pbo = (next_pbo + 1) % CAPTURE_PBOS;
+}
+void FrameCapture::finish(){
+	if (!writer.joinable()){
+		return;
+	}
+	for (int i = 0; i < CAPTURE_PBOS; ++i){
+		retire(pbos[(next_pbo + i) % CAPTURE_PBOS], true);
+	}
+	for (auto &p : pbos){
+		glDeleteBuffers(1, &p.buffer);
+	}
+	{
+		std::lock_guard<std::mutex> lock{mutex};
+		quit = true;
+	}
+	frame_ready.notify_all();
+	writer.join();
+	if (stream){
+		if (pipe){
+			pclose(stream);
+		}
+		else {
+			std::fclose(stream);
+		}
+		stream = nullptr;
+	}
+	std::cout << "Captured " << captured << " frames, wrote " << written << ", dropped " << dropped;
+	if (failed > 0){
+		std::cout << ", failed to write " << failed;
+	}
+	std::cout << "\n";
+}
+size_t FrameCapture::frames_captured() const {
+	return captured;
+}
+size_t FrameCapture::frames_written() const {
+	return written;
+}
+size_t FrameCapture::frames_dropped() const {
+	return dropped;
+}
+const CaptureConfig& FrameCapture::settings() const {
+	return config;
+}
+bool FrameCapture::retire(PixelBuffer &p, bool wait){
+	if (!p.fence){
+		return true;
+	}
+	const GLenum status = glClientWaitSync(p.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+			wait ? GL_TIMEOUT_IGNORED : 0);
+	if (status == GL_TIMEOUT_EXPIRED){
+		return false;
+	}
+	glDeleteSync(p.fence);
+	p.fence = 0;
+
+	Frame frame{p.frame, p.width, p.height, {}};
+	{
+		std::unique_lock<std::mutex> lock{mutex};
+		if (queue.size() >= CAPTURE_MAX_QUEUED_FRAMES){
+			if (drop_frames){
+				++dropped;
+				return true;
+			}
+			queue_space.wait(lock, [&](){ return queue.size() < CAPTURE_MAX_QUEUED_FRAMES; });
+		}
+		if (!free_data.empty()){
+			frame.data = std::move(free_data.back());
+			free_data.pop_back();
+		}
+	}
+	const size_t bytes = static_cast<size_t>(p.width) * p.height * pixel_bytes;
+	frame.data.resize(bytes);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, p.buffer);
+	const void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+	if (!data){
+		std::cout << "FrameCapture: failed to map frame " << p.frame << "\n";
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		++failed;
+		return true;
+	}
+	std::memcpy(frame.data.data(), data, bytes);
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	{
+		std::lock_guard<std::mutex> lock{mutex};
+		queue.push_back(std::move(frame));
+	}
+	frame_ready.notify_one();
+	return true;
+}
+void FrameCapture::write_loop(){
+	for (;;){
+		Frame frame;
+		{
+			std::unique_lock<std::mutex> lock{mutex};
+			frame_ready.wait(lock, [&](){ return quit || !queue.empty(); });
+			// Only stop once everything queued has been written
+			if (queue.empty()){
+				return;
+			}
+			frame = std::move(queue.front());
+			queue.pop_front();
+		}
+		queue_space.notify_one();
+		if (write_frame(frame)){
+			++written;
+		}
+		else {
+			++failed;
+		}
+		std::lock_guard<std::mutex> lock{mutex};
+		free_data.push_back(std::move(frame.data));
+	}
+}
+bool FrameCapture::write_frame(Frame &frame){
+	if (config.format == CAPTURE_FIMG){
+		FloatImage img{frame.width, frame.height, channels,
+			std::vector<float>(static_cast<size_t>(frame.width) * frame.height * channels)};
+		std::memcpy(img.data.data(), frame.data.data(), frame.data.size());
+		char suffix[32];
+		std::snprintf(suffix, sizeof(suffix), "_%05zu.fimg", frame.index);
+		return save_float_image(config.output + suffix, img);
+	}
+
+	// GL reads the rows from the bottom up
+	const size_t row_bytes = static_cast<size_t>(frame.width) * pixel_bytes;
+	for (int y = 0; y < frame.height / 2; ++y){
+		std::swap_ranges(frame.data.begin() + y * row_bytes, frame.data.begin() + (y + 1) * row_bytes,
+				frame.data.begin() + (frame.height - 1 - y) * row_bytes);
+	}
+	if (config.format == CAPTURE_PNG){
+		char suffix[32];
+		std::snprintf(suffix, sizeof(suffix), "_%05zu.png", frame.index);
+		return save_png(config.output + suffix, frame.width, frame.height, channels, frame.data.data());
+	}
+	if (!stream){
+		return false;
+	}
+	if (raw_width == 0){
+		raw_width = frame.width;
+		raw_height = frame.height;
+	}
+	else if (frame.width != raw_width || frame.height != raw_height){
+		// A change in size would garble the rest of the stream, so skip the frame
+		if (failed == 0){
+			std::cout << "FrameCapture: frame " << frame.index << " is " << frame.width << "x" << frame.height
+				<< " but the raw stream is " << raw_width << "x" << raw_height << ", skipping it\n";
+		}
+		return false;
+	}
+	return std::fwrite(frame.data.data(), 1, frame.data.size(), stream) == frame.data.size();
+}
+
@@ -0,0 +1,122 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "glt/gl_core_4_5.h"
+
+// Number of pixel buffers frames are read back through
+const int CAPTURE_PBOS = 3;
+// Most frames waiting on the writer thread before we drop or wait, see FrameCapture
+const size_t CAPTURE_MAX_QUEUED_FRAMES = 8;
+
+// What to capture: the final frame as shown, without the UI, or the AO target
+enum CAPTURE_SOURCE { CAPTURE_FINAL, CAPTURE_AO };
+/*
+ * How captured frames are written: a sequence of 8 bit PNGs, a sequence of float images
+ * (see float_image.h) or raw 8 bit frames back to back in one stream, RGBA for the final
+ * frame and gray for the AO
+ */
+enum CAPTURE_FORMAT { CAPTURE_PNG, CAPTURE_FIMG, CAPTURE_RAW };
+
+struct CaptureConfig {
+	// The prefix of the image sequences, written as <output>_<frame>.png/.fimg. Raw frames are
+	// written to this file, or if it starts with | piped to the rest of it run as a command
+	std::string output;
+	CAPTURE_SOURCE source;
+	CAPTURE_FORMAT format;
+};
+
+/*
+ * Captures rendered frames without stalling the render loop. Each frame is read into the next
+ * of a ring of pixel buffers and fenced, and only mapped once the GPU has finished the copy,
+ * by which point we're a frame or two further on. The pixels are then handed to a writer
+ * thread which encodes and writes them out. If the writer falls CAPTURE_MAX_QUEUED_FRAMES
+ * behind, new frames are either dropped, keeping the frame rate, or we wait for it to catch
+ * up. Frames are numbered by the order they were captured in, so dropped frames leave a gap
+ * in the sequence. The PNGs and raw frames are flipped to go from top to bottom, the float
+ * images keep GL's bottom to top row order like the renderer's other float dumps
+ */
+class FrameCapture {
+	struct PixelBuffer {
+		GLuint buffer;
+		size_t capacity;
+		// Signalled once the frame has been copied into the buffer, null if it's free
+		GLsync fence;
+		size_t frame;
+		int width, height;
+	};
+	struct Frame {
+		size_t index;
+		int width, height;
+		std::vector<uint8_t> data;
+	};
+
+	CaptureConfig config;
+	bool drop_frames;
+	int channels;
+	GLenum pixel_format, pixel_type;
+	size_t pixel_bytes;
+	std::array<PixelBuffer, CAPTURE_PBOS> pbos;
+	// The buffer the next frame is read into, the oldest one still in use if they all are
+	int next_pbo;
+	size_t captured, dropped;
+	std::atomic<size_t> written, failed;
+	// Size of the first raw frame, the frames in a raw stream must all be the same size
+	int raw_width, raw_height;
+	FILE *stream;
+	bool pipe;
+
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable frame_ready, queue_space;
+	std::deque<Frame> queue;
+	// Pixel data of frames which have been written, reused for the frames after them
+	std::vector<std::vector<uint8_t>> free_data;
+	bool quit;
+
+public:
+	/*
+	 * Setup the capture and start the writer thread. If drop_frames is set frames are dropped
+	 * when the writer falls behind, otherwise we wait for it
+	 */
+	FrameCapture(const CaptureConfig &config, bool drop_frames);
+	// Finishes the capture if it hasn't been already
+	~FrameCapture();
+	FrameCapture(const FrameCapture&) = delete;
+	FrameCapture& operator=(const FrameCapture&) = delete;
+	// Check if the output for raw frames could be opened
+	bool is_valid() const;
+	/*
+	 * Queue the copy of the framebuffer's read buffer, of width x height, for capture and hand
+	 * any earlier frames which have finished copying to the writer. Leaves the read framebuffer
+	 * and pixel pack buffer unbound
+	 */
+	void capture(GLuint fbo, GLenum read_buffer, int width, int height);
+	// Wait for the frames still being read back and written out, then stop the writer
+	void finish();
+	size_t frames_captured() const;
+	size_t frames_written() const;
+	size_t frames_dropped() const;
+	const CaptureConfig& settings() const;
+
+private:
+	/*
+	 * Map the buffer's frame and queue it for the writer, returns false if the copy isn't done
+	 * yet and wait isn't set
+	 */
+	bool retire(PixelBuffer &pbo, bool wait);
+	void write_loop();
+	bool write_frame(Frame &frame);
+};
+
+#endif
+
@@ -0,0 +1,22 @@
+#include <cstring>
+#include "glt/gl_core_4_5.h"
+#include "gl_caps.h"
+
+bool gl_version_at_least(int major, int minor){
+	GLint ctx_major = 0, ctx_minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &ctx_major);
+	glGetIntegerv(GL_MINOR_VERSION, &ctx_minor);
+	return ctx_major > major || (ctx_major == major && ctx_minor >= minor);
+}
+bool gl_has_extension(const char *extension){
+	GLint num_extensions = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+	for (GLint i = 0; i < num_extensions; ++i){
+		const char *ext = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+		if (ext && std::strcmp(ext, extension) == 0){
+			return true;
+		}
+	}
+	return false;
+}
+
@@ -0,0 +1,14 @@
+#ifndef GL_CAPS_H
+#define GL_CAPS_H
+
+/*
+ * Check if the current context's version is at least major.minor
+ */
+bool gl_version_at_least(int major, int minor);
+/*
+ * Check if the current context supports the extension, e.g. "GL_ARB_buffer_storage"
+ */
+bool gl_has_extension(const char *extension);
+
+#endif
+
@@ -0,0 +1,104 @@
+#include <cstring>
+#include <iostream>
+#include "headless.h"
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+static bool has_extension(const char *extensions, const char *ext){
+	if (extensions == nullptr){
+		return false;
+	}
+	const size_t len = std::strlen(ext);
+	for (const char *s = std::strstr(extensions, ext); s != nullptr; s = std::strstr(s + len, ext)){
+		if ((s == extensions || s[-1] == ' ') && (s[len] == ' ' || s[len] == '\0')){
+			return true;
+		}
+	}
+	return false;
+}
+
+bool create_headless_context(HeadlessContext &ctx){
+	ctx.display = EGL_NO_DISPLAY;
+	ctx.context = EGL_NO_CONTEXT;
+
+	// Prefer the surfaceless platform so we don't need X or a DRM device at all,
+	// falling back to whatever default display EGL gives us
+	const char *client_exts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	if (has_extension(client_exts, "EGL_MESA_platform_surfaceless")){
+		auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+				eglGetProcAddress("eglGetPlatformDisplayEXT"));
+		if (get_platform_display != nullptr){
+			ctx.display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+		}
+	}
+	if (ctx.display == EGL_NO_DISPLAY){
+		ctx.display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+	EGLint major = 0, minor = 0;
+	if (ctx.display == EGL_NO_DISPLAY || !eglInitialize(ctx.display, &major, &minor)){
+		std::cout << "Failed to initialize EGL display\n";
+		return false;
+	}
+	std::cout << "EGL Version: " << major << "." << minor << "\n";
+	if (!has_extension(eglQueryString(ctx.display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")){
+		std::cout << "EGL_KHR_surfaceless_context is required for headless mode\n";
+		eglTerminate(ctx.display);
+		return false;
+	}
+	if (!eglBindAPI(EGL_OPENGL_API)){
+		std::cout << "Failed to bind the desktop OpenGL API\n";
+		eglTerminate(ctx.display);
+		return false;
+	}
+
+	const EGLint config_attribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint num_configs = 0;
+	if (!eglChooseConfig(ctx.display, config_attribs, &config, 1, &num_configs) || num_configs == 0){
+		std::cout << "No EGL config supporting desktop OpenGL found\n";
+		eglTerminate(ctx.display);
+		return false;
+	}
+
+	EGLint context_attribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+#ifdef DEBUG
+		EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE,
+#endif
+		EGL_NONE
+	};
+	ctx.context = eglCreateContext(ctx.display, config, EGL_NO_CONTEXT, context_attribs);
+	if (ctx.context == EGL_NO_CONTEXT){
+		std::cout << "Unable to create an OpenGL 4.3 or higher context with EGL\n";
+		eglTerminate(ctx.display);
+		return false;
+	}
+	if (!eglMakeCurrent(ctx.display, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx.context)){
+		std::cout << "Failed to make the headless context current\n";
+		destroy_headless_context(ctx);
+		return false;
+	}
+	return true;
+}
+void destroy_headless_context(HeadlessContext &ctx){
+	if (ctx.display == EGL_NO_DISPLAY){
+		return;
+	}
+	eglMakeCurrent(ctx.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (ctx.context != EGL_NO_CONTEXT){
+		eglDestroyContext(ctx.display, ctx.context);
+	}
+	eglTerminate(ctx.display);
+	ctx.display = EGL_NO_DISPLAY;
+	ctx.context = EGL_NO_CONTEXT;
+}
+
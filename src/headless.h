@@ -0,0 +1,25 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#ifdef SSAO_HEADLESS
+
+#include <EGL/egl.h>
+
+// An offscreen OpenGL context with no window or surface, used for benchmarking
+struct HeadlessContext {
+	EGLDisplay display;
+	EGLContext context;
+};
+
+/*
+ * Create an OpenGL 4.3+ core context on an EGL surfaceless display and make it current.
+ * On Mesa this works without a display server or GPU by falling back to llvmpipe.
+ * Returns false if no suitable context could be created
+ */
+bool create_headless_context(HeadlessContext &ctx);
+void destroy_headless_context(HeadlessContext &ctx);
+
+#endif
+
+#endif
+
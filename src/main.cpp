@@ -4,6 +4,10 @@
 #include <string>
 #include <unordered_map>
 #include <array>
+#include <chrono>
+#include <cfloat>
+#include <cstdio>
+#include <memory>
 #include <SDL.h>
 #include <imgui.h>
 #include <glm/glm.hpp>
@@ -20,39 +24,370 @@
 #include "glt/load_texture.h"
 #include "glt/framebuffer.h"
 #include "imgui_impl.h"
+#include "pass_timer.h"
+#include "camera_path.h"
+#include "headless.h"
+#include "ao_params.h"
+#include "batch_ao.h"
+#include "deinterleaved_ao.h"
+#include "frame_capture.h"
+#include "float_image.h"
+#include "shader_variants.h"
+#include "scene_cache.h"
+#include "obj_loader.h"
+#include "obj_upload.h"
+#include "texture_stream.h"
+#include "streaming_buffer.h"
+#include "draw_culler.h"
+#include "gl_caps.h"
+#include "model_geometry.h"
+#include "fragment_counter.h"
+#include "dynamic_resolution.h"
+#include "vertex_ao.h"
 
 const int WIN_WIDTH = 1280;
 const int WIN_HEIGHT = 720;
 
-enum RENDER_MODE { FULL, AO_ONLY, NO_AO };
-
-// Tweak params for the AO and blur passes, laid out to match the layout
-// of the uniform buffer
-struct AOParams {
-	// Parameters for the AO pass
-	int use_rendered_normals;
-	int n_samples;
-	int turns;
-	float ball_radius;
-	float sigma;
-	float kappa;
-	float beta;
-	// Parameters for the blurring pass
-	int filter_scale;
-	float edge_sharpness;
+enum RENDER_MODE { FULL, AO_ONLY, NO_AO, SAMPLE_HEATMAP };
+// The passes in the render loop which we time on the GPU and CPU, the swap and whole frame are only timed on the CPU
+enum PASS { CULL_PASS, DEPTH_PASS, MIP_PASS, AO_PASS, TEMPORAL_PASS, BLUR_H_PASS, BLUR_V_PASS, BLUR_COMPUTE_PASS,
+	UPSAMPLE_PASS, FINAL_PASS, CAPTURE_PASS, IMGUI_PASS, SWAP_PASS, FRAME_PASS, NUM_PASSES };
+// Number of frames captured when a trace is started from the UI
+const size_t TRACE_CAPTURE_FRAMES = 120;
+// When accumulating AO over frames we don't need as many samples per frame
+const int TEMPORAL_AO_SAMPLES = 8;
+// The compute shader blur's shared memory tiles only have room for the apron of filter
+// scales up to this, matching MAX_FILTER_SCALE in blur_comp.glsl
+const int COMPUTE_BLUR_MAX_FILTER_SCALE = 4;
+// Width and height of the tile blurred by each work group of the compute shader blur
+const int COMPUTE_BLUR_TILE = 16;
+// Scale applied to the model's positions in vert.glsl
+const float MODEL_SCALE = 0.25f;
+// GPU frame time the dynamic resolution aims for when it's turned on from the UI, 120Hz
+const float DEFAULT_TARGET_FRAME_MS = 8.3f;
+// Screen space AO radius used when the model has baked AO, which covers the occlusion further out
+const float BAKED_AO_BALL_RADIUS = 8.f;
+
+// Formats for the normal and AO render targets. Full keeps the original 32 bit float
+// targets, compact stores octahedral encoded normals in RG16 and the AO with its depth
+// key in RG16 to cut the bandwidth of the AO and blur passes
+enum GBUFFER_FORMAT { GBUFFER_FULL, GBUFFER_COMPACT };
+
+// Settings for the renderer picked when starting it
+struct RenderConfig {
+	GBUFFER_FORMAT gbuffer_format;
+	// log2 of the factor to compute AO at below full resolution, 0, 1 or 2
+	int ao_level;
+	// If AO should be accumulated over frames by reprojecting the previous frame's AO
+	bool temporal;
+	// If the blur should run as a single compute dispatch instead of two fragment passes
+	bool compute_blur;
+	// If the OBJ should be parsed by the parallel loader and its textures streamed in
+	// while rendering, instead of loading everything up front through glt
+	bool parallel_loader;
+	// If the draws should be culled against the view frustum on the GPU
+	bool frustum_cull;
+	// If the shading pass should test against the prepass depth with GL_EQUAL so each pixel
+	// is shaded once, instead of depth testing the scene again itself
+	bool depth_equal;
+	// GPU frame time in milliseconds to hold by scaling the render resolution, or 0 to always
+	// render at the display resolution
+	float target_frame_ms;
+	// If the AO pass should pick the number of samples per pixel
+	bool adaptive_ao;
+	// If the AO pass should combine a few small sample sets at different radii instead of
+	// taking all its samples in one ball
+	bool multi_scale_ao;
+	// If the AO pass should run on 4x4 deinterleaved layers of the depth
+	bool deinterleaved_ao;
+	// Frames are captured from the start if the output is set
+	CaptureConfig capture;
+	// Directory to cache program binaries in, the resource directory's shader_cache if empty
+	// or none if "off"
+	std::string shader_cache;
+};
+
+// The Viewing uniform block in global.glsl, laid out to match std140
+struct ViewingBlock {
+	glm::mat4 proj, view, inv_trans_view;
+	// Only xyz is used, w is std140's padding after the vec3
+	glm::vec4 cam_pos;
+	// The alpha channel is the light power
+	glm::vec4 light_dir;
+	glm::vec2 viewport_dim;
+};
+// The blocks of per-frame uniforms streamed through the frame_uniforms ring
+enum FRAME_UNIFORM_BLOCK {
+	VIEWING_BLOCK,
+	AO_PARAMS_BLOCK,
+};
+
+// The render targets sized by the render resolution, which are reallocated when the window
+// is resized or the dynamic resolution changes the scale
+struct RenderTargets {
+	// Depth, linear camera space depth with its mip pyramid, normals and the blur intermediate
+	std::array<GLuint, 4> ao_pass_textures;
+	GLuint ao_val_tex, scene_color_rb;
+	GLuint depth_pass_fbo, ao_pass_fbo, blur_pass_fbo, scene_fbo;
+	// Number of mip levels in the depth pyramid
+	GLsizei levels;
+};
+
+// Settings for a headless benchmark run along a scripted camera path
+struct BenchConfig {
+	std::string camera_path, output;
+	// If set the positions, normals and AO targets of the last frame are saved
+	// with this prefix, to be used as golden references for the CPU AO
+	std::string dump_prefix;
+	// If set a Chrome trace of the passes in the benchmark frames is written to this file
+	std::string trace_output;
+	int frames, warmup, width, height;
 };
 
+// Settings for rendering the AO of a list of views offscreen in batches, at the --size resolution
+struct BatchConfig {
+	std::string views_file, output_prefix;
+	int views_per_batch;
+};
+
+/*
+ * Run the assignment program. If win is null we're running headless and will render the
+ * benchmark described by bench to an offscreen target of the benchmark's size, or if batch
+ * is set write out the AO of each view in its list instead of running the render loop
+ */
+void run(SDL_Window *win, const std::string &model_file, int width, int height, const RenderConfig &config,
+		const BenchConfig *bench, const BatchConfig *batch);
+/*
+ * Setup the GL state shared by the interactive and headless modes and print the context info
+ */
+void init_gl_state();
+/*
+ * Run the benchmark or the batch, if it's set, headless on an EGL surfaceless context
+ */
+int run_headless(const std::string &model_file, const RenderConfig &config, const BenchConfig &bench,
+		const BatchConfig *batch);
+/*
+ * Read back level 0 of the 2D texture bound to the texture unit and save it as a float image
+ */
+void save_texture(int unit, int channels, int width, int height, const std::string &file);
+/*
+ * Read back the octahedral encoded normals bound to the texture unit and save them
+ * decoded to an RGB float image
+ */
+void save_octahedral_normals(int unit, int width, int height, const std::string &file);
+// Get the size in bytes of a 2D texture's mip chain
+size_t texture_bytes(int width, int height, int levels, int texel_bytes);
+/*
+ * (Re)create a pair of AO targets at 1 / 2^level of width x height, e.g. for computing and
+ * blurring AO at reduced resolution. Each texture is attached to the matching framebuffer
+ * and bound to the matching texture unit
+ */
+void setup_ao_targets(std::array<GLuint, 2> &textures, const std::array<GLuint, 2> &fbos,
+		const std::array<int, 2> &units, GLenum format, int width, int height, int level);
 /*
- * Run the assignment program
+ * (Re)create the full resolution targets at width x height and attach them to their framebuffers,
+ * which are created the first time. The linear depth, normals, AO and blur intermediate are bound
+ * to the texture units starting at first_unit, in that order
  */
-void run(SDL_Window *win, const std::string &model_file);
+void setup_render_targets(RenderTargets &targets, int first_unit, GLenum ao_format, GLenum normal_format,
+		int width, int height);
+/*
+ * Look up glMultiDrawElementsIndirectCount, returns null if the context doesn't support it
+ */
+MultiDrawElementsIndirectCountFn load_multi_draw_indirect_count(SDL_Window *win);
+/*
+ * Look up glMaxShaderCompilerThreadsKHR/ARB, returns null if the context doesn't support it
+ */
+MaxShaderCompilerThreadsFn load_max_shader_compiler_threads(SDL_Window *win);
 
 int main(int argc, char **argv){
 	if (argc < 2){
-		std::cout << "Usage: ./exe <model.obj>\n";
+		std::cout << "Usage: ./exe <model.obj> [--bench <camera_path>] [--frames N] [--warmup N]"
+			<< " [--size WxH] [--out <results.json|results.csv>] [--dump <prefix>] [--trace <trace.json>] [--gbuffer full|compact]"
+			<< " [--ao-scale 1|2|4] [--temporal on|off] [--blur compute|fragment] [--loader glt|parallel] [--cull on|off]"
+			<< " [--depth-equal on|off] [--dynamic-res <target ms>|off] [--adaptive-ao on|off]"
+			<< " [--multi-scale-ao on|off] [--deinterleave-ao on|off] [--shader-cache <dir>|off]"
+			<< " [--capture <prefix|file|\"|command\"> [--capture-source final|ao] [--capture-format png|fimg|raw]]"
+			<< " [--batch <views> [--batch-size K] [--batch-out <prefix>]]\n";
 		return 1;
 	}
 	std::string model_file{argv[1]};
+	BenchConfig bench{"", "pass_times.json", "", "", 500, 10, WIN_WIDTH, WIN_HEIGHT};
+	RenderConfig config{GBUFFER_FULL, 0, false, true, true, true, true, 0.f, false, false, false,
+		CaptureConfig{"", CAPTURE_FINAL, CAPTURE_PNG}, ""};
+	BatchConfig batch{"", "ao", 8};
+	for (int i = 2; i < argc; ++i){
+		const std::string arg = argv[i];
+		if (i + 1 >= argc){
+			std::cout << "Missing value for argument " << arg << "\n";
+			return 1;
+		}
+		if (arg == "--bench"){
+			bench.camera_path = argv[++i];
+		}
+		else if (arg == "--frames"){
+			bench.frames = std::max(std::stoi(argv[++i]), 1);
+		}
+		else if (arg == "--warmup"){
+			bench.warmup = std::max(std::stoi(argv[++i]), 0);
+		}
+		else if (arg == "--size"){
+			if (std::sscanf(argv[++i], "%dx%d", &bench.width, &bench.height) != 2
+					|| bench.width <= 0 || bench.height <= 0){
+				std::cout << "Invalid size " << argv[i] << ", expected WxH\n";
+				return 1;
+			}
+		}
+		else if (arg == "--out"){
+			bench.output = argv[++i];
+		}
+		else if (arg == "--dump"){
+			bench.dump_prefix = argv[++i];
+		}
+		else if (arg == "--trace"){
+			bench.trace_output = argv[++i];
+		}
+		else if (arg == "--gbuffer"){
+			const std::string format = argv[++i];
+			if (format == "full"){
+				config.gbuffer_format = GBUFFER_FULL;
+			}
+			else if (format == "compact"){
+				config.gbuffer_format = GBUFFER_COMPACT;
+			}
+			else {
+				std::cout << "Invalid G-buffer format " << format << ", expected full or compact\n";
+				return 1;
+			}
+		}
+		else if (arg == "--ao-scale"){
+			const int scale = std::stoi(argv[++i]);
+			if (scale != 1 && scale != 2 && scale != 4){
+				std::cout << "Invalid AO scale " << scale << ", expected 1, 2 or 4\n";
+				return 1;
+			}
+			config.ao_level = scale == 1 ? 0 : scale == 2 ? 1 : 2;
+		}
+		else if (arg == "--temporal"){
+			const std::string temporal = argv[++i];
+			if (temporal != "on" && temporal != "off"){
+				std::cout << "Invalid temporal setting " << temporal << ", expected on or off\n";
+				return 1;
+			}
+			config.temporal = temporal == "on";
+		}
+		else if (arg == "--blur"){
+			const std::string blur = argv[++i];
+			if (blur != "compute" && blur != "fragment"){
+				std::cout << "Invalid blur method " << blur << ", expected compute or fragment\n";
+				return 1;
+			}
+			config.compute_blur = blur == "compute";
+		}
+		else if (arg == "--loader"){
+			const std::string loader = argv[++i];
+			if (loader != "glt" && loader != "parallel"){
+				std::cout << "Invalid loader " << loader << ", expected glt or parallel\n";
+				return 1;
+			}
+			config.parallel_loader = loader == "parallel";
+		}
+		else if (arg == "--cull"){
+			const std::string cull = argv[++i];
+			if (cull != "on" && cull != "off"){
+				std::cout << "Invalid culling mode " << cull << ", expected on or off\n";
+				return 1;
+			}
+			config.frustum_cull = cull == "on";
+		}
+		else if (arg == "--depth-equal"){
+			const std::string depth_equal = argv[++i];
+			if (depth_equal != "on" && depth_equal != "off"){
+				std::cout << "Invalid depth equal setting " << depth_equal << ", expected on or off\n";
+				return 1;
+			}
+			config.depth_equal = depth_equal == "on";
+		}
+		else if (arg == "--dynamic-res"){
+			const std::string target = argv[++i];
+			config.target_frame_ms = target == "off" ? 0.f : std::stof(target);
+			if (config.target_frame_ms < 0.f){
+				std::cout << "Invalid dynamic resolution target " << target << ", expected a frame time in ms or off\n";
+				return 1;
+			}
+		}
+		else if (arg == "--adaptive-ao"){
+			const std::string adaptive = argv[++i];
+			if (adaptive != "on" && adaptive != "off"){
+				std::cout << "Invalid adaptive AO setting " << adaptive << ", expected on or off\n";
+				return 1;
+			}
+			config.adaptive_ao = adaptive == "on";
+		}
+		else if (arg == "--multi-scale-ao"){
+			const std::string multi_scale = argv[++i];
+			if (multi_scale != "on" && multi_scale != "off"){
+				std::cout << "Invalid multi-scale AO setting " << multi_scale << ", expected on or off\n";
+				return 1;
+			}
+			config.multi_scale_ao = multi_scale == "on";
+		}
+		else if (arg == "--deinterleave-ao"){
+			const std::string deinterleave = argv[++i];
+			if (deinterleave != "on" && deinterleave != "off"){
+				std::cout << "Invalid deinterleaved AO setting " << deinterleave << ", expected on or off\n";
+				return 1;
+			}
+			config.deinterleaved_ao = deinterleave == "on";
+		}
+		else if (arg == "--capture"){
+			config.capture.output = argv[++i];
+		}
+		else if (arg == "--capture-source"){
+			const std::string source = argv[++i];
+			if (source != "final" && source != "ao"){
+				std::cout << "Invalid capture source " << source << ", expected final or ao\n";
+				return 1;
+			}
+			config.capture.source = source == "final" ? CAPTURE_FINAL : CAPTURE_AO;
+		}
+		else if (arg == "--capture-format"){
+			const std::string format = argv[++i];
+			if (format != "png" && format != "fimg" && format != "raw"){
+				std::cout << "Invalid capture format " << format << ", expected png, fimg or raw\n";
+				return 1;
+			}
+			config.capture.format = format == "png" ? CAPTURE_PNG : format == "fimg" ? CAPTURE_FIMG : CAPTURE_RAW;
+		}
+		else if (arg == "--shader-cache"){
+			config.shader_cache = argv[++i];
+		}
+		else if (arg == "--batch"){
+			batch.views_file = argv[++i];
+		}
+		else if (arg == "--batch-size"){
+			batch.views_per_batch = std::max(std::stoi(argv[++i]), 1);
+		}
+		else if (arg == "--batch-out"){
+			batch.output_prefix = argv[++i];
+		}
+		else {
+			std::cout << "Unrecognized argument " << arg << "\n";
+			return 1;
+		}
+	}
+	if (!bench.dump_prefix.empty() && config.ao_level != 0){
+		std::cout << "Dumping the AO targets requires full resolution AO\n";
+		return 1;
+	}
+	if (!bench.camera_path.empty() && !batch.views_file.empty()){
+		std::cout << "A benchmark and a batch can't be run together\n";
+		return 1;
+	}
+	if (!bench.camera_path.empty() || !batch.views_file.empty()){
+		return run_headless(model_file, config, bench, batch.views_file.empty() ? nullptr : &batch);
+	}
+
 	if (SDL_Init(SDL_INIT_VIDEO) != 0){
 		std::cout << "SDL_Init error: " << SDL_GetError() << std::endl;
 		return 1;
@@ -61,8 +396,6 @@ int main(int argc, char **argv){
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
-	SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 1);
-	SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, 4);
 	SDL_GL_SetAttribute(SDL_GL_RED_SIZE, 8);
 	SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 8);
 	SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE, 8);
@@ -73,7 +406,7 @@ int main(int argc, char **argv){
 #endif
 
 	SDL_Window *win = SDL_CreateWindow("Final Project - Will Usher", SDL_WINDOWPOS_CENTERED,
-		SDL_WINDOWPOS_CENTERED, WIN_WIDTH, WIN_HEIGHT, SDL_WINDOW_OPENGL);
+		SDL_WINDOWPOS_CENTERED, WIN_WIDTH, WIN_HEIGHT, SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE);
 	SDL_GLContext ctx = SDL_GL_CreateContext(win);
 
 	// If we don't have a 4.5 context available we may fail loading some functions
@@ -107,10 +440,60 @@ int main(int argc, char **argv){
 		SDL_Quit();
 		return 1;
 	}
-#ifdef DEBUG
-	if (argc > 1){
-		glt::dbg::register_debug_callback();
+	init_gl_state();
+
+	run(win, model_file, WIN_WIDTH, WIN_HEIGHT, config, nullptr, nullptr);
+
+	SDL_GL_DeleteContext(ctx);
+	SDL_DestroyWindow(win);
+	SDL_Quit();
+	return 0;
+}
+MultiDrawElementsIndirectCountFn load_multi_draw_indirect_count(SDL_Window *win){
+	// It's core in 4.6 or comes from ARB_indirect_parameters, neither of which glLoadGen loads
+	// for our 4.3 context so we look it up ourselves
+	const char *name = nullptr;
+	if (gl_version_at_least(4, 6)){
+		name = "glMultiDrawElementsIndirectCount";
+	}
+	else if (gl_has_extension("GL_ARB_indirect_parameters")){
+		name = "glMultiDrawElementsIndirectCountARB";
+	}
+	else {
+		return nullptr;
+	}
+	if (win){
+		return reinterpret_cast<MultiDrawElementsIndirectCountFn>(SDL_GL_GetProcAddress(name));
+	}
+#ifdef SSAO_HEADLESS
+	return reinterpret_cast<MultiDrawElementsIndirectCountFn>(eglGetProcAddress(name));
+#else
+	return nullptr;
+#endif
+}
+MaxShaderCompilerThreadsFn load_max_shader_compiler_threads(SDL_Window *win){
+	const char *name = nullptr;
+	if (gl_has_extension("GL_KHR_parallel_shader_compile")){
+		name = "glMaxShaderCompilerThreadsKHR";
 	}
+	else if (gl_has_extension("GL_ARB_parallel_shader_compile")){
+		name = "glMaxShaderCompilerThreadsARB";
+	}
+	else {
+		return nullptr;
+	}
+	if (win){
+		return reinterpret_cast<MaxShaderCompilerThreadsFn>(SDL_GL_GetProcAddress(name));
+	}
+#ifdef SSAO_HEADLESS
+	return reinterpret_cast<MaxShaderCompilerThreadsFn>(eglGetProcAddress(name));
+#else
+	return nullptr;
+#endif
+}
+void init_gl_state(){
+#ifdef DEBUG
+	glt::dbg::register_debug_callback();
 #endif
 	glClearColor(0.1f, 0.1f, 0.1f, 1.f);
 	glClearDepth(1.f);
@@ -123,41 +506,239 @@ int main(int argc, char **argv){
 		<< "OpenGL Vendor: " << glGetString(GL_VENDOR) << "\n"
 		<< "OpenGL Renderer: " << glGetString(GL_RENDERER) << "\n"
 		<< "GLSL Version: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << "\n";
+}
+int run_headless(const std::string &model_file, const RenderConfig &config, const BenchConfig &bench,
+		const BatchConfig *batch)
+{
+#ifdef SSAO_HEADLESS
+	HeadlessContext ctx;
+	if (!create_headless_context(ctx)){
+		return 1;
+	}
+	// We still load through glLoadGen's loader, with libglvnd the function pointers it
+	// finds are dispatch stubs that also work for our EGL context
+	if (ogl_LoadFunctions() == ogl_LOAD_FAILED){
+		std::cout << "ogl load failed" << std::endl;
+		destroy_headless_context(ctx);
+		return 1;
+	}
+	init_gl_state();
+	run(nullptr, model_file, bench.width, bench.height, config, batch ? nullptr : &bench, batch);
+	destroy_headless_context(ctx);
+	return 0;
+#else
+	(void)model_file;
+	(void)config;
+	(void)bench;
+	(void)batch;
+	std::cout << "Headless benchmarking requires building with EGL\n";
+	return 1;
+#endif
+}
+void save_texture(int unit, int channels, int width, int height, const std::string &file){
+	FloatImage img{width, height, channels,
+		std::vector<float>(static_cast<size_t>(width) * height * channels)};
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	const GLenum format = channels == 3 ? GL_RGB : channels == 2 ? GL_RG : GL_RED;
+	glGetTexImage(GL_TEXTURE_2D, 0, format, GL_FLOAT, img.data.data());
+	save_float_image(file, img);
+}
+void save_octahedral_normals(int unit, int width, int height, const std::string &file){
+	FloatImage oct{width, height, 2, std::vector<float>(static_cast<size_t>(width) * height * 2)};
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RG, GL_FLOAT, oct.data.data());
+	FloatImage img{width, height, 3, std::vector<float>(static_cast<size_t>(width) * height * 3)};
+	for (size_t i = 0; i < static_cast<size_t>(width) * height; ++i){
+		// Same decoding as oct_decode in global.glsl
+		const glm::vec2 e{oct.data[2 * i], oct.data[2 * i + 1]};
+		glm::vec3 n{e.x, e.y, 1.f - std::abs(e.x) - std::abs(e.y)};
+		if (n.z < 0.f){
+			n.x = (1.f - std::abs(e.y)) * (e.x >= 0.f ? 1.f : -1.f);
+			n.y = (1.f - std::abs(e.x)) * (e.y >= 0.f ? 1.f : -1.f);
+		}
+		n = glm::normalize(n);
+		img.data[3 * i] = n.x;
+		img.data[3 * i + 1] = n.y;
+		img.data[3 * i + 2] = n.z;
+	}
+	save_float_image(file, img);
+}
+void setup_ao_targets(std::array<GLuint, 2> &textures, const std::array<GLuint, 2> &fbos,
+		const std::array<int, 2> &units, GLenum format, int width, int height, int level)
+{
+	if (textures[0] != 0){
+		glDeleteTextures(textures.size(), textures.data());
+	}
+	glGenTextures(textures.size(), textures.data());
+	for (size_t i = 0; i < textures.size(); ++i){
+		glActiveTexture(GL_TEXTURE0 + units[i]);
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+		glTexStorage2D(GL_TEXTURE_2D, 1, format, std::max(width >> level, 1), std::max(height >> level, 1));
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-	run(win, model_file);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbos[i]);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, textures[i], 0);
+		glDrawBuffer(GL_COLOR_ATTACHMENT0);
+		assert(glt::check_framebuffer(fbos[i]));
+	}
+}
+void setup_render_targets(RenderTargets &targets, int first_unit, GLenum ao_format, GLenum normal_format,
+		int width, int height)
+{
+	if (targets.scene_fbo == 0){
+		glGenFramebuffers(1, &targets.depth_pass_fbo);
+		glGenFramebuffers(1, &targets.ao_pass_fbo);
+		glGenFramebuffers(1, &targets.blur_pass_fbo);
+		glGenFramebuffers(1, &targets.scene_fbo);
+	}
+	else {
+		glDeleteTextures(targets.ao_pass_textures.size(), targets.ao_pass_textures.data());
+		glDeleteTextures(1, &targets.ao_val_tex);
+		glDeleteRenderbuffers(1, &targets.scene_color_rb);
+	}
+	targets.levels = std::log2(std::max(width, height));
 
-	SDL_GL_DeleteContext(ctx);
-	SDL_DestroyWindow(win);
-	SDL_Quit();
-	return 0;
+	// Texture and render target for our AO values
+	glActiveTexture(GL_TEXTURE0 + first_unit + 2);
+	glGenTextures(1, &targets.ao_val_tex);
+	glBindTexture(GL_TEXTURE_2D, targets.ao_val_tex);
+	glTexStorage2D(GL_TEXTURE_2D, 1, ao_format, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, targets.ao_pass_fbo);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, targets.ao_val_tex, 0);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	assert(glt::check_framebuffer(targets.ao_pass_fbo));
+
+	// Setup the render targets for the depth prepass, which writes linear camera space depth
+	// and normals. The linear depth is then downsampled into a pyramid for the AO pass
+	glActiveTexture(GL_TEXTURE0 + first_unit);
+	glGenTextures(targets.ao_pass_textures.size(), targets.ao_pass_textures.data());
+	glBindTexture(GL_TEXTURE_2D, targets.ao_pass_textures[0]);
+	glTexStorage2D(GL_TEXTURE_2D, targets.levels, GL_DEPTH_COMPONENT32F, width, height);
+
+	glBindTexture(GL_TEXTURE_2D, targets.ao_pass_textures[1]);
+	glTexStorage2D(GL_TEXTURE_2D, targets.levels, GL_R32F, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	// The normals are only read at level 0 by the AO pass so don't need mips
+	glActiveTexture(GL_TEXTURE0 + first_unit + 1);
+	glBindTexture(GL_TEXTURE_2D, targets.ao_pass_textures[2]);
+	glTexStorage2D(GL_TEXTURE_2D, 1, normal_format, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, targets.depth_pass_fbo);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, targets.ao_pass_textures[0], 0);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, targets.ao_pass_textures[1], 0);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, targets.ao_pass_textures[2], 0);
+	GLenum depth_draw_buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, depth_draw_buffers);
+	assert(glt::check_framebuffer(targets.depth_pass_fbo));
+
+	// Intermediate target for the blur pass
+	glActiveTexture(GL_TEXTURE0 + first_unit + 3);
+	glBindTexture(GL_TEXTURE_2D, targets.ao_pass_textures[3]);
+	glTexStorage2D(GL_TEXTURE_2D, 1, ao_format, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, targets.blur_pass_fbo);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, targets.ao_pass_textures[3], 0);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	assert(glt::check_framebuffer(targets.blur_pass_fbo));
+
+	// The shading pass renders into our own color target so it can share the prepass depth
+	// attachment. With a window it's then blitted to the default framebuffer, when running
+	// headless there's no default framebuffer so this is the final output
+	glGenRenderbuffers(1, &targets.scene_color_rb);
+	glBindRenderbuffer(GL_RENDERBUFFER, targets.scene_color_rb);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glBindFramebuffer(GL_FRAMEBUFFER, targets.scene_fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, targets.scene_color_rb);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, targets.ao_pass_textures[0], 0);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	assert(glt::check_framebuffer(targets.scene_fbo));
 }
-void run(SDL_Window *win, const std::string &model_file){
-	// Load and setup our shaders
+size_t texture_bytes(int width, int height, int levels, int texel_bytes){
+	size_t bytes = 0;
+	for (int i = 0; i < levels; ++i){
+		bytes += static_cast<size_t>(std::max(width >> i, 1)) * std::max(height >> i, 1) * texel_bytes;
+	}
+	return bytes;
+}
+void run(SDL_Window *win, const std::string &model_file, int width, int height, const RenderConfig &config,
+		const BenchConfig *bench, const BatchConfig *batch)
+{
+	const bool compact_gbuffer = config.gbuffer_format == GBUFFER_COMPACT;
+	std::vector<CameraKey> camera_path;
+	if (bench && !load_camera_path(bench->camera_path, camera_path)){
+		return;
+	}
+	std::vector<glm::mat4> batch_views;
+	if (batch && !load_view_list(batch->views_file, batch_views)){
+		return;
+	}
+	// Load and setup our shaders, through the program binary cache and all at once so drivers
+	// with parallel shader compilation can build them together
+	const auto shaders_start = std::chrono::steady_clock::now();
+	setup_program_builds(config.shader_cache == "off" ? ""
+			: config.shader_cache.empty() ? glt::get_resource_path("shader_cache") : config.shader_cache,
+			load_max_shader_compiler_threads(win));
 	const std::string shader_path = glt::get_resource_path("shaders");
-	GLint shader = glt::load_program({std::make_pair(GL_VERTEX_SHADER, shader_path + "vert.glsl"),
-		std::make_pair(GL_GEOMETRY_SHADER, shader_path + "geom.glsl"),
-		std::make_pair(GL_FRAGMENT_SHADER, shader_path + "frag.glsl")});
-	GLint ao_sample_shader = glt::load_program({
-		std::make_pair(GL_VERTEX_SHADER, shader_path + "ao_sample_vert.glsl"),
-		std::make_pair(GL_FRAGMENT_SHADER, shader_path + "ao_sample_frag.glsl")});
-	GLint blur_pass_shader = glt::load_program({
-		std::make_pair(GL_VERTEX_SHADER, shader_path + "ao_sample_vert.glsl"),
-		std::make_pair(GL_FRAGMENT_SHADER, shader_path + "blur_frag.glsl")});
-	assert(shader != -1 && ao_sample_shader != -1 && blur_pass_shader != -1);
-
-	GLuint depth_pass_unif = glGetUniformLocation(shader, "depth_pass");
+	const std::vector<GLint> programs = load_programs({
+		{std::make_pair(GL_VERTEX_SHADER, shader_path + "vert.glsl"),
+			std::make_pair(GL_FRAGMENT_SHADER, shader_path + "frag.glsl")},
+		// The prepass only writes what the AO pass needs: depth, linear depth and normals
+		{std::make_pair(GL_VERTEX_SHADER, shader_path + "prepass_vert.glsl"),
+			std::make_pair(GL_FRAGMENT_SHADER, shader_path + "prepass_frag.glsl")},
+		{std::make_pair(GL_VERTEX_SHADER, shader_path + "ao_sample_vert.glsl"),
+			std::make_pair(GL_FRAGMENT_SHADER, shader_path + "blur_frag.glsl")},
+		{std::make_pair(GL_VERTEX_SHADER, shader_path + "ao_sample_vert.glsl"),
+			std::make_pair(GL_FRAGMENT_SHADER, shader_path + "depth_mip_frag.glsl")},
+		{std::make_pair(GL_VERTEX_SHADER, shader_path + "ao_sample_vert.glsl"),
+			std::make_pair(GL_FRAGMENT_SHADER, shader_path + "ao_upsample_frag.glsl")},
+		{std::make_pair(GL_VERTEX_SHADER, shader_path + "ao_sample_vert.glsl"),
+			std::make_pair(GL_FRAGMENT_SHADER, shader_path + "ao_temporal_frag.glsl")},
+		{std::make_pair(GL_COMPUTE_SHADER, shader_path + "blur_comp.glsl")}});
+	GLint shader = programs[0];
+	GLint prepass_shader = programs[1];
+	GLint blur_pass_shader = programs[2];
+	GLint depth_mip_shader = programs[3];
+	GLint ao_upsample_shader = programs[4];
+	GLint ao_temporal_shader = programs[5];
+	GLint blur_compute_shader = programs[6];
+	std::cout << "Shaders loaded in " << std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - shaders_start).count() << "ms\n";
+	assert(shader != -1 && prepass_shader != -1 && blur_pass_shader != -1 && depth_mip_shader != -1
+			&& ao_upsample_shader != -1 && ao_temporal_shader != -1 && blur_compute_shader != -1);
+
 	GLuint ao_only_unif = glGetUniformLocation(shader, "ao_only");
 	GLuint ao_values_tex_unif = glGetUniformLocation(shader, "ao_texture");
+	GLuint sample_heatmap_unif = glGetUniformLocation(shader, "sample_heatmap");
+	GLuint baked_ao_unif = glGetUniformLocation(shader, "baked_ao_enabled");
 	glUseProgram(shader);
-	glUniform1ui(depth_pass_unif, 0);
 	glUniform1ui(ao_only_unif, 0);
+	glUniform1ui(sample_heatmap_unif, 0);
+	glUniform1ui(baked_ao_unif, 0);
+	glUseProgram(prepass_shader);
+	glUniform1ui(glGetUniformLocation(prepass_shader, "octahedral_normals"), compact_gbuffer);
+
+	GLuint upsample_ao_level_unif = glGetUniformLocation(ao_upsample_shader, "ao_level");
 
-	GLuint cam_pos_tex_unif = glGetUniformLocation(ao_sample_shader, "camera_positions");
-	GLuint cam_norm_tex_unif = glGetUniformLocation(ao_sample_shader, "camera_normals");
+	GLuint temporal_ao_in_unif = glGetUniformLocation(ao_temporal_shader, "ao_in");
+	GLuint temporal_history_unif = glGetUniformLocation(ao_temporal_shader, "history");
+	GLuint temporal_reproject_unif = glGetUniformLocation(ao_temporal_shader, "reproject");
+	GLuint temporal_ao_level_unif = glGetUniformLocation(ao_temporal_shader, "ao_level");
+	GLuint temporal_history_valid_unif = glGetUniformLocation(ao_temporal_shader, "history_valid");
+	GLuint temporal_blend_unif = glGetUniformLocation(ao_temporal_shader, "blend");
 
-	GLuint blur_cam_pos_tex_unif = glGetUniformLocation(blur_pass_shader, "camera_positions");
 	GLuint blur_ao_in_unif = glGetUniformLocation(blur_pass_shader, "ao_in");
 	GLuint blur_axis_unif = glGetUniformLocation(blur_pass_shader, "axis");
+	GLuint blur_compute_ao_in_unif = glGetUniformLocation(blur_compute_shader, "ao_in");
 
 	GLuint vao;
 	glGenVertexArrays(1, &vao);
@@ -168,10 +749,32 @@ void run(SDL_Window *win, const std::string &model_file){
 	glt::SubBuffer vert_buf, elem_buf, mat_buf;
 	std::unordered_map<std::string, glt::ModelMatInfo> model_info;
 	glt::OBJTextures textures;
-	if (!glt::load_model_with_mats(model_file, allocator, vert_buf, elem_buf, mat_buf, textures, model_info)){
+	std::unique_ptr<TextureStreamer> texture_streamer;
+	// Load the preprocessed scene if it's been converted with scene_convert, otherwise parse the OBJ
+	const auto load_start = std::chrono::steady_clock::now();
+	const std::string cache_file = scene_cache_path(model_file);
+	if (load_scene_cache(cache_file, allocator, vert_buf, elem_buf, mat_buf, textures, model_info)){
+		std::cout << "Loaded scene cache " << cache_file << "\n";
+	}
+	else if (config.parallel_loader){
+		ObjModel obj;
+		if (!load_obj_parallel(model_file, obj)){
+			std::cout << "Error loading model!\n";
+			return;
+		}
+		upload_obj_model(obj, allocator, vert_buf, elem_buf, mat_buf, model_info);
+		texture_streamer = std::make_unique<TextureStreamer>(obj, mat_buf, textures);
+		// Benchmarks and batches should see the same scene every frame
+		if (bench || batch){
+			texture_streamer->finish();
+		}
+	}
+	else if (!glt::load_model_with_mats(model_file, allocator, vert_buf, elem_buf, mat_buf, textures, model_info)){
 		std::cout << "Error loading model!\n";
 		return;
 	}
+	std::cout << "Scene loaded in " << std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - load_start).count() << "ms\n";
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3) + sizeof(glm::vec2),
 			(void*)vert_buf.offset);
@@ -182,6 +785,43 @@ void run(SDL_Window *win, const std::string &model_file){
 	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3) + sizeof(glm::vec2),
 			(void*)(vert_buf.offset + 2 * sizeof(glm::vec3)));
 
+	// Tangent frames for normal mapping are computed once at load instead of per triangle in a
+	// geometry shader each frame. The culler also uses the geometry to find the bounds of its draws
+	ModelGeometry geometry = read_back_geometry(vert_buf, elem_buf);
+	{
+		const std::vector<float> tangents = compute_vertex_tangents(geometry, model_info);
+		auto tangent_buf = allocator.alloc(tangents.size() * sizeof(float));
+		float *tangent_data = static_cast<float*>(tangent_buf.map(GL_ARRAY_BUFFER,
+					GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_WRITE_BIT));
+		std::copy(tangents.begin(), tangents.end(), tangent_data);
+		tangent_buf.unmap(GL_ARRAY_BUFFER);
+		glEnableVertexAttribArray(4);
+		glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)tangent_buf.offset);
+	}
+	// AO baked offline by ao_bake has the far field occlusion the screen space AO can't see,
+	// without a bake for the model every vertex is left unoccluded
+	bool has_baked_ao = false;
+	{
+		const std::string bake_file = vertex_ao_path(model_file);
+		std::vector<float> baked_ao;
+		if (load_vertex_ao(bake_file, vertex_checksum(geometry.vertices),
+					geometry.vertices.size() / MODEL_VERTEX_FLOATS, baked_ao))
+		{
+			auto baked_ao_buf = allocator.alloc(baked_ao.size() * sizeof(float));
+			float *baked_ao_data = static_cast<float*>(baked_ao_buf.map(GL_ARRAY_BUFFER,
+						GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_WRITE_BIT));
+			std::copy(baked_ao.begin(), baked_ao.end(), baked_ao_data);
+			baked_ao_buf.unmap(GL_ARRAY_BUFFER);
+			glEnableVertexAttribArray(5);
+			glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)baked_ao_buf.offset);
+			has_baked_ao = true;
+			std::cout << "Loaded baked AO from " << bake_file << "\n";
+		}
+		else {
+			glVertexAttrib1f(5, 1.f);
+		}
+	}
+
 	std::cout << "num model textures = " << textures.textures.size() << std::endl;
 	std::vector<GLint> tex_unifs;
 	for (size_t i = 0; i < textures.textures.size(); ++i){
@@ -190,114 +830,101 @@ void run(SDL_Window *win, const std::string &model_file){
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 		tex_unifs.push_back(i);
 	}
-	GLuint textures_unif_loc = glGetUniformLocation(shader, "model_textures");
-	glUseProgram(shader);
-	glUniform1iv(textures_unif_loc, tex_unifs.size(), tex_unifs.data());
+	for (const GLint program : {shader, prepass_shader}){
+		glUseProgram(program);
+		glUniform1iv(glGetUniformLocation(program, "model_textures"), tex_unifs.size(), tex_unifs.data());
+	}
 	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 4, mat_buf.buffer, mat_buf.offset, mat_buf.size);
 
-	// Number of mip levels for our ao and depth textures
-	GLsizei levels = std::log2(std::max(WIN_WIDTH, WIN_HEIGHT));
+	// The window's drawable may be larger than its size in screen coordinates on high DPI displays
+	int display_width = width, display_height = height;
+	if (win){
+		SDL_GL_GetDrawableSize(win, &display_width, &display_height);
+	}
+	// The scene is rendered at a scale of the display resolution picked by the dynamic resolution
+	// and upscaled when it's blitted to the window
+	bool dynamic_res_enabled = config.target_frame_ms > 0.f;
+	DynamicResolution dynamic_res{dynamic_res_enabled ? config.target_frame_ms : DEFAULT_TARGET_FRAME_MS};
+	width = display_width;
+	height = display_height;
 
-	// Texture and render target for our AO values
-	int ao_tex_unit = textures.textures.size() + 2;
-	glActiveTexture(GL_TEXTURE0 + ao_tex_unit);
-	GLuint ao_val_tex;
-	glGenTextures(1, &ao_val_tex);
-	glBindTexture(GL_TEXTURE_2D, ao_val_tex);
-	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG32F, WIN_WIDTH, WIN_HEIGHT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	// The AO value and depth key are both in [0, 1] so can be stored normalized, normals
+	// are octahedral encoded into two signed normalized channels
+	const GLenum ao_format = compact_gbuffer ? GL_RG16 : GL_RG32F;
+	const GLenum normal_format = compact_gbuffer ? GL_RG16_SNORM : GL_RGB32F;
+	const int ao_texel_bytes = compact_gbuffer ? 4 : 8;
+	const int normal_texel_bytes = compact_gbuffer ? 4 : 12;
+	std::cout << "Normal and AO targets use " << (compact_gbuffer ? "compact" : "full") << " formats, "
+		<< (texture_bytes(width, height, 1, normal_texel_bytes) + 2 * texture_bytes(width, height, 1, ao_texel_bytes))
+			/ (1024.0 * 1024.0) << "MB\n";
 
-	GLuint ao_pass_fbo;
-	glGenFramebuffers(1, &ao_pass_fbo);
-	glBindFramebuffer(GL_FRAMEBUFFER, ao_pass_fbo);
-	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, ao_val_tex, 0);
-	glDrawBuffer(GL_COLOR_ATTACHMENT0);
-	assert(glt::check_framebuffer(ao_pass_fbo));
+	const int cspace_depth_tex_unit = textures.textures.size();
+	const int cspace_norm_tex_unit = textures.textures.size() + 1;
+	const int ao_tex_unit = textures.textures.size() + 2;
+	const int blur_pass_intermediate_unit = textures.textures.size() + 3;
+	RenderTargets targets{};
+	setup_render_targets(targets, cspace_depth_tex_unit, ao_format, normal_format, width, height);
 
 	glUseProgram(shader);
 	glUniform1i(ao_values_tex_unif, ao_tex_unit);
 
-	// Setup the depth only render target for the depth pass
-	int cspace_pos_tex_unit = textures.textures.size();
-	int cspace_norm_tex_unit = textures.textures.size() + 1;
-	glActiveTexture(GL_TEXTURE0 + cspace_pos_tex_unit);
-	std::array<GLuint, 4> ao_pass_textures;
-	glGenTextures(ao_pass_textures.size(), ao_pass_textures.data());
-	glBindTexture(GL_TEXTURE_2D, ao_pass_textures[0]);
-	glTexStorage2D(GL_TEXTURE_2D, levels, GL_DEPTH_COMPONENT32F, WIN_WIDTH, WIN_HEIGHT);
-
-	glBindTexture(GL_TEXTURE_2D, ao_pass_textures[1]);
-	glTexStorage2D(GL_TEXTURE_2D, levels, GL_RGB32F, WIN_WIDTH, WIN_HEIGHT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-
-	glActiveTexture(GL_TEXTURE0 + cspace_norm_tex_unit);
-	glBindTexture(GL_TEXTURE_2D, ao_pass_textures[2]);
-	glTexStorage2D(GL_TEXTURE_2D, levels, GL_RGB32F, WIN_WIDTH, WIN_HEIGHT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-
-	GLuint depth_pass_fbo;
-	glGenFramebuffers(1, &depth_pass_fbo);
-	glBindFramebuffer(GL_FRAMEBUFFER, depth_pass_fbo);
-	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, ao_pass_textures[0], 0);
-	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, ao_pass_textures[1], 0);
-	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, ao_pass_textures[2], 0);
-	GLenum depth_draw_buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-	glDrawBuffers(2, depth_draw_buffers);
-	assert(glt::check_framebuffer(depth_pass_fbo));
+	// Each level of the depth pyramid is rendered by attaching it to this framebuffer
+	GLuint depth_mip_fbo;
+	glGenFramebuffers(1, &depth_mip_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, depth_mip_fbo);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
 
-	// Intermediate target for the blur pass
-	int blur_pass_intermediate_unit = textures.textures.size() + 3;
-	glActiveTexture(GL_TEXTURE0 + blur_pass_intermediate_unit);
-	glBindTexture(GL_TEXTURE_2D, ao_pass_textures[3]);
-	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG32F, WIN_WIDTH, WIN_HEIGHT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	// When computing AO at reduced resolution the AO and blur passes render to these
+	// smaller targets, which are then upsampled into the full resolution AO target
+	int ao_level = config.ao_level;
+	const int low_res_ao_unit = textures.textures.size() + 4;
+	const int low_res_blur_unit = textures.textures.size() + 5;
+	std::array<GLuint, 2> low_res_ao_textures = {0, 0};
+	std::array<GLuint, 2> low_res_fbos;
+	glGenFramebuffers(low_res_fbos.size(), low_res_fbos.data());
+	if (ao_level != 0){
+		setup_ao_targets(low_res_ao_textures, low_res_fbos, {low_res_ao_unit, low_res_blur_unit},
+				ao_format, width, height, ao_level);
+	}
+	int low_res_level = ao_level;
 
-	GLuint blur_pass_fbo;
-	glGenFramebuffers(1, &blur_pass_fbo);
-	glBindFramebuffer(GL_FRAMEBUFFER, blur_pass_fbo);
-	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, ao_pass_textures[3], 0);
-	glDrawBuffer(GL_COLOR_ATTACHMENT0);
-	assert(glt::check_framebuffer(blur_pass_fbo));
+	// When accumulating AO over time we ping-pong between two history targets at the
+	// AO resolution, reading last frame's AO from one and writing this frame's to the other
+	bool temporal_enabled = config.temporal;
+	float temporal_blend = 0.1f;
+	bool history_valid = false;
+	const std::array<int, 2> history_units = {static_cast<int>(textures.textures.size()) + 6,
+		static_cast<int>(textures.textures.size()) + 7};
+	std::array<GLuint, 2> history_textures = {0, 0};
+	std::array<GLuint, 2> history_fbos;
+	glGenFramebuffers(history_fbos.size(), history_fbos.data());
+	int history_level = ao_level;
+	glm::mat4 prev_view;
 
-	// Also set the AO sample pass shader to read from the R32F texture holding camera space depth values
-	glUseProgram(ao_sample_shader);
-	glUniform1i(cam_pos_tex_unif, cspace_pos_tex_unit);
-	glUniform1i(cam_norm_tex_unif, cspace_norm_tex_unit);
+	glUseProgram(ao_upsample_shader);
+	glUniform1i(glGetUniformLocation(ao_upsample_shader, "ao_in"), low_res_ao_unit);
+	glUniform1i(glGetUniformLocation(ao_upsample_shader, "camera_depth"), cspace_depth_tex_unit);
 
-	glUseProgram(blur_pass_shader);
-	glUniform1i(blur_cam_pos_tex_unif, cspace_pos_tex_unit);
+	// The AO sample pass shader is specialized for the AO params being used, the variants
+	// read from the R32F texture holding camera space depth values
+	AOShaderCache ao_shaders{shader_path, compact_gbuffer, cspace_depth_tex_unit, cspace_norm_tex_unit};
+	// Or the AO can be computed on the deinterleaved depth, in layers bound to the two units after the history
+	DeinterleavedAO deinterleaved_ao{shader_path, compact_gbuffer, cspace_depth_tex_unit, cspace_norm_tex_unit,
+		static_cast<int>(textures.textures.size()) + 8};
+	bool deinterleaved_enabled = config.deinterleaved_ao && deinterleaved_ao.is_valid();
+
+	glUseProgram(depth_mip_shader);
+	glUniform1i(glGetUniformLocation(depth_mip_shader, "depth_in"), cspace_depth_tex_unit);
 
 	glm::vec3 light_pos = glm::normalize(glm::vec3{0, 1, -1});
 	glm::mat4 look_at_mat = glm::lookAt(glm::vec3{100, 50, 0}, glm::vec3{0, 50, 0}, glm::vec3{0, 1, 0});
 	// Setup view and projection matrix uniform block
 	GLint unif_alignment = 0;
 	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &unif_alignment);
-	// The light pos will be aligned as a vec4 so there's 4 bytes of space between it and the cam pos
-	auto globals_buf = allocator.alloc(3 * sizeof(glm::mat4) + 2 * sizeof(glm::vec4)
-			+ sizeof(glm::vec2), unif_alignment);
-	{
-		char *globals_data = static_cast<char*>(globals_buf.map(GL_UNIFORM_BUFFER,
-					GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_WRITE_BIT));
-		glm::mat4 *mats = reinterpret_cast<glm::mat4*>(globals_data);
-		mats[0] = glm::perspective(glt::to_radians(75),
-				static_cast<float>(WIN_WIDTH) / WIN_HEIGHT, 1.f, 1000.f);
-		mats[1] = look_at_mat;
-		mats[2] = glm::inverse(glm::transpose(look_at_mat));
-
-		glm::vec3 *eye_pos = reinterpret_cast<glm::vec3*>(globals_data + 3 * sizeof(glm::mat4));
-		*eye_pos = glm::vec3{0, 0, 6};
-		// The light pos will be aligned as a vec4 so there's 4 bytes of space between it and the cam pos
-		glm::vec4 *light_info = reinterpret_cast<glm::vec4*>(globals_data + 3 * sizeof(glm::mat4)
-			+ sizeof(glm::vec4));
-		*light_info = glm::vec4{light_pos, 0.65f};
-
-		glm::vec2 *viewport_info = reinterpret_cast<glm::vec2*>(globals_data + 3 * sizeof(glm::mat4)
-			+ 2 * sizeof(glm::vec4));
-		*viewport_info = glm::vec2(WIN_WIDTH, WIN_HEIGHT);
-
-		glBindBufferRange(GL_UNIFORM_BUFFER, 0, globals_buf.buffer, globals_buf.offset, globals_buf.size);
-		globals_buf.unmap(GL_UNIFORM_BUFFER);
-	}
+	const glm::mat4 proj_mat = glm::perspective(glt::to_radians(75),
+			static_cast<float>(display_width) / display_height, 1.f, 1000.f);
+	ViewingBlock viewing{proj_mat, look_at_mat, glm::inverse(glm::transpose(look_at_mat)), glm::vec4{0, 0, 6, 0},
+		glm::vec4{light_pos, 0.65f}, glm::vec2(width, height)};
 
 	// Setup material id attributes
 	auto mat_id_buf = allocator.alloc(model_info.size() * sizeof(GLuint));
@@ -315,18 +942,40 @@ void run(SDL_Window *win, const std::string &model_file){
 	glVertexAttribDivisor(3, 1);
 
 	// Setup AO tweaking parameters
-	AOParams ao_params{0, 27, 16, 3.5f, 3.8f, 0.8f, 0.0005f, 2, 0.8f};
-	auto ao_params_buf = allocator.alloc(4 * sizeof(GLint) + 5 * sizeof(GLfloat), unif_alignment);
+	AOParams ao_params = DEFAULT_AO_PARAMS;
+	// Batches aren't accumulated over frames so take the full sample count
+	if (temporal_enabled && !batch){
+		ao_params.n_samples = TEMPORAL_AO_SAMPLES;
+	}
+	// The screen space AO only needs to add the nearby detail missing from the bake
+	if (has_baked_ao){
+		ao_params.ball_radius = BAKED_AO_BALL_RADIUS;
+	}
+	// The viewing and AO params change from frame to frame so are written to a new slot of a
+	// persistently mapped ring each frame, instead of mapping a buffer the GPU may still be reading
+	StreamingBuffer frame_uniforms{{sizeof(ViewingBlock), sizeof(AOParams)}, static_cast<size_t>(unif_alignment)};
+	std::cout << "Per-frame uniforms are " << (frame_uniforms.is_persistent() ? "persistently mapped" : "uploaded with glBufferSubData")
+		<< "\n";
+	// Setup the table of AO sample offsets, which only changes with the sample count and turns
+	auto ao_pattern_buf = allocator.alloc(AO_MAX_SAMPLES * 4 * sizeof(GLfloat), unif_alignment);
 	{
-		AOParams *p = static_cast<AOParams*>(ao_params_buf.map(GL_UNIFORM_BUFFER,
+		float *pattern = static_cast<float*>(ao_pattern_buf.map(GL_UNIFORM_BUFFER,
 					GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_WRITE_BIT));
-		*p = ao_params;
-		glBindBufferRange(GL_UNIFORM_BUFFER, 5, ao_params_buf.buffer, ao_params_buf.offset, ao_params_buf.size);
-		ao_params_buf.unmap(GL_UNIFORM_BUFFER);
+		fill_ao_sample_pattern(ao_params, pattern);
+		glBindBufferRange(GL_UNIFORM_BUFFER, 6, ao_pattern_buf.buffer, ao_pattern_buf.offset, ao_pattern_buf.size);
+		ao_pattern_buf.unmap(GL_UNIFORM_BUFFER);
+	}
+	AOParams ao_pattern_params = ao_params;
+	const AOVariant *ao_variant = ao_shaders.get(ao_params);
+	if (!ao_variant){
+		std::cout << "Failed to compile the AO sample shader\n";
+		return;
 	}
 
-	// Setup draw commands for our scene geometry
-	auto draw_cmd_buf = allocator.alloc(model_info.size() * sizeof(glt::DrawElemsIndirectCmd));
+	// Setup draw commands for our scene geometry, the culling pass also reads them as an SSBO
+	GLint ssbo_alignment = 0;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &ssbo_alignment);
+	auto draw_cmd_buf = allocator.alloc(model_info.size() * sizeof(glt::DrawElemsIndirectCmd), ssbo_alignment);
 	{
 		glt::DrawElemsIndirectCmd *cmds = static_cast<glt::DrawElemsIndirectCmd*>(
 				draw_cmd_buf.map(GL_DRAW_INDIRECT_BUFFER, GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_WRITE_BIT));
@@ -339,26 +988,138 @@ void run(SDL_Window *win, const std::string &model_file){
 		}
 		draw_cmd_buf.unmap(GL_DRAW_INDIRECT_BUFFER);
 	}
+	DrawCuller culler{shader_path, allocator, geometry, model_info, draw_cmd_buf, MODEL_SCALE,
+		load_multi_draw_indirect_count(win)};
+	// Everything that needed the CPU copy of the geometry has it now
+	geometry = ModelGeometry{};
+	std::cout << "Culled draws are " << (culler.has_draw_count() ? "compacted and drawn with glMultiDrawElementsIndirectCount"
+			: "drawn with zero instances") << "\n";
+	// Sums of the draws and triangles left after culling over the benchmark frames
+	size_t bench_visible_draws = 0, bench_visible_triangles = 0;
 
 	GLuint dummy_vao;
 	glGenVertexArrays(1, &dummy_vao);
 
-	imgui_impl_init(win);
+	// Counts the fragments shaded by the final pass to see the overdraw saved by the depth equal test
+	FragmentCounter shaded_fragments;
+	// Sum of the fragments shaded over the benchmark frames
+	uint64_t bench_shaded_fragments = 0;
+	// Sum of the render resolution's scale over the benchmark frames
+	double bench_render_scale = 0;
+
+	PassTimer pass_timer{{"cull", "depth", "mipmap", "ao_sample", "temporal", "blur_horiz", "blur_vert", "blur_compute",
+		"upsample", "final", "capture", "imgui", "swap", "frame"}};
+	// Interactively the timings only feed the profiler's rolling history, benchmarks keep
+	// every sample and skip the warmup frames
+	pass_timer.set_keep_samples(bench != nullptr);
+	pass_timer.set_enabled(!bench || bench->warmup == 0);
+
+	if (win){
+		imgui_impl_init(win);
+	}
+
+	// Frames are written out by the capture's writer thread. Interactively frames are dropped if
+	// it falls behind so capturing doesn't slow us down, headless we wait so every frame is kept
+	CaptureConfig capture_config = config.capture;
+	std::unique_ptr<FrameCapture> capture;
+	if (!capture_config.output.empty() && !batch){
+		capture = std::make_unique<FrameCapture>(capture_config, win != nullptr);
+		if (!capture->is_valid()){
+			capture.reset();
+		}
+	}
+	if (capture_config.output.empty()){
+		capture_config.output = "capture";
+	}
+	int capture_source = capture_config.source;
+	int capture_format = capture_config.format;
 
 	//auto camera = glt::ArcBallCamera{look_at_mat, 1000.0, 75.0, {1.0 / WIN_WIDTH, 1.0 / WIN_HEIGHT}};
-	auto camera = glt::FlythroughCamera{look_at_mat, 1000.0, 75.0, {1.0 / WIN_WIDTH, 1.0 / WIN_HEIGHT}};
+	auto camera = glt::FlythroughCamera{look_at_mat, 1000.0, 75.0, {1.f / display_width, 1.f / display_height}};
+	// Set when the display size or render scale changed and the targets need to be reallocated
+	bool resize_targets = false;
 	bool quit = false, camera_updated = false, blur_pass_enabled = true, use_rendered_normals = false,
-		 ui_hovered = false;
+		 ui_hovered = false, compute_blur_enabled = config.compute_blur,
+		 frustum_cull_enabled = config.frustum_cull, depth_equal_enabled = config.depth_equal,
+		 adaptive_samples = config.adaptive_ao, multi_scale_ao = config.multi_scale_ao,
+		 baked_ao_enabled = has_baked_ao;
 	int render_mode = FULL;
-	uint32_t prev_time = SDL_GetTicks();
+	int frame = 0;
+	if (batch){
+		// Batches render each view's AO offscreen with their own targets, so the render loop is skipped
+		BatchAO batch_ao{shader_path, batch->output_prefix, width, height, batch->views_per_batch,
+			compact_gbuffer, static_cast<int>(textures.textures.size())};
+		if (batch_ao.is_valid()){
+			ao_params.adaptive_samples = adaptive_samples ? 1 : 0;
+			ao_params.multi_scale = multi_scale_ao ? 1 : 0;
+			// Each view is tested against the frustum in the prepass' geometry shader instead
+			culler.cull(false);
+			const auto batch_start = std::chrono::steady_clock::now();
+			for (size_t first = 0; first < batch_views.size(); first += batch_ao.batch_size()){
+				frame_uniforms.begin_frame();
+				*static_cast<ViewingBlock*>(frame_uniforms.block(VIEWING_BLOCK)) = viewing;
+				*static_cast<AOParams*>(frame_uniforms.block(AO_PARAMS_BLOCK)) = ao_params;
+				frame_uniforms.bind(GL_UNIFORM_BUFFER, 0, VIEWING_BLOCK);
+				frame_uniforms.bind(GL_UNIFORM_BUFFER, 5, AO_PARAMS_BLOCK);
+				batch_ao.render(batch_views, first, batch_views.size() - first, ao_params, [&](){
+					glBindVertexArray(vao);
+					culler.draw();
+				});
+				frame_uniforms.end_frame();
+			}
+			batch_ao.finish();
+			const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - batch_start).count();
+			std::cout << "Wrote AO for " << batch_ao.written() << "/" << batch_views.size() << " views in "
+				<< elapsed << "s, " << batch_views.size() / elapsed << " views/s with "
+				<< batch_ao.batch_size() << " views per batch\n";
+		}
+		else {
+			std::cout << "Failed to compile the batch AO shaders\n";
+		}
+		quit = true;
+	}
+	uint32_t prev_time = win ? SDL_GetTicks() : 0;
 	uint32_t cur_time;
 	while (!quit){
-		cur_time = SDL_GetTicks();
-		float elapsed = (cur_time - prev_time) / 1000.f;
-		prev_time = cur_time;
+		if (bench){
+			if (frame == bench->warmup + bench->frames){
+				break;
+			}
+			pass_timer.set_enabled(frame >= bench->warmup);
+			// Replay the scripted path through the camera so we see the same
+			// transforms it'd give us interactively
+			const float t = frame < bench->warmup ? 0.f
+				: static_cast<float>(frame - bench->warmup) / std::max(bench->frames - 1, 1);
+			camera = glt::FlythroughCamera{camera_path_look_at(camera_path, t), 1000.0, 75.0,
+				{1.f / display_width, 1.f / display_height}};
+			camera_updated = true;
+		}
+		if (bench && !bench->trace_output.empty() && frame == bench->warmup){
+			pass_timer.start_trace();
+		}
+		pass_timer.begin(FRAME_PASS, false);
+		++frame;
+		if (texture_streamer){
+			texture_streamer->update(TEXTURE_STREAM_FRAME_BYTES);
+			if (texture_streamer->done()){
+				std::cout << "Streamed " << texture_streamer->resident() << "/" << texture_streamer->total()
+					<< " textures in " << texture_streamer->elapsed_ms() << "ms\n";
+				texture_streamer.reset();
+			}
+		}
+		const bool dump_frame = bench && !bench->dump_prefix.empty()
+			&& frame == bench->warmup + bench->frames;
+
+		float elapsed = 0;
+		if (win){
+			cur_time = SDL_GetTicks();
+			elapsed = (cur_time - prev_time) / 1000.f;
+			prev_time = cur_time;
+		}
 
 		SDL_Event e;
-		while (SDL_PollEvent(&e)){
+		while (win && SDL_PollEvent(&e)){
+
 			if (e.type == SDL_QUIT || (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE)){
 				quit = true;
 				break;
@@ -374,6 +1135,9 @@ void run(SDL_Window *win, const std::string &model_file){
 					case SDLK_3:
 						render_mode = NO_AO;
 						break;
+					case SDLK_4:
+						render_mode = SAMPLE_HEATMAP;
+						break;
 					case SDLK_n:
 						use_rendered_normals = !use_rendered_normals;
 						break;
@@ -391,6 +1155,17 @@ void run(SDL_Window *win, const std::string &model_file){
 			else if (e.type == SDL_MOUSEWHEEL && !ui_hovered){
 				camera_updated = camera.mouse_scroll(e.wheel, elapsed) || camera_updated;
 			}
+			else if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED){
+				SDL_GL_GetDrawableSize(win, &display_width, &display_height);
+				// A minimized window can report a zero size
+				display_width = std::max(display_width, 1);
+				display_height = std::max(display_height, 1);
+				viewing.proj = glm::perspective(glt::to_radians(75),
+						static_cast<float>(display_width) / display_height, 1.f, 1000.f);
+				camera = glt::FlythroughCamera{camera.transform(), 1000.0, 75.0,
+					{1.f / display_width, 1.f / display_height}};
+				resize_targets = true;
+			}
 
 			// Send events to Imgui
 			if (e.type == SDL_MOUSEBUTTONDOWN || e.type == SDL_MOUSEBUTTONUP){
@@ -409,128 +1184,574 @@ void run(SDL_Window *win, const std::string &model_file){
 			}
 		}
 
+		// The timings lag a few frames behind, the controller waits for frames at the new
+		// resolution to come back before changing it again
+		if (dynamic_res_enabled && dynamic_res.update(pass_timer.last_frame_gpu_ms())){
+			resize_targets = true;
+		}
+		if (resize_targets){
+			width = std::max(static_cast<int>(display_width * dynamic_res.get_scale()), 1);
+			height = std::max(static_cast<int>(display_height * dynamic_res.get_scale()), 1);
+			setup_render_targets(targets, cspace_depth_tex_unit, ao_format, normal_format, width, height);
+			viewing.viewport_dim = glm::vec2(width, height);
+			// The reduced resolution and history targets follow the render resolution
+			low_res_level = -1;
+			history_level = -1;
+			history_valid = false;
+			resize_targets = false;
+		}
 		if (camera_updated){
-			char *globals_data = static_cast<char*>(globals_buf.map(GL_UNIFORM_BUFFER, GL_MAP_WRITE_BIT));
-
-			glm::mat4 *mats = reinterpret_cast<glm::mat4*>(globals_data);
-			mats[1] = camera.transform();
-			mats[2] = glm::inverse(glm::transpose(camera.transform()));
-			glm::vec3 *eye_vec = reinterpret_cast<glm::vec3*>(mats + 3);
-			*eye_vec = camera.eye_pos();
-
-			globals_buf.unmap(GL_UNIFORM_BUFFER);
+			viewing.view = camera.transform();
+			viewing.inv_trans_view = glm::inverse(glm::transpose(viewing.view));
+			viewing.cam_pos = glm::vec4{camera.eye_pos(), 0};
 		}
 		camera_updated = false;
+		ao_params.use_rendered_normals = use_rendered_normals ? 1 : 0;
+		ao_params.adaptive_samples = adaptive_samples ? 1 : 0;
+		ao_params.multi_scale = multi_scale_ao ? 1 : 0;
+		frame_uniforms.begin_frame();
+		*static_cast<ViewingBlock*>(frame_uniforms.block(VIEWING_BLOCK)) = viewing;
+		*static_cast<AOParams*>(frame_uniforms.block(AO_PARAMS_BLOCK)) = ao_params;
+		frame_uniforms.bind(GL_UNIFORM_BUFFER, 0, VIEWING_BLOCK);
+		frame_uniforms.bind(GL_UNIFORM_BUFFER, 5, AO_PARAMS_BLOCK);
+
+		pass_timer.begin(CULL_PASS);
+		culler.cull(frustum_cull_enabled);
+		pass_timer.end(CULL_PASS);
+		if (bench && pass_timer.is_enabled()){
+			bench_visible_draws += culler.stats().visible_draws;
+			bench_visible_triangles += culler.stats().visible_triangles;
+			bench_shaded_fragments += shaded_fragments.last();
+			bench_render_scale += static_cast<double>(width) / display_width;
+		}
+		// ImGui sets its own viewport for the overlay
+		glViewport(0, 0, width, height);
 
 		if (render_mode != NO_AO){
-			// Render camera space positions
-			glBindFramebuffer(GL_FRAMEBUFFER, depth_pass_fbo);
+			// Render camera space depth and normals
+			pass_timer.begin(DEPTH_PASS);
+			glBindFramebuffer(GL_FRAMEBUFFER, targets.depth_pass_fbo);
 			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 			glBindVertexArray(vao);
-			glUseProgram(shader);
-			glUniform1ui(depth_pass_unif, 1);
-			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(draw_cmd_buf.offset),
-					model_info.size(), sizeof(glt::DrawElemsIndirectCmd));
+			glUseProgram(prepass_shader);
+			culler.draw();
+			pass_timer.end(DEPTH_PASS);
+			if (dump_frame){
+				save_texture(cspace_depth_tex_unit, 1, width, height, bench->dump_prefix + "_depth.fimg");
+				if (compact_gbuffer){
+					save_octahedral_normals(cspace_norm_tex_unit, width, height, bench->dump_prefix + "_normals.fimg");
+				}
+				else {
+					save_texture(cspace_norm_tex_unit, 3, width, height, bench->dump_prefix + "_normals.fimg");
+				}
+				save_ao_params(bench->dump_prefix + "_params.txt", ao_params);
+				save_float_image(bench->dump_prefix + "_proj.fimg",
+						FloatImage{4, 4, 1, std::vector<float>(glm::value_ptr(viewing.proj), glm::value_ptr(viewing.proj) + 16)});
+			}
 
-			glBindFramebuffer(GL_FRAMEBUFFER, ao_pass_fbo);
-			glActiveTexture(GL_TEXTURE0 + cspace_pos_tex_unit);
-			glGenerateMipmap(GL_TEXTURE_2D);
+			// Build the depth pyramid, reading each level from the one above it. Limiting the
+			// texture to the previous level keeps the level we're writing out of the sampler
+			pass_timer.begin(MIP_PASS);
+			glBindFramebuffer(GL_FRAMEBUFFER, depth_mip_fbo);
+			glBindVertexArray(dummy_vao);
+			glUseProgram(depth_mip_shader);
+			glActiveTexture(GL_TEXTURE0 + cspace_depth_tex_unit);
+			for (GLsizei i = 1; i < targets.levels; ++i){
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, i - 1);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, i - 1);
+				glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, targets.ao_pass_textures[1], i);
+				glViewport(0, 0, std::max(width >> i, 1), std::max(height >> i, 1));
+				glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+			}
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, targets.levels - 1);
+			glViewport(0, 0, width, height);
+			pass_timer.end(MIP_PASS);
+
+			// Recreate the reduced resolution targets if the AO resolution was changed
+			if (ao_level != 0 && ao_level != low_res_level){
+				setup_ao_targets(low_res_ao_textures, low_res_fbos, {low_res_ao_unit, low_res_blur_unit},
+						ao_format, width, height, ao_level);
+				low_res_level = ao_level;
+			}
+			if (temporal_enabled && (history_textures[0] == 0 || history_level != ao_level)){
+				setup_ao_targets(history_textures, history_fbos, history_units, ao_format, width, height, ao_level);
+				history_level = ao_level;
+				history_valid = false;
+			}
+			// At reduced resolution the AO and blur passes ping-pong between the low
+			// resolution targets and the result is upsampled into the AO target
+			const bool low_res = ao_level != 0;
+			const GLuint ao_fbo = low_res ? low_res_fbos[0] : targets.ao_pass_fbo;
+			const GLuint blur_fbo = low_res ? low_res_fbos[1] : targets.blur_pass_fbo;
+			const int ao_in_unit = low_res ? low_res_ao_unit : ao_tex_unit;
+			const int blur_in_unit = low_res ? low_res_blur_unit : blur_pass_intermediate_unit;
+			const int ao_width = std::max(width >> ao_level, 1);
+			const int ao_height = std::max(height >> ao_level, 1);
+			glViewport(0, 0, ao_width, ao_height);
+			// Finish the AO variants built in the background since the last frame and pick the one
+			// to draw with. While the variant for new settings builds the last one keeps drawing,
+			// so the heatmap and sample pattern follow the variant drawn with, not the UI
+			ao_shaders.poll();
+			const AOVariant *deinterleaved_variant = deinterleaved_enabled
+				? deinterleaved_ao.update_variant(ao_params, render_mode == SAMPLE_HEATMAP) : nullptr;
+			if (!deinterleaved_variant){
+				deinterleaved_ao.poll();
+				// Keep drawing with the last variant while the new one builds or if it failed to compile
+				if (const AOVariant *v = ao_shaders.get(ao_params, render_mode == SAMPLE_HEATMAP, false)){
+					ao_variant = v;
+				}
+			}
+			const AOVariant &drawn_variant = deinterleaved_variant ? *deinterleaved_variant : *ao_variant;
+			if (drawn_variant.n_samples != ao_pattern_params.n_samples || ao_params.turns != ao_pattern_params.turns){
+				ao_pattern_params = ao_params;
+				ao_pattern_params.n_samples = drawn_variant.n_samples;
+				float *pattern = static_cast<float*>(ao_pattern_buf.map(GL_UNIFORM_BUFFER,
+							GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_WRITE_BIT));
+				fill_ao_sample_pattern(ao_pattern_params, pattern);
+				ao_pattern_buf.unmap(GL_UNIFORM_BUFFER);
+			}
+			// The heatmap shows the samples taken by this frame's AO pass, so isn't blurred or accumulated
+			const bool sample_heatmap = drawn_variant.sample_heatmap;
+			const bool blur_enabled = blur_pass_enabled && !sample_heatmap;
+			// Filter scales too large for the compute blur's shared memory fall back to the fragment passes
+			const bool compute_blur = blur_enabled && compute_blur_enabled
+				&& ao_params.filter_scale <= COMPUTE_BLUR_MAX_FILTER_SCALE;
+			// The compute blur can't blur in place, so the AO pass writes to the blur intermediate
+			// target and the blur writes its result to the AO target
+			const GLuint ao_sample_fbo = compute_blur ? blur_fbo : ao_fbo;
+			const int ao_sample_unit = compute_blur ? blur_in_unit : ao_in_unit;
 
 			// Compute noisy AO values
+			pass_timer.begin(AO_PASS);
+			glBindFramebuffer(GL_FRAMEBUFFER, ao_sample_fbo);
 			glClear(GL_COLOR_BUFFER_BIT);
 			glBindVertexArray(dummy_vao);
-			glUseProgram(ao_sample_shader);
-			glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+			// Step the spiral rotation by the golden angle each frame so the accumulated
+			// samples cover it evenly
+			const float phi_offset = temporal_enabled ? std::fmod(frame * 2.3999632f, 6.2831853f) : 0.f;
+			// The deinterleaved pass falls back to the interleaved one if none of its variants compiled
+			if (!deinterleaved_variant || !deinterleaved_ao.render(ao_level, ao_width, ao_height, phi_offset,
+						ao_sample_fbo))
+			{
+				glUseProgram(ao_variant->program);
+				glUniform1i(ao_variant->ao_level_unif, ao_level);
+				glUniform1f(ao_variant->phi_offset_unif, phi_offset);
+				glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+			}
+			pass_timer.end(AO_PASS);
+			if (dump_frame){
+				save_texture(ao_sample_unit, 2, width, height, bench->dump_prefix + "_ao.fimg");
+			}
+
+			// Blend with the reprojected AO from previous frames, the blur then reads
+			// the accumulated AO
+			int blur_src_unit = ao_sample_unit;
+			const glm::mat4 view = camera.transform();
+			if (temporal_enabled && !sample_heatmap){
+				pass_timer.begin(TEMPORAL_PASS);
+				const int cur = frame & 1;
+				glBindFramebuffer(GL_FRAMEBUFFER, history_fbos[cur]);
+				glUseProgram(ao_temporal_shader);
+				glUniform1i(temporal_ao_in_unif, ao_sample_unit);
+				glUniform1i(temporal_history_unif, history_units[1 - cur]);
+				glUniformMatrix4fv(temporal_reproject_unif, 1, GL_FALSE, glm::value_ptr(prev_view * glm::inverse(view)));
+				glUniform1i(temporal_ao_level_unif, ao_level);
+				glUniform1ui(temporal_history_valid_unif, history_valid);
+				glUniform1f(temporal_blend_unif, temporal_blend);
+				glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+				pass_timer.end(TEMPORAL_PASS);
+				blur_src_unit = history_units[cur];
+				history_valid = true;
+				if (!blur_enabled){
+					// Nothing else will write the accumulated AO to the AO target
+					glCopyImageSubData(history_textures[cur], GL_TEXTURE_2D, 0, 0, 0, 0,
+							low_res ? low_res_ao_textures[0] : targets.ao_val_tex, GL_TEXTURE_2D, 0, 0, 0, 0,
+							ao_width, ao_height, 1);
+				}
+			}
+			else {
+				history_valid = false;
+			}
+			prev_view = view;
 
-			if (blur_pass_enabled){
+			if (compute_blur){
+				// Blur both axes in one dispatch, writing the result to the AO target
+				pass_timer.begin(BLUR_COMPUTE_PASS);
+				glUseProgram(blur_compute_shader);
+				glUniform1i(blur_compute_ao_in_unif, blur_src_unit);
+				glBindImageTexture(0, low_res ? low_res_ao_textures[0] : targets.ao_val_tex, 0, GL_FALSE, 0,
+						GL_WRITE_ONLY, ao_format);
+				glDispatchCompute((ao_width + COMPUTE_BLUR_TILE - 1) / COMPUTE_BLUR_TILE,
+						(ao_height + COMPUTE_BLUR_TILE - 1) / COMPUTE_BLUR_TILE, 1);
+				// The upsample or final pass reads the blurred AO through a sampler
+				glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+				pass_timer.end(BLUR_COMPUTE_PASS);
+			}
+			else if (blur_enabled){
 				// Perform horizontal blur pass
-				glBindFramebuffer(GL_FRAMEBUFFER, blur_pass_fbo);
+				pass_timer.begin(BLUR_H_PASS);
+				glBindFramebuffer(GL_FRAMEBUFFER, blur_fbo);
 				glClear(GL_COLOR_BUFFER_BIT);
 				glUseProgram(blur_pass_shader);
 				glUniform2i(blur_axis_unif, 0, 1);
-				glUniform1i(blur_ao_in_unif, ao_tex_unit);
+				glUniform1i(blur_ao_in_unif, blur_src_unit);
 				glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+				pass_timer.end(BLUR_H_PASS);
 
 				// Perform vertical blur pass
-				glBindFramebuffer(GL_FRAMEBUFFER, ao_pass_fbo);
+				pass_timer.begin(BLUR_V_PASS);
+				glBindFramebuffer(GL_FRAMEBUFFER, ao_fbo);
 				glClear(GL_COLOR_BUFFER_BIT);
-				glUniform1i(blur_ao_in_unif, blur_pass_intermediate_unit);
+				glUniform1i(blur_ao_in_unif, blur_in_unit);
 				glUniform2i(blur_axis_unif, 1, 0);
 				glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+				pass_timer.end(BLUR_V_PASS);
+			}
+			glViewport(0, 0, width, height);
+			if (low_res){
+				pass_timer.begin(UPSAMPLE_PASS);
+				glBindFramebuffer(GL_FRAMEBUFFER, targets.ao_pass_fbo);
+				glUseProgram(ao_upsample_shader);
+				glUniform1i(upsample_ao_level_unif, ao_level);
+				glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+				pass_timer.end(UPSAMPLE_PASS);
+			}
+			if (dump_frame){
+				save_texture(ao_tex_unit, 2, width, height, bench->dump_prefix + "_ao_blur.fimg");
 			}
 
-			glBindFramebuffer(GL_FRAMEBUFFER, 0);
-			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			pass_timer.begin(FINAL_PASS);
+			glBindFramebuffer(GL_FRAMEBUFFER, targets.scene_fbo);
+			if (depth_equal_enabled){
+				// The prepass depth is already in place, so only the visible fragments pass
+				// and the shading runs once per pixel
+				glClear(GL_COLOR_BUFFER_BIT);
+				glDepthFunc(GL_EQUAL);
+				glDepthMask(GL_FALSE);
+			}
+			else {
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			}
 
 			glBindVertexArray(vao);
 			glUseProgram(shader);
-			glUniform1ui(depth_pass_unif, 0);
 			glUniform1ui(ao_only_unif, render_mode == AO_ONLY);
-			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(draw_cmd_buf.offset),
-					model_info.size(), sizeof(glt::DrawElemsIndirectCmd));
+			glUniform1ui(sample_heatmap_unif, sample_heatmap);
+			glUniform1ui(baked_ao_unif, baked_ao_enabled);
+			shaded_fragments.begin();
+			culler.draw();
+			shaded_fragments.end();
 			glUniform1ui(ao_only_unif, 0);
+			glUniform1ui(sample_heatmap_unif, 0);
+			glUniform1ui(baked_ao_unif, 0);
+			glDepthFunc(GL_LESS);
+			glDepthMask(GL_TRUE);
+			pass_timer.end(FINAL_PASS);
 		}
 		else {
-			glBindFramebuffer(GL_FRAMEBUFFER, ao_pass_fbo);
+			history_valid = false;
+			glBindFramebuffer(GL_FRAMEBUFFER, targets.ao_pass_fbo);
 			glClearColor(1, 1, 1, 1);
 			glClear(GL_COLOR_BUFFER_BIT);
 			glClearColor(0, 0, 0, 1);
 
-			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glBindFramebuffer(GL_FRAMEBUFFER, targets.scene_fbo);
 			glActiveTexture(GL_TEXTURE0 + ao_tex_unit);
 			glGenerateMipmap(GL_TEXTURE_2D);
 
+			// Without the prepass there's no depth to test against so this pass does its own
+			pass_timer.begin(FINAL_PASS);
 			glBindVertexArray(vao);
 			glUseProgram(shader);
-			glUniform1ui(depth_pass_unif, 0);
 			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(draw_cmd_buf.offset),
-					model_info.size(), sizeof(glt::DrawElemsIndirectCmd));
+			shaded_fragments.begin();
+			culler.draw();
+			shaded_fragments.end();
+			pass_timer.end(FINAL_PASS);
+		}
+		shaded_fragments.end_frame();
+		if (win){
+			// Upscale the scene if it was rendered below the display resolution
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, targets.scene_fbo);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+			glBlitFramebuffer(0, 0, width, height, 0, 0, display_width, display_height, GL_COLOR_BUFFER_BIT,
+					width == display_width && height == display_height ? GL_NEAREST : GL_LINEAR);
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		}
+		if (capture){
+			pass_timer.begin(CAPTURE_PASS);
+			if (capture->settings().source == CAPTURE_AO){
+				capture->capture(targets.ao_pass_fbo, GL_COLOR_ATTACHMENT0, width, height);
+			}
+			else if (win){
+				// The window has the frame as shown, before the UI is drawn over it
+				capture->capture(0, GL_BACK, display_width, display_height);
+			}
+			else {
+				capture->capture(targets.scene_fbo, GL_COLOR_ATTACHMENT0, width, height);
+			}
+			pass_timer.end(CAPTURE_PASS);
+		}
+		frame_uniforms.end_frame();
+
+		if (!win){
+			pass_timer.end(FRAME_PASS);
+			pass_timer.end_frame();
+			// Keep the driver from queuing up an unbounded number of frames since
+			// we don't have a swap to throttle us
+			glFlush();
+			continue;
 		}
 
         ImGuiIO& io = ImGui::GetIO();
         imgui_impl_newframe();
 
 		ImGui::Text("Average %.3f ms/frame (%.1f FPS)", 1000.0f / io.Framerate, io.Framerate);
+		if (texture_streamer){
+			ImGui::Text("Streaming textures: %d/%d resident", static_cast<int>(texture_streamer->resident()),
+					static_cast<int>(texture_streamer->total()));
+		}
 		ImGui::RadioButton("Full Render", &render_mode, FULL);
 		ImGui::RadioButton("AO Only", &render_mode, AO_ONLY);
 		ImGui::RadioButton("No AO", &render_mode, NO_AO);
+		ImGui::RadioButton("Sample Heatmap", &render_mode, SAMPLE_HEATMAP);
 		ImGui::Checkbox("Blur Enabled", &blur_pass_enabled);
+		if (blur_pass_enabled){
+			ImGui::Checkbox("Compute Shader Blur", &compute_blur_enabled);
+		}
 		ImGui::Checkbox("Use Rendered Normals", &use_rendered_normals);
+		if (has_baked_ao){
+			ImGui::Checkbox("Baked AO", &baked_ao_enabled);
+		}
+		if (render_mode != NO_AO){
+			ImGui::Checkbox("Depth Equal Shading", &depth_equal_enabled);
+		}
+		if (shaded_fragments.is_supported()){
+			ImGui::Text("Shaded %.2fM fragments, %.2f per pixel", shaded_fragments.last() / 1e6,
+					static_cast<double>(shaded_fragments.last()) / (width * height));
+		}
+		ImGui::Checkbox("Frustum Culling", &frustum_cull_enabled);
+		if (frustum_cull_enabled){
+			const CullStats &cull_stats = culler.stats();
+			ImGui::Text("Culled %d/%d draws, %.2fM/%.2fM triangles",
+					static_cast<int>(cull_stats.draws - cull_stats.visible_draws), static_cast<int>(cull_stats.draws),
+					(cull_stats.triangles - cull_stats.visible_triangles) / 1e6, cull_stats.triangles / 1e6);
+		}
+		ImGui::Text("Render resolution %dx%d of %dx%d", width, height, display_width, display_height);
+		ImGui::Checkbox("Dynamic Resolution", &dynamic_res_enabled);
+		if (dynamic_res_enabled){
+			float target_ms = dynamic_res.get_target();
+			if (ImGui::SliderFloat("Target GPU ms", &target_ms, 2.f, 33.3f)){
+				dynamic_res.set_target(target_ms);
+			}
+			ImGui::Text("Smoothed GPU frame time %.2fms", dynamic_res.frame_ms());
+		}
+		else {
+			float render_scale = dynamic_res.get_scale();
+			if (ImGui::SliderFloat("Render Scale", &render_scale, 0.5f, 1.f)){
+				dynamic_res.set_scale(render_scale);
+				resize_targets = true;
+			}
+		}
+		ImGui::Text("AO Resolution");
+		ImGui::RadioButton("Full", &ao_level, 0);
+		ImGui::SameLine();
+		ImGui::RadioButton("Half", &ao_level, 1);
+		ImGui::SameLine();
+		ImGui::RadioButton("Quarter", &ao_level, 2);
+		if (ImGui::Checkbox("Temporal Accumulation", &temporal_enabled) && temporal_enabled){
+			// Most of the samples come from the history so we can take far fewer per frame
+			ao_params.n_samples = std::min(ao_params.n_samples, TEMPORAL_AO_SAMPLES);
+		}
+		if (temporal_enabled){
+			ImGui::SliderFloat("History Blend", &temporal_blend, 0.02f, 1.f);
+		}
 		if (ImGui::CollapsingHeader("AO Params")){
-			ImGui::SliderInt("Num Samples", &ao_params.n_samples, 1, 64);
+			ImGui::Checkbox("Multi-scale AO", &multi_scale_ao);
+			if (multi_scale_ao){
+				// The sample count is the budget shared by all the scales
+				ImGui::SliderInt("Num Samples", &ao_params.n_samples, 1, AO_MAX_SAMPLES);
+				ImGui::SliderInt("Scales", &ao_params.n_scales, 1, AO_MAX_SCALES);
+				ImGui::SliderInt("Samples per Scale", &ao_params.scale_samples, 1,
+						std::max(ao_params.n_samples / ao_params.n_scales, 1));
+				for (int i = 0; i < ao_params.n_scales; ++i){
+					ImGui::SliderFloat(("Scale " + std::to_string(i) + " Radius").c_str(), &ao_params.scale_radii[i],
+							1.f, 400.f);
+				}
+			}
+			else {
+				ImGui::Checkbox("Adaptive Samples", &adaptive_samples);
+				if (adaptive_samples){
+					// The sample count becomes the most taken at any pixel
+					ImGui::SliderInt("Max Samples", &ao_params.n_samples, 1, AO_MAX_SAMPLES);
+					ImGui::SliderInt("Min Samples", &ao_params.min_samples, 1, ao_params.n_samples);
+					ImGui::SliderFloat("Full Sample Radius (px)", &ao_params.full_sample_radius, 4.f, 256.f);
+				}
+				else {
+					ImGui::SliderInt("Num Samples", &ao_params.n_samples, 1, AO_MAX_SAMPLES);
+				}
+			}
 			ImGui::SliderInt("Num Turns", &ao_params.turns, 1, 64);
-			ImGui::SliderFloat("Ball Radius", &ao_params.ball_radius, 0.1f, 10.f);
+			if (!multi_scale_ao){
+				ImGui::SliderFloat("Ball Radius", &ao_params.ball_radius, 1.f, 75.f);
+			}
 			ImGui::SliderFloat("Sigma", &ao_params.sigma, 0.1f, 20.f);
 			ImGui::SliderFloat("Kappa", &ao_params.kappa, 0.1f, 10.f);
+			if (deinterleaved_ao.is_valid()){
+				// Mostly helps at large radii, where the interleaved pass' taps scatter across the pyramid
+				ImGui::Checkbox("Deinterleaved AO", &deinterleaved_enabled);
+			}
+			ImGui::Text("Compiled AO shader variants: %d",
+					static_cast<int>(ao_shaders.size() + deinterleaved_ao.num_variants()));
+			const size_t building = ao_shaders.num_building() + deinterleaved_ao.num_building();
+			if (building > 0){
+				ImGui::Text("Compiling %d in the background", static_cast<int>(building));
+			}
 		}
 		if (ImGui::CollapsingHeader("Filter Params")){
 			ImGui::SliderInt("Filter Scale", &ao_params.filter_scale, 1, 10);
 			ImGui::SliderFloat("Edge Sharpness", &ao_params.edge_sharpness, 0.f, 10.f);
 		}
+		if (ImGui::CollapsingHeader("Profiler")){
+			ImGui::Text("%-14s%-22s%s", "Pass", "GPU median/p99", "CPU median/p99");
+			for (size_t i = 0; i < pass_timer.num_passes(); ++i){
+				const PassHistory &gpu = pass_timer.gpu_recent(i);
+				const PassHistory &cpu = pass_timer.cpu_recent(i);
+				if (cpu.samples().empty()){
+					continue;
+				}
+				const PassStats cpu_stats = cpu.stats();
+				if (gpu.samples().empty()){
+					ImGui::Text("%-14s%-22s%.3f/%.3fms", pass_timer.name(i).c_str(), "-",
+							cpu_stats.median, cpu_stats.p99);
+				}
+				else {
+					const PassStats gpu_stats = gpu.stats();
+					char gpu_text[32];
+					std::snprintf(gpu_text, sizeof(gpu_text), "%.3f/%.3fms", gpu_stats.median, gpu_stats.p99);
+					ImGui::Text("%-14s%-22s%.3f/%.3fms", pass_timer.name(i).c_str(), gpu_text,
+							cpu_stats.median, cpu_stats.p99);
+				}
+				// Graph the GPU time of the passes which have it, otherwise the CPU time
+				const PassHistory &graph = gpu.samples().empty() ? cpu : gpu;
+				ImGui::PlotLines(("##" + pass_timer.name(i)).c_str(), graph.samples().data(), graph.samples().size(),
+						graph.offset(), nullptr, 0.f, FLT_MAX, ImVec2(0, 32));
+			}
+			if (pass_timer.is_tracing()){
+				ImGui::Text("Capturing trace: %d/%d frames", static_cast<int>(pass_timer.trace_frames()),
+						static_cast<int>(TRACE_CAPTURE_FRAMES));
+			}
+			else if (ImGui::Button("Capture Trace")){
+				pass_timer.start_trace();
+			}
+		}
+		if (ImGui::CollapsingHeader("Frame Capture")){
+			if (capture){
+				ImGui::Text("Captured %d frames, %d written, %d dropped", static_cast<int>(capture->frames_captured()),
+						static_cast<int>(capture->frames_written()), static_cast<int>(capture->frames_dropped()));
+				// Waits for the frames still queued to be written
+				if (ImGui::Button("Stop Capture")){
+					capture.reset();
+				}
+			}
+			else {
+				ImGui::Text("Output: %s", capture_config.output.c_str());
+				ImGui::RadioButton("Final", &capture_source, CAPTURE_FINAL);
+				ImGui::SameLine();
+				ImGui::RadioButton("AO", &capture_source, CAPTURE_AO);
+				ImGui::RadioButton("PNG", &capture_format, CAPTURE_PNG);
+				ImGui::SameLine();
+				ImGui::RadioButton("Float", &capture_format, CAPTURE_FIMG);
+				ImGui::SameLine();
+				ImGui::RadioButton("Raw", &capture_format, CAPTURE_RAW);
+				if (ImGui::Button("Start Capture")){
+					capture_config.source = static_cast<CAPTURE_SOURCE>(capture_source);
+					capture_config.format = static_cast<CAPTURE_FORMAT>(capture_format);
+					capture = std::make_unique<FrameCapture>(capture_config, true);
+					if (!capture->is_valid()){
+						capture.reset();
+					}
+				}
+			}
+		}
 		ui_hovered = ImGui::IsMouseHoveringAnyWindow();
 
         glViewport(0, 0, (int)io.DisplaySize.x, (int)io.DisplaySize.y);
+		pass_timer.begin(IMGUI_PASS);
         ImGui::Render();
+		pass_timer.end(IMGUI_PASS);
 
+		pass_timer.begin(SWAP_PASS, false);
 		SDL_GL_SwapWindow(win);
-
-		// Update our AO parameters
-		{
-			ao_params.use_rendered_normals = use_rendered_normals ? 1 : 0;
-			AOParams *p = static_cast<AOParams*>(ao_params_buf.map(GL_UNIFORM_BUFFER, GL_MAP_WRITE_BIT));
-			*p = ao_params;
-			ao_params_buf.unmap(GL_UNIFORM_BUFFER);
+		pass_timer.end(SWAP_PASS);
+		pass_timer.end(FRAME_PASS);
+		pass_timer.end_frame();
+		if (pass_timer.is_tracing() && pass_timer.trace_frames() >= TRACE_CAPTURE_FRAMES
+				&& pass_timer.write_trace("trace.json")){
+			std::cout << "Wrote a trace of " << TRACE_CAPTURE_FRAMES << " frames to trace.json\n";
+		}
+		if (frame == 1){
+			std::cout << "First frame after " << std::chrono::duration<double, std::milli>(
+					std::chrono::steady_clock::now() - load_start).count() << "ms\n";
+		}
+	}
+	if (bench){
+		pass_timer.flush();
+		for (size_t i = 0; i < pass_timer.num_passes(); ++i){
+			const PassStats stats = compute_pass_stats(pass_timer.samples(i));
+			const PassStats cpu = compute_pass_stats(pass_timer.cpu_times(i));
+			if (cpu.count == 0){
+				continue;
+			}
+			std::cout << pass_timer.name(i) << ": ";
+			if (stats.count > 0){
+				std::cout << "min " << stats.min << "ms, median " << stats.median << "ms, p99 " << stats.p99 << "ms, ";
+			}
+			std::cout << "CPU median " << cpu.median << "ms, p99 " << cpu.p99 << "ms\n";
+		}
+		pass_timer.write_stats(bench->output);
+		if (!bench->trace_output.empty() && pass_timer.write_trace(bench->trace_output)){
+			std::cout << "Wrote a trace of the benchmark to " << bench->trace_output << "\n";
+		}
+		const CullStats &cull_stats = culler.stats();
+		std::cout << "Frustum culling: on average " << cull_stats.draws - bench_visible_draws / bench->frames << "/"
+			<< cull_stats.draws << " draws and " << cull_stats.triangles - bench_visible_triangles / bench->frames << "/"
+			<< cull_stats.triangles << " triangles culled per frame\n";
+		if (shaded_fragments.is_supported()){
+			const double fragments = static_cast<double>(bench_shaded_fragments) / bench->frames;
+			std::cout << "Final pass shaded on average " << fragments << " fragments per frame, "
+				<< fragments / (width * height) << " per pixel\n";
+		}
+		if (dynamic_res_enabled){
+			std::cout << "Dynamic resolution: average render scale " << bench_render_scale / bench->frames
+				<< ", final resolution " << width << "x" << height << "\n";
 		}
 	}
+	texture_streamer.reset();
+	capture.reset();
 	glDeleteVertexArrays(1, &vao);
+	glDeleteVertexArrays(1, &dummy_vao);
 	glDeleteTextures(textures.textures.size(), textures.textures.data());
-	glDeleteTextures(ao_pass_textures.size(), ao_pass_textures.data());
-	glDeleteTextures(1, &ao_val_tex);
-	glDeleteFramebuffers(1, &depth_pass_fbo);
-	glDeleteFramebuffers(1, &ao_pass_fbo);
-	glDeleteFramebuffers(1, &blur_pass_fbo);
-    imgui_impl_shutdown();
+	glDeleteTextures(targets.ao_pass_textures.size(), targets.ao_pass_textures.data());
+	glDeleteTextures(1, &targets.ao_val_tex);
+	glDeleteFramebuffers(1, &targets.depth_pass_fbo);
+	glDeleteFramebuffers(1, &depth_mip_fbo);
+	glDeleteFramebuffers(1, &targets.ao_pass_fbo);
+	glDeleteFramebuffers(1, &targets.blur_pass_fbo);
+	if (low_res_ao_textures[0] != 0){
+		glDeleteTextures(low_res_ao_textures.size(), low_res_ao_textures.data());
+	}
+	glDeleteFramebuffers(low_res_fbos.size(), low_res_fbos.data());
+	if (history_textures[0] != 0){
+		glDeleteTextures(history_textures.size(), history_textures.data());
+	}
+	glDeleteFramebuffers(history_fbos.size(), history_fbos.data());
+	glDeleteFramebuffers(1, &targets.scene_fbo);
+	glDeleteRenderbuffers(1, &targets.scene_color_rb);
+	if (win){
+		imgui_impl_shutdown();
+	}
 	// Intel driver gives an error when I delete a shader?
 	//glDeleteProgram(shader);
 }
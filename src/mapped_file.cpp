@@ -0,0 +1,107 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "mapped_file.h"
+
+#ifdef _WIN32
+MappedFile::MappedFile() : mem(nullptr), len(0), file(INVALID_HANDLE_VALUE), mapping(nullptr){}
+#else
+MappedFile::MappedFile() : mem(nullptr), len(0), fd(-1){}
+#endif
+MappedFile::~MappedFile(){
+	close();
+}
+#ifdef _WIN32
+bool MappedFile::open(const std::string &fname){
+	close();
+	file = CreateFileA(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE){
+		return false;
+	}
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)){
+		close();
+		return false;
+	}
+	len = static_cast<size_t>(file_size.QuadPart);
+	if (len == 0){
+		return true;
+	}
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr){
+		close();
+		return false;
+	}
+	mem = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (mem == nullptr){
+		close();
+		return false;
+	}
+	return true;
+}
+void MappedFile::close(){
+	if (mem){
+		UnmapViewOfFile(mem);
+	}
+	if (mapping){
+		CloseHandle(mapping);
+	}
+	if (file != INVALID_HANDLE_VALUE){
+		CloseHandle(file);
+	}
+	mem = nullptr;
+	len = 0;
+	mapping = nullptr;
+	file = INVALID_HANDLE_VALUE;
+}
+#else
+bool MappedFile::open(const std::string &fname){
+	close();
+	fd = ::open(fname.c_str(), O_RDONLY);
+	if (fd == -1){
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0){
+		close();
+		return false;
+	}
+	len = static_cast<size_t>(st.st_size);
+	if (len == 0){
+		return true;
+	}
+	void *m = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (m == MAP_FAILED){
+		close();
+		return false;
+	}
+	mem = static_cast<const char*>(m);
+	return true;
+}
+void MappedFile::close(){
+	if (mem){
+		munmap(const_cast<char*>(mem), len);
+	}
+	if (fd != -1){
+		::close(fd);
+	}
+	mem = nullptr;
+	len = 0;
+	fd = -1;
+}
+#endif
+const char* MappedFile::data() const {
+	return mem;
+}
+size_t MappedFile::size() const {
+	return len;
+}
+
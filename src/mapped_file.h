@@ -0,0 +1,37 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+/*
+ * A read-only memory mapping of a whole file, so large files can be read in place
+ * without copying them into memory first
+ */
+class MappedFile {
+	const char *mem;
+	size_t len;
+#ifdef _WIN32
+	void *file, *mapping;
+#else
+	int fd;
+#endif
+
+public:
+	MappedFile();
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	/*
+	 * Map the file, unmapping any file previously mapped. Returns false if the
+	 * file couldn't be opened or mapped
+	 */
+	bool open(const std::string &file);
+	void close();
+	// The file's contents, null for an empty file
+	const char* data() const;
+	size_t size() const;
+};
+
+#endif
+
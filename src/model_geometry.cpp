@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include "model_geometry.h"
+
+ModelGeometry read_back_geometry(const glt::SubBuffer &vert_buf, const glt::SubBuffer &elem_buf){
+	ModelGeometry geom;
+	geom.vertices.resize(vert_buf.size / sizeof(float));
+	geom.indices.resize(elem_buf.size / sizeof(GLuint));
+	glBindBuffer(GL_COPY_READ_BUFFER, vert_buf.buffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, vert_buf.offset, geom.vertices.size() * sizeof(float), geom.vertices.data());
+	glBindBuffer(GL_COPY_READ_BUFFER, elem_buf.buffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, elem_buf.offset, geom.indices.size() * sizeof(GLuint), geom.indices.data());
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	return geom;
+}
+std::vector<uint32_t> model_triangles(const ModelGeometry &geom,
+		const std::unordered_map<std::string, glt::ModelMatInfo> &model_info)
+{
+	std::vector<uint32_t> triangles;
+	triangles.reserve(geom.indices.size());
+	for (const auto &m : model_info){
+		for (size_t i = m.second.index_offset; i + 2 < m.second.index_offset + m.second.indices; i += 3){
+			for (size_t j = 0; j < 3; ++j){
+				triangles.push_back(m.second.vert_offset + geom.indices[i + j]);
+			}
+		}
+	}
+	return triangles;
+}
+std::vector<float> compute_vertex_tangents(const ModelGeometry &geom,
+		const std::unordered_map<std::string, glt::ModelMatInfo> &model_info)
+{
+	const size_t num_verts = geom.vertices.size() / MODEL_VERTEX_FLOATS;
+	std::vector<glm::vec3> tan_sum(num_verts, glm::vec3{0}), bitan_sum(num_verts, glm::vec3{0});
+	auto position = [&](size_t v){
+		return glm::vec3{geom.vertices[v * MODEL_VERTEX_FLOATS], geom.vertices[v * MODEL_VERTEX_FLOATS + 1],
+			geom.vertices[v * MODEL_VERTEX_FLOATS + 2]};
+	};
+	auto texcoord = [&](size_t v){
+		return glm::vec2{geom.vertices[v * MODEL_VERTEX_FLOATS + 6], geom.vertices[v * MODEL_VERTEX_FLOATS + 7]};
+	};
+	for (const auto &m : model_info){
+		for (size_t i = m.second.index_offset; i + 2 < m.second.index_offset + m.second.indices; i += 3){
+			const size_t v[3] = {m.second.vert_offset + geom.indices[i], m.second.vert_offset + geom.indices[i + 1],
+				m.second.vert_offset + geom.indices[i + 2]};
+			const glm::vec3 dp1 = position(v[1]) - position(v[0]);
+			const glm::vec3 dp2 = position(v[2]) - position(v[0]);
+			const glm::vec2 dst1 = texcoord(v[1]) - texcoord(v[0]);
+			const glm::vec2 dst2 = texcoord(v[2]) - texcoord(v[0]);
+			// Solving for dp/ds and dp/dt would divide by the texture space area, which would
+			// then weight the sum by it, so we leave it out and only keep its sign
+			const float area = dst1.x * dst2.y - dst2.x * dst1.y;
+			if (area == 0.f){
+				continue;
+			}
+			const float sign = area > 0.f ? 1.f : -1.f;
+			const glm::vec3 dp_ds = sign * (dp1 * dst2.y - dp2 * dst1.y);
+			const glm::vec3 dp_dt = sign * (dp2 * dst1.x - dp1 * dst2.x);
+			for (const auto &x : v){
+				tan_sum[x] += dp_ds;
+				bitan_sum[x] += dp_dt;
+			}
+		}
+	}
+
+	std::vector<float> tangents(num_verts * 4);
+	for (size_t v = 0; v < num_verts; ++v){
+		const float *n_data = &geom.vertices[v * MODEL_VERTEX_FLOATS + 3];
+		glm::vec3 n{n_data[0], n_data[1], n_data[2]};
+		n = glm::length(n) > 0.f ? glm::normalize(n) : glm::vec3{0, 0, 1};
+		glm::vec3 t = tan_sum[v] - n * glm::dot(n, tan_sum[v]);
+		if (glm::length(t) < 1e-12f){
+			// Pick the axis least aligned with the normal to build a tangent from
+			const glm::vec3 axis = std::abs(n.x) < 0.9f ? glm::vec3{1, 0, 0} : glm::vec3{0, 1, 0};
+			t = axis - n * glm::dot(n, axis);
+		}
+		t = glm::normalize(t);
+		tangents[4 * v] = t.x;
+		tangents[4 * v + 1] = t.y;
+		tangents[4 * v + 2] = t.z;
+		tangents[4 * v + 3] = glm::dot(glm::cross(n, t), bitan_sum[v]) < 0.f ? -1.f : 1.f;
+	}
+	return tangents;
+}
+
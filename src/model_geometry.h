@@ -0,0 +1,43 @@
+#ifndef MODEL_GEOMETRY_H
+#define MODEL_GEOMETRY_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "glt/gl_core_4_5.h"
+#include "glt/buffer_allocator.h"
+#include "glt/load_models.h"
+
+// Floats per vertex in the model's interleaved vertex data: position, normal and texcoord
+const size_t MODEL_VERTEX_FLOATS = 8;
+
+// A CPU copy of the model's vertex and index data, for preprocessing done after loading
+struct ModelGeometry {
+	std::vector<float> vertices;
+	std::vector<GLuint> indices;
+};
+
+/*
+ * Read back the vertex and index data of the model from the GPU. The model may have
+ * come from glt, the scene cache or our OBJ loader so this is the one place it's
+ * all in the same form
+ */
+ModelGeometry read_back_geometry(const glt::SubBuffer &vert_buf, const glt::SubBuffer &elem_buf);
+/*
+ * Get the model's triangles as triples of indices into all its vertices, the model's
+ * indices are relative to the first vertex of the object they're part of
+ */
+std::vector<uint32_t> model_triangles(const ModelGeometry &geom,
+		const std::unordered_map<std::string, glt::ModelMatInfo> &model_info);
+/*
+ * Compute a tangent for each vertex of the model, in the style of MikkTSpace: the tangents
+ * of the triangles sharing the vertex are summed weighted by their area in texture space
+ * and orthogonalized against the normal. The w component is the handedness of the frame,
+ * the bitangent is w * cross(normal, tangent). Vertices without a usable texture space
+ * parameterization get an arbitrary tangent perpendicular to the normal
+ */
+std::vector<float> compute_vertex_tangents(const ModelGeometry &geom,
+		const std::unordered_map<std::string, glt::ModelMatInfo> &model_info);
+
+#endif
+
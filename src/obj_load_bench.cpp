@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "obj_loader.h"
+
+/*
+ * Write a synthetic OBJ of a grid x grid height field split into rows of groups, with
+ * positions, texcoords and normals for each vertex and a material per group
+ */
+static bool write_synthetic_obj(const std::string &file, int grid){
+	std::ofstream fout{file};
+	if (!fout){
+		std::cout << "Failed to open " << file << " for writing\n";
+		return false;
+	}
+	const int groups = std::max(grid / 64, 1);
+	const std::string mtl = file.substr(0, file.find_last_of('.')) + ".mtl";
+	std::ofstream mtl_out{mtl};
+	for (int g = 0; g < groups; ++g){
+		mtl_out << "newmtl mat" << g << "\nKd 0.8 0.8 0.8\nKa 0.1 0.1 0.1\n";
+	}
+	const size_t mtl_dir = mtl.find_last_of("/\\");
+	fout << "mtllib " << (mtl_dir == std::string::npos ? mtl : mtl.substr(mtl_dir + 1)) << "\n";
+	char buf[256];
+	for (int y = 0; y <= grid; ++y){
+		for (int x = 0; x <= grid; ++x){
+			const float h = 0.1f * std::sin(0.05f * x) * std::cos(0.07f * y);
+			std::snprintf(buf, sizeof(buf), "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn 0.0 1.0 0.0\n",
+					static_cast<float>(x), h, static_cast<float>(y),
+					static_cast<float>(x) / grid, static_cast<float>(y) / grid);
+			fout << buf;
+		}
+	}
+	const int rows_per_group = (grid + groups - 1) / groups;
+	for (int y = 0; y < grid; ++y){
+		if (y % rows_per_group == 0){
+			fout << "g group" << y / rows_per_group << "\nusemtl mat" << y / rows_per_group << "\n";
+		}
+		for (int x = 0; x < grid; ++x){
+			const int i = y * (grid + 1) + x + 1;
+			const int j = i + grid + 1;
+			std::snprintf(buf, sizeof(buf), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n",
+					i, i, i, i + 1, i + 1, i + 1, j + 1, j + 1, j + 1, j, j, j);
+			fout << buf;
+		}
+	}
+	return static_cast<bool>(fout);
+}
+// Load the model iters times, returning the stats of the fastest run
+static bool time_load(const std::string &file, int threads, int iters, ObjModel &model, ObjLoadStats &best){
+	for (int i = 0; i < iters; ++i){
+		ObjLoadStats stats;
+		if (!load_obj_parallel(file, model, threads, &stats)){
+			return false;
+		}
+		if (i == 0 || stats.total < best.total){
+			best = stats;
+		}
+	}
+	return true;
+}
+static void print_stats(int threads, const ObjLoadStats &stats){
+	std::printf("%3d threads: %8.2fms (parse %.2fms, merge %.2fms, dedupe %.2fms), %.1f MB/s\n", threads,
+			stats.total, stats.parse, stats.merge, stats.dedupe, stats.file_bytes / (1024.0 * 1024.0) / (stats.total / 1000.0));
+}
+
+int main(int argc, char **argv){
+	std::string model_file;
+	int threads = 0, iters = 3, grid = 0;
+	bool scaling = false;
+	for (int i = 1; i < argc; ++i){
+		const std::string arg = argv[i];
+		if (arg == "-h" || arg == "--help"){
+			std::cout << "Usage: ./obj_load_bench <model.obj> [--threads N] [--iters N] [--scaling]\n"
+				<< "\t[--synthetic N]\n"
+				<< "Times loading the model with the parallel OBJ loader, reporting the fastest of\n"
+				<< "--iters runs. --synthetic writes an N x N grid model to the model file first.\n"
+				<< "--scaling reports the load time from 1 thread up to --threads (default all)\n";
+			return 0;
+		}
+		if (arg == "--scaling"){
+			scaling = true;
+			continue;
+		}
+		if (arg.compare(0, 2, "--") != 0){
+			model_file = arg;
+			continue;
+		}
+		if (i + 1 >= argc){
+			std::cout << "Missing value for argument " << arg << "\n";
+			return 1;
+		}
+		if (arg == "--threads"){
+			threads = std::stoi(argv[++i]);
+		}
+		else if (arg == "--iters"){
+			iters = std::max(std::stoi(argv[++i]), 1);
+		}
+		else if (arg == "--synthetic"){
+			grid = std::max(std::stoi(argv[++i]), 1);
+		}
+		else {
+			std::cout << "Unrecognized argument " << arg << "\n";
+			return 1;
+		}
+	}
+	if (model_file.empty()){
+		std::cout << "A model file is required, see --help\n";
+		return 1;
+	}
+	if (grid > 0 && !write_synthetic_obj(model_file, grid)){
+		return 1;
+	}
+	const int max_threads = threads > 0 ? threads : std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+
+	ObjModel model;
+	ObjLoadStats stats;
+	if (!time_load(model_file, max_threads, iters, model, stats)){
+		return 1;
+	}
+	std::printf("%s: %.1fMB in %zu chunks, %zu vertices, %zu triangles, %zu groups, %zu materials\n",
+			model_file.c_str(), stats.file_bytes / (1024.0 * 1024.0), stats.chunks,
+			model.vertices.size() / OBJ_VERTEX_FLOATS, model.indices.size() / 3, model.groups.size(),
+			model.materials.size());
+	if (!scaling){
+		print_stats(max_threads, stats);
+		return 0;
+	}
+	double single_thread = 0;
+	for (int t = 1; t <= max_threads; t = t == max_threads ? t + 1 : std::min(t * 2, max_threads)){
+		if (!time_load(model_file, t, iters, model, stats)){
+			return 1;
+		}
+		single_thread = t == 1 ? stats.total : single_thread;
+		print_stats(t, stats);
+		std::printf("\tspeedup %.2fx, efficiency %.0f%%\n", single_thread / stats.total,
+				100.0 * single_thread / (stats.total * t));
+	}
+	return 0;
+}
+
@@ -0,0 +1,595 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include "mapped_file.h"
+#include "thread_pool.h"
+#include "obj_loader.h"
+
+// Chunks are at least this large so small files aren't split into tiny pieces
+const size_t OBJ_MIN_CHUNK_BYTES = 1 << 20;
+// How many chunks we aim to give each thread, so uneven chunks still balance out
+const size_t OBJ_CHUNKS_PER_THREAD = 4;
+
+namespace {
+
+// A corner of a triangle, the 0-based position, texcoord and normal indices. Missing
+// texcoords and normals are -1
+struct Corner {
+	int32_t v, vt, vn;
+};
+
+// A relative (negative) index in a chunk is stored relative to the chunk's first element,
+// these are fixed up once we know how many elements came before the chunk
+enum RELATIVE_MASK { RELATIVE_V = 1, RELATIVE_VT = 2, RELATIVE_VN = 4 };
+struct RelativeCorner {
+	size_t corner;
+	uint8_t mask;
+};
+
+// A g, o or usemtl statement before the corner at its position in the chunk
+struct StateChange {
+	size_t corner;
+	bool material;
+	std::string name;
+};
+
+struct ParsedChunk {
+	std::vector<float> positions, normals, texcoords;
+	std::vector<Corner> corners;
+	std::vector<RelativeCorner> relative;
+	std::vector<StateChange> changes;
+	std::vector<std::string> mtllibs;
+	std::string error;
+};
+
+// A run of corners in a chunk which belong to the same group
+struct GroupRun {
+	int group;
+	size_t chunk, begin, end;
+	// Where the run goes in the index data
+	size_t offset;
+};
+
+// Exact powers of ten representable in a double, for parsing floats
+const double POW10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+bool is_space(char c){
+	return c == ' ' || c == '\t' || c == '\r';
+}
+const char* skip_space(const char *p, const char *end){
+	while (p != end && is_space(*p)){
+		++p;
+	}
+	return p;
+}
+bool is_digit(char c){
+	return c >= '0' && c <= '9';
+}
+// Parse a float, which is much faster than strtof and doesn't depend on the locale
+bool parse_float(const char *&p, const char *end, float &out){
+	const char *s = p;
+	bool negative = false;
+	if (s != end && (*s == '-' || *s == '+')){
+		negative = *s == '-';
+		++s;
+	}
+	uint64_t mantissa = 0;
+	int exponent = 0, digits = 0;
+	for (; s != end && is_digit(*s); ++s, ++digits){
+		if (mantissa < 1000000000000000000ull){
+			mantissa = mantissa * 10 + (*s - '0');
+		}
+		else {
+			++exponent;
+		}
+	}
+	if (s != end && *s == '.'){
+		++s;
+		for (; s != end && is_digit(*s); ++s, ++digits){
+			if (mantissa < 1000000000000000000ull){
+				mantissa = mantissa * 10 + (*s - '0');
+				--exponent;
+			}
+		}
+	}
+	if (digits == 0){
+		return false;
+	}
+	if (s != end && (*s == 'e' || *s == 'E')){
+		const char *e = s + 1;
+		bool exp_negative = false;
+		if (e != end && (*e == '-' || *e == '+')){
+			exp_negative = *e == '-';
+			++e;
+		}
+		if (e != end && is_digit(*e)){
+			int exp_val = 0;
+			for (; e != end && is_digit(*e); ++e){
+				exp_val = std::min(exp_val * 10 + (*e - '0'), 1000);
+			}
+			exponent += exp_negative ? -exp_val : exp_val;
+			s = e;
+		}
+	}
+	double val = static_cast<double>(mantissa);
+	if (exponent < 0){
+		val = exponent >= -22 ? val / POW10[-exponent] : val * std::pow(10.0, exponent);
+	}
+	else if (exponent > 0){
+		val = exponent <= 22 ? val * POW10[exponent] : val * std::pow(10.0, exponent);
+	}
+	out = static_cast<float>(negative ? -val : val);
+	p = s;
+	return true;
+}
+bool parse_int(const char *&p, const char *end, int32_t &out){
+	const char *s = p;
+	bool negative = false;
+	if (s != end && (*s == '-' || *s == '+')){
+		negative = *s == '-';
+		++s;
+	}
+	if (s == end || !is_digit(*s)){
+		return false;
+	}
+	int64_t val = 0;
+	for (; s != end && is_digit(*s); ++s){
+		val = std::min<int64_t>(val * 10 + (*s - '0'), INT32_MAX);
+	}
+	out = static_cast<int32_t>(negative ? -val : val);
+	p = s;
+	return true;
+}
+// Parse up to n floats of the record into out, the ones missing are 0
+bool parse_floats(const char *p, const char *end, int n, int required, std::vector<float> &out){
+	for (int i = 0; i < n; ++i){
+		float f = 0.f;
+		p = skip_space(p, end);
+		if (!parse_float(p, end, f) && i < required){
+			return false;
+		}
+		out.push_back(f);
+	}
+	return true;
+}
+// Get the rest of the line after the keyword, with trailing whitespace removed
+std::string line_args(const char *p, const char *end){
+	p = skip_space(p, end);
+	while (end != p && is_space(end[-1])){
+		--end;
+	}
+	return std::string(p, end);
+}
+
+// Convert the 1-based or relative OBJ index to a 0-based one, relative indices are made
+// relative to the chunk's first element. Returns false for the invalid index 0
+bool resolve_index(int32_t idx, size_t count, int32_t &out, bool &relative){
+	if (idx > 0){
+		out = idx - 1;
+		relative = false;
+		return true;
+	}
+	if (idx < 0){
+		out = static_cast<int32_t>(count) + idx;
+		relative = true;
+		return true;
+	}
+	return false;
+}
+// Parse a corner of a face: v, v/vt, v//vn or v/vt/vn
+bool parse_corner(const char *&p, const char *end, const ParsedChunk &chunk, Corner &c, uint8_t &mask){
+	int32_t idx;
+	bool relative;
+	c.vt = -1;
+	c.vn = -1;
+	mask = 0;
+	if (!parse_int(p, end, idx) || !resolve_index(idx, chunk.positions.size() / 3, c.v, relative)){
+		return false;
+	}
+	mask |= relative ? RELATIVE_V : 0;
+	if (p != end && *p == '/'){
+		++p;
+		if (p != end && *p != '/'){
+			if (!parse_int(p, end, idx) || !resolve_index(idx, chunk.texcoords.size() / 2, c.vt, relative)){
+				return false;
+			}
+			mask |= relative ? RELATIVE_VT : 0;
+		}
+		if (p != end && *p == '/'){
+			++p;
+			if (!parse_int(p, end, idx) || !resolve_index(idx, chunk.normals.size() / 3, c.vn, relative)){
+				return false;
+			}
+			mask |= relative ? RELATIVE_VN : 0;
+		}
+	}
+	return p == end || is_space(*p);
+}
+bool keyword(const char *p, const char *end, const char *kw, size_t len){
+	return static_cast<size_t>(end - p) > len && std::memcmp(p, kw, len) == 0 && is_space(p[len]);
+}
+
+void parse_chunk(const char *begin, const char *end, ParsedChunk &chunk){
+	// Rough guesses for the number of each record to avoid most of the reallocations
+	const size_t bytes = end - begin;
+	chunk.positions.reserve(bytes / 40 * 3);
+	chunk.corners.reserve(bytes / 20 * 3);
+	std::vector<Corner> face;
+	std::vector<uint8_t> face_mask;
+	for (const char *line = begin; line < end;){
+		const char *line_end = static_cast<const char*>(std::memchr(line, '\n', end - line));
+		line_end = line_end ? line_end : end;
+		const char *p = skip_space(line, line_end);
+		const char *next = line_end + 1;
+		bool ok = true;
+		if (p == line_end || *p == '#'){
+			// Blank line or comment
+		}
+		else if (keyword(p, line_end, "v", 1)){
+			ok = parse_floats(p + 1, line_end, 3, 3, chunk.positions);
+		}
+		else if (keyword(p, line_end, "vn", 2)){
+			ok = parse_floats(p + 2, line_end, 3, 3, chunk.normals);
+		}
+		else if (keyword(p, line_end, "vt", 2)){
+			ok = parse_floats(p + 2, line_end, 2, 1, chunk.texcoords);
+		}
+		else if (keyword(p, line_end, "f", 1)){
+			face.clear();
+			face_mask.clear();
+			for (p = skip_space(p + 1, line_end); ok && p != line_end; p = skip_space(p, line_end)){
+				Corner c;
+				uint8_t mask;
+				ok = parse_corner(p, line_end, chunk, c, mask);
+				face.push_back(c);
+				face_mask.push_back(mask);
+			}
+			ok = ok && face.size() >= 3;
+			// Triangulate the polygon as a fan around its first corner
+			for (size_t i = 1; ok && i + 1 < face.size(); ++i){
+				const size_t tri[3] = {0, i, i + 1};
+				for (size_t j = 0; j < 3; ++j){
+					if (face_mask[tri[j]]){
+						chunk.relative.push_back(RelativeCorner{chunk.corners.size(), face_mask[tri[j]]});
+					}
+					chunk.corners.push_back(face[tri[j]]);
+				}
+			}
+		}
+		else if (keyword(p, line_end, "g", 1) || keyword(p, line_end, "o", 1)){
+			chunk.changes.push_back(StateChange{chunk.corners.size(), false, line_args(p + 1, line_end)});
+		}
+		else if (keyword(p, line_end, "usemtl", 6)){
+			chunk.changes.push_back(StateChange{chunk.corners.size(), true, line_args(p + 6, line_end)});
+		}
+		else if (keyword(p, line_end, "mtllib", 6)){
+			chunk.mtllibs.push_back(line_args(p + 6, line_end));
+		}
+		if (!ok){
+			chunk.error = "Invalid record '" + line_args(line, line_end) + "'";
+			return;
+		}
+		line = next;
+	}
+}
+
+// Parse the texture name from the arguments of a map_* statement, which is the last argument after any
+// options, and prefix it with the directory of the MTL file
+std::string texture_name(const std::string &dir, const std::string &args){
+	const size_t name_start = args.find_last_of(" \t");
+	return dir + (name_start == std::string::npos ? args : args.substr(name_start + 1));
+}
+bool load_mtl(const std::string &file, std::vector<ObjMaterial> &materials){
+	std::ifstream fin{file};
+	if (!fin){
+		std::cout << "Failed to open MTL file " << file << "\n";
+		return false;
+	}
+	const size_t dir_end = file.find_last_of("/\\");
+	const std::string dir = dir_end == std::string::npos ? "" : file.substr(0, dir_end + 1);
+	std::string line;
+	ObjMaterial *mat = nullptr;
+	while (std::getline(fin, line)){
+		const char *p = skip_space(line.data(), line.data() + line.size());
+		const char *end = line.data() + line.size();
+		if (keyword(p, end, "newmtl", 6)){
+			materials.push_back(ObjMaterial{line_args(p + 6, end), {0, 0, 0}, {0.8f, 0.8f, 0.8f}, {0, 0, 0}, 0,
+					"", "", "", "", ""});
+			mat = &materials.back();
+			continue;
+		}
+		if (!mat){
+			continue;
+		}
+		std::vector<float> vals;
+		if (keyword(p, end, "Ka", 2) && parse_floats(p + 2, end, 3, 3, vals)){
+			std::copy(vals.begin(), vals.end(), mat->ka);
+		}
+		else if (keyword(p, end, "Kd", 2) && parse_floats(p + 2, end, 3, 3, vals)){
+			std::copy(vals.begin(), vals.end(), mat->kd);
+		}
+		else if (keyword(p, end, "Ks", 2) && parse_floats(p + 2, end, 3, 3, vals)){
+			std::copy(vals.begin(), vals.end(), mat->ks);
+		}
+		else if (keyword(p, end, "Ns", 2) && parse_floats(p + 2, end, 1, 1, vals)){
+			mat->ns = vals[0];
+		}
+		else if (keyword(p, end, "map_Ka", 6)){
+			mat->map_ka = texture_name(dir, line_args(p + 6, end));
+		}
+		else if (keyword(p, end, "map_Kd", 6)){
+			mat->map_kd = texture_name(dir, line_args(p + 6, end));
+		}
+		else if (keyword(p, end, "map_Ks", 6)){
+			mat->map_ks = texture_name(dir, line_args(p + 6, end));
+		}
+		else if (keyword(p, end, "map_bump", 8)){
+			mat->map_bump = texture_name(dir, line_args(p + 8, end));
+		}
+		else if (keyword(p, end, "bump", 4)){
+			mat->map_bump = texture_name(dir, line_args(p + 4, end));
+		}
+		else if (keyword(p, end, "map_d", 5)){
+			mat->map_d = texture_name(dir, line_args(p + 5, end));
+		}
+	}
+	return true;
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+bool load_obj_parallel(const std::string &file, ObjModel &model, int threads, ObjLoadStats *stats){
+	const auto start = std::chrono::steady_clock::now();
+	MappedFile mapped;
+	if (!mapped.open(file)){
+		std::cout << "Failed to open OBJ file " << file << "\n";
+		return false;
+	}
+	WorkStealingPool pool{threads};
+
+	// Split the file into line aligned chunks
+	const char *data = mapped.data();
+	const size_t size = mapped.size();
+	const size_t chunk_bytes = std::max(size / (pool.size() * OBJ_CHUNKS_PER_THREAD), OBJ_MIN_CHUNK_BYTES);
+	std::vector<const char*> bounds{data};
+	while (bounds.back() != data + size){
+		const char *b = bounds.back() + std::min(chunk_bytes, static_cast<size_t>(data + size - bounds.back()));
+		const char *nl = b == data + size ? nullptr : static_cast<const char*>(std::memchr(b, '\n', data + size - b));
+		bounds.push_back(nl ? nl + 1 : data + size);
+	}
+	const size_t n_chunks = bounds.size() - 1;
+	std::vector<ParsedChunk> chunks(n_chunks);
+	pool.parallel_for(n_chunks, [&](int, int i){
+		parse_chunk(bounds[i], bounds[i + 1], chunks[i]);
+	});
+	for (const auto &c : chunks){
+		if (!c.error.empty()){
+			std::cout << "Error parsing " << file << ": " << c.error << "\n";
+			return false;
+		}
+	}
+	const double parse_time = elapsed_ms(start);
+
+	// Load the materials, these are tiny compared to the OBJ
+	const auto merge_start = std::chrono::steady_clock::now();
+	model = ObjModel{};
+	const size_t dir_end = file.find_last_of("/\\");
+	const std::string dir = dir_end == std::string::npos ? "" : file.substr(0, dir_end + 1);
+	for (const auto &c : chunks){
+		for (const auto &mtl : c.mtllibs){
+			load_mtl(dir + mtl, model.materials);
+		}
+	}
+	std::map<std::string, int> material_ids;
+	for (size_t i = 0; i < model.materials.size(); ++i){
+		material_ids.insert(std::make_pair(model.materials[i].name, static_cast<int>(i)));
+	}
+
+	// Find where each chunk's elements start in the merged arrays
+	std::vector<size_t> pos_base(n_chunks + 1, 0), normal_base(n_chunks + 1, 0), uv_base(n_chunks + 1, 0);
+	for (size_t i = 0; i < n_chunks; ++i){
+		pos_base[i + 1] = pos_base[i] + chunks[i].positions.size() / 3;
+		normal_base[i + 1] = normal_base[i] + chunks[i].normals.size() / 3;
+		uv_base[i + 1] = uv_base[i] + chunks[i].texcoords.size() / 2;
+	}
+	std::vector<float> positions(pos_base.back() * 3), normals(normal_base.back() * 3), texcoords(uv_base.back() * 2);
+	std::atomic<bool> index_error{false};
+	pool.parallel_for(n_chunks, [&](int, int i){
+		ParsedChunk &c = chunks[i];
+		std::copy(c.positions.begin(), c.positions.end(), positions.begin() + pos_base[i] * 3);
+		std::copy(c.normals.begin(), c.normals.end(), normals.begin() + normal_base[i] * 3);
+		std::copy(c.texcoords.begin(), c.texcoords.end(), texcoords.begin() + uv_base[i] * 2);
+		std::vector<float>().swap(c.positions);
+		std::vector<float>().swap(c.normals);
+		std::vector<float>().swap(c.texcoords);
+		for (const auto &r : c.relative){
+			Corner &corner = c.corners[r.corner];
+			corner.v += r.mask & RELATIVE_V ? static_cast<int32_t>(pos_base[i]) : 0;
+			corner.vt += r.mask & RELATIVE_VT ? static_cast<int32_t>(uv_base[i]) : 0;
+			corner.vn += r.mask & RELATIVE_VN ? static_cast<int32_t>(normal_base[i]) : 0;
+			if (corner.v < 0 || ((r.mask & RELATIVE_VT) && corner.vt < 0) || ((r.mask & RELATIVE_VN) && corner.vn < 0)){
+				index_error = true;
+			}
+		}
+	});
+
+	// Walk the group and material changes in order to split the corners into runs for each group
+	std::vector<GroupRun> runs;
+	std::map<std::pair<std::string, std::string>, int> group_ids;
+	std::map<std::string, int> group_names;
+	std::string cur_group = "default", cur_material;
+	int cur_id = -1;
+	for (size_t i = 0; i < n_chunks; ++i){
+		const ParsedChunk &c = chunks[i];
+		size_t begin = 0;
+		for (size_t s = 0; s <= c.changes.size(); ++s){
+			const size_t end = s < c.changes.size() ? c.changes[s].corner : c.corners.size();
+			if (end > begin){
+				if (cur_id == -1){
+					const auto key = std::make_pair(cur_group, cur_material);
+					auto fnd = group_ids.find(key);
+					if (fnd == group_ids.end()){
+						ObjGroup g;
+						// The first material used by a group name keeps the name as is
+						g.name = group_names[cur_group]++ == 0 ? cur_group : cur_group + "/" + cur_material;
+						auto mat = material_ids.find(cur_material);
+						g.mat_id = mat != material_ids.end() ? mat->second : -1;
+						g.index_offset = g.indices = g.vert_offset = 0;
+						fnd = group_ids.insert(std::make_pair(key, static_cast<int>(model.groups.size()))).first;
+						model.groups.push_back(g);
+					}
+					cur_id = fnd->second;
+				}
+				runs.push_back(GroupRun{cur_id, i, begin, end, 0});
+				model.groups[cur_id].indices += end - begin;
+			}
+			if (s < c.changes.size()){
+				(c.changes[s].material ? cur_material : cur_group) = c.changes[s].name;
+				cur_id = -1;
+			}
+			begin = end;
+		}
+	}
+	size_t n_indices = 0;
+	for (auto &g : model.groups){
+		g.index_offset = n_indices;
+		n_indices += g.indices;
+	}
+	std::vector<size_t> group_fill(model.groups.size());
+	for (size_t i = 0; i < model.groups.size(); ++i){
+		group_fill[i] = model.groups[i].index_offset;
+	}
+	for (auto &r : runs){
+		r.offset = group_fill[r.group];
+		group_fill[r.group] += r.end - r.begin;
+	}
+	// Gather the corners of each group together
+	std::vector<Corner> corners(n_indices);
+	pool.parallel_for(runs.size(), [&](int, int i){
+		const GroupRun &r = runs[i];
+		std::copy(chunks[r.chunk].corners.begin() + r.begin, chunks[r.chunk].corners.begin() + r.end,
+				corners.begin() + r.offset);
+	});
+	chunks.clear();
+	const double merge_time = elapsed_ms(merge_start);
+
+	// De-duplicate the vertices within each group. Each vertex is stored as the corner it was
+	// first seen at, vertices missing normals accumulate the normals of their faces
+	const auto dedupe_start = std::chrono::steady_clock::now();
+	const int32_t n_positions = static_cast<int32_t>(pos_base.back());
+	const int32_t n_uvs = static_cast<int32_t>(uv_base.back());
+	const int32_t n_normals = static_cast<int32_t>(normal_base.back());
+	std::vector<std::vector<Corner>> group_verts(model.groups.size());
+	std::vector<std::vector<float>> group_normals(model.groups.size());
+	model.indices.resize(n_indices);
+	pool.parallel_for(model.groups.size(), [&](int, int g){
+		const ObjGroup &group = model.groups[g];
+		std::vector<Corner> &verts = group_verts[g];
+		std::vector<float> &face_normals = group_normals[g];
+		// Open addressing table of vertex indices, sized to a power of two at most half full
+		size_t table_size = 16;
+		while (table_size < 2 * group.indices){
+			table_size *= 2;
+		}
+		std::vector<int32_t> table(table_size, -1);
+		for (size_t i = group.index_offset; i < group.index_offset + group.indices; ++i){
+			const Corner &c = corners[i];
+			if (c.v < 0 || c.v >= n_positions || c.vt >= n_uvs || c.vn >= n_normals){
+				index_error = true;
+				model.indices[i] = 0;
+				continue;
+			}
+			uint64_t h = (static_cast<uint64_t>(c.v) * 0x9E3779B97F4A7C15ull)
+				^ (static_cast<uint64_t>(c.vt + 1) * 0xC2B2AE3D27D4EB4Full)
+				^ (static_cast<uint64_t>(c.vn + 1) * 0x165667B19E3779F9ull);
+			size_t slot = (h ^ (h >> 29)) & (table_size - 1);
+			while (table[slot] != -1){
+				const Corner &o = verts[table[slot]];
+				if (o.v == c.v && o.vt == c.vt && o.vn == c.vn){
+					break;
+				}
+				slot = (slot + 1) & (table_size - 1);
+			}
+			if (table[slot] == -1){
+				table[slot] = static_cast<int32_t>(verts.size());
+				verts.push_back(c);
+			}
+			model.indices[i] = table[slot];
+		}
+		// Accumulate area weighted face normals for the vertices without one
+		for (size_t i = group.index_offset; i + 2 < group.index_offset + group.indices; i += 3){
+			const uint32_t tri[3] = {model.indices[i], model.indices[i + 1], model.indices[i + 2]};
+			if (verts[tri[0]].vn >= 0 && verts[tri[1]].vn >= 0 && verts[tri[2]].vn >= 0){
+				continue;
+			}
+			if (face_normals.empty()){
+				face_normals.resize(verts.size() * 3, 0.f);
+			}
+			const float *p[3];
+			for (int j = 0; j < 3; ++j){
+				p[j] = &positions[3 * verts[tri[j]].v];
+			}
+			const float e1[3] = {p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2]};
+			const float e2[3] = {p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2]};
+			const float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2],
+				e1[0] * e2[1] - e1[1] * e2[0]};
+			for (int j = 0; j < 3; ++j){
+				for (int k = 0; k < 3; ++k){
+					face_normals[3 * tri[j] + k] += n[k];
+				}
+			}
+		}
+	});
+	if (index_error){
+		std::cout << "Error loading " << file << ": a face references a vertex that doesn't exist\n";
+		return false;
+	}
+
+	// Lay the groups' vertices out one after the other and fill in the interleaved data
+	size_t n_verts = 0;
+	for (size_t g = 0; g < model.groups.size(); ++g){
+		model.groups[g].vert_offset = n_verts;
+		n_verts += group_verts[g].size();
+	}
+	model.vertices.resize(n_verts * OBJ_VERTEX_FLOATS);
+	pool.parallel_for(model.groups.size(), [&](int, int g){
+		float *out = model.vertices.data() + model.groups[g].vert_offset * OBJ_VERTEX_FLOATS;
+		const std::vector<float> &face_normals = group_normals[g];
+		for (size_t i = 0; i < group_verts[g].size(); ++i, out += OBJ_VERTEX_FLOATS){
+			const Corner &c = group_verts[g][i];
+			std::copy(&positions[3 * c.v], &positions[3 * c.v] + 3, out);
+			if (c.vn >= 0){
+				std::copy(&normals[3 * c.vn], &normals[3 * c.vn] + 3, out + 3);
+			}
+			else {
+				const float *n = &face_normals[3 * i];
+				const float len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				for (int k = 0; k < 3; ++k){
+					out[3 + k] = len > 0.f ? n[k] / len : (k == 1 ? 1.f : 0.f);
+				}
+			}
+			out[6] = c.vt >= 0 ? texcoords[2 * c.vt] : 0.f;
+			out[7] = c.vt >= 0 ? texcoords[2 * c.vt + 1] : 0.f;
+		}
+	});
+	if (stats){
+		stats->parse = parse_time;
+		stats->merge = merge_time;
+		stats->dedupe = elapsed_ms(dedupe_start);
+		stats->total = elapsed_ms(start);
+		stats->file_bytes = size;
+		stats->chunks = n_chunks;
+	}
+	return true;
+}
+
@@ -0,0 +1,57 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Floats per vertex in the interleaved vertex data: position, normal and texcoord
+const int OBJ_VERTEX_FLOATS = 8;
+
+// A material read from the model's MTL files, texture paths include the MTL file's directory
+struct ObjMaterial {
+	std::string name;
+	float ka[3], kd[3], ks[3];
+	float ns;
+	std::string map_ka, map_kd, map_ks, map_bump, map_d;
+};
+
+// A group of faces drawn with one material, indexed like glt::ModelMatInfo
+struct ObjGroup {
+	std::string name;
+	// The index into the model's materials, -1 if the faces have no material
+	int mat_id;
+	// Offset of the group's first index and the number of indices in the index data
+	size_t index_offset, indices;
+	// The group's first vertex, the indices are relative to it
+	size_t vert_offset;
+};
+
+// The triangulated model with vertices de-duplicated within each group
+struct ObjModel {
+	// Interleaved position, normal and texcoord of each vertex
+	std::vector<float> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<ObjGroup> groups;
+	std::vector<ObjMaterial> materials;
+};
+
+// Time spent in each stage of loading the model, in milliseconds
+struct ObjLoadStats {
+	double parse, merge, dedupe, total;
+	size_t file_bytes, chunks;
+};
+
+/*
+ * Load an OBJ model and its MTL files in parallel on the number of threads passed, or one
+ * per hardware thread if threads is 0. The file is memory mapped and split into line aligned
+ * chunks which are parsed independently, the faces are then sorted into their groups and
+ * vertices de-duplicated per group in parallel. Faces are triangulated as fans, vertices
+ * without a normal get the area weighted normal of the faces sharing them in the group.
+ * A group is started by g, o or usemtl, groups reusing a name with a different material are
+ * suffixed by "/material". Returns false and prints the error if the model couldn't be loaded
+ */
+bool load_obj_parallel(const std::string &file, ObjModel &model, int threads = 0, ObjLoadStats *stats = nullptr);
+
+#endif
+
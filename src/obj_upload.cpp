@@ -0,0 +1,55 @@
+#include <algorithm>
+#include <cstring>
+#include "obj_upload.h"
+
+// Upload the data to a newly allocated sub-buffer through a mapping of it
+template<typename T>
+static glt::SubBuffer upload(glt::BufferAllocator &allocator, GLenum target, const std::vector<T> &data,
+		size_t alignment)
+{
+	glt::SubBuffer buf = allocator.alloc(data.size() * sizeof(T), alignment);
+	void *dst = buf.map(target, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+	std::memcpy(dst, data.data(), data.size() * sizeof(T));
+	buf.unmap(target);
+	return buf;
+}
+
+std::vector<GpuMaterial> obj_gpu_materials(const ObjModel &model){
+	std::vector<GpuMaterial> materials;
+	for (const auto &m : model.materials){
+		GpuMaterial gm;
+		std::copy(m.ka, m.ka + 3, gm.ka);
+		std::copy(m.kd, m.kd + 3, gm.kd);
+		std::copy(m.ks, m.ks + 3, gm.ks);
+		gm.ka[3] = 1.f;
+		gm.kd[3] = 1.f;
+		gm.ks[3] = m.ns;
+		std::fill(gm.map_ka_kd, gm.map_ka_kd + 4, -1);
+		std::fill(gm.map_ks_n, gm.map_ks_n + 4, -1);
+		std::fill(gm.map_mask, gm.map_mask + 4, -1);
+		materials.push_back(gm);
+	}
+	materials.push_back(GpuMaterial{{0.1f, 0.1f, 0.1f, 1.f}, {0.8f, 0.8f, 0.8f, 1.f}, {0.f, 0.f, 0.f, 0.f},
+			{-1, -1, -1, -1}, {-1, -1, -1, -1}, {-1, -1, -1, -1}});
+	return materials;
+}
+void upload_obj_model(const ObjModel &model, glt::BufferAllocator &allocator, glt::SubBuffer &vert_buf,
+		glt::SubBuffer &elem_buf, glt::SubBuffer &mat_buf,
+		std::unordered_map<std::string, glt::ModelMatInfo> &model_info)
+{
+	const std::vector<GpuMaterial> materials = obj_gpu_materials(model);
+	const int default_mat = materials.size() - 1;
+
+	GLint ssbo_alignment = 0;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &ssbo_alignment);
+	vert_buf = upload(allocator, GL_ARRAY_BUFFER, model.vertices, sizeof(float));
+	elem_buf = upload(allocator, GL_ELEMENT_ARRAY_BUFFER, model.indices, sizeof(uint32_t));
+	mat_buf = upload(allocator, GL_SHADER_STORAGE_BUFFER, materials, std::max(ssbo_alignment, 1));
+
+	model_info.clear();
+	for (const auto &g : model.groups){
+		model_info[g.name] = glt::ModelMatInfo(g.indices, g.index_offset, g.vert_offset,
+				g.mat_id >= 0 ? g.mat_id : default_mat);
+	}
+}
+
@@ -0,0 +1,36 @@
+#ifndef OBJ_UPLOAD_H
+#define OBJ_UPLOAD_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "glt/gl_core_4_5.h"
+#include "glt/buffer_allocator.h"
+#include "glt/load_models.h"
+#include "obj_loader.h"
+
+// A material as laid out in the Materials SSBO in global.glsl. The map_* members hold the
+// texture array and layer of each map, -1 if the material doesn't have it
+struct GpuMaterial {
+	float ka[4], kd[4], ks[4];
+	int32_t map_ka_kd[4], map_ks_n[4], map_mask[4];
+};
+
+/*
+ * Build the GPU materials for the model's materials, untextured, followed by the default
+ * material used by groups without one
+ */
+std::vector<GpuMaterial> obj_gpu_materials(const ObjModel &model);
+/*
+ * Upload the vertices, indices and materials of a model loaded by load_obj_parallel to
+ * sub-buffers from the allocator and fill out the model info for each group, like
+ * glt::load_model_with_mats. The materials are uploaded untextured. Groups without a
+ * material use a default one appended after the model's materials
+ */
+void upload_obj_model(const ObjModel &model, glt::BufferAllocator &allocator, glt::SubBuffer &vert_buf,
+		glt::SubBuffer &elem_buf, glt::SubBuffer &mat_buf,
+		std::unordered_map<std::string, glt::ModelMatInfo> &model_info);
+
+#endif
+
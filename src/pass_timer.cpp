@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include "pass_timer.h"
+
+PassStats compute_pass_stats(std::vector<double> samples){
+	PassStats stats{0, 0, 0, 0, samples.size()};
+	if (samples.empty()){
+		return stats;
+	}
+	std::sort(samples.begin(), samples.end());
+	stats.min = samples.front();
+	stats.median = samples[samples.size() / 2];
+	if (samples.size() % 2 == 0){
+		stats.median = (stats.median + samples[samples.size() / 2 - 1]) / 2.0;
+	}
+	// Nearest-rank percentile
+	size_t p99_rank = static_cast<size_t>(std::ceil(0.99 * samples.size()));
+	stats.p99 = samples[std::max(p99_rank, size_t{1}) - 1];
+	for (const auto &s : samples){
+		stats.mean += s;
+	}
+	stats.mean /= samples.size();
+	return stats;
+}
+
+PassHistory::PassHistory(size_t capacity) : capacity(capacity), next(0) {
+	ring.reserve(capacity);
+}
+void PassHistory::push(float ms){
+	if (ring.size() < capacity){
+		ring.push_back(ms);
+	}
+	else {
+		ring[next] = ms;
+	}
+	next = (next + 1) % capacity;
+}
+PassStats PassHistory::stats() const {
+	return compute_pass_stats(std::vector<double>(ring.begin(), ring.end()));
+}
+const std::vector<float>& PassHistory::samples() const {
+	return ring;
+}
+size_t PassHistory::offset() const {
+	return ring.size() < capacity ? 0 : next;
+}
+
+PassTimer::PassTimer(const std::vector<std::string> &pass_names, size_t frames_in_flight, size_t history)
+	: pass_names(pass_names), queries(pass_names.size() * frames_in_flight, 0),
+	timestamp_queries(queries.size(), 0), issued(queries.size(), false), slot_frames(frames_in_flight, 0),
+	cpu_begin(pass_names.size()), cpu_open(pass_names.size(), false), pass_samples(pass_names.size()),
+	cpu_samples(pass_names.size()), gpu_history(pass_names.size(), PassHistory{history}),
+	cpu_history(pass_names.size(), PassHistory{history}), frames_in_flight(frames_in_flight), frame(0),
+	pending(0), enabled(true), keep_samples(true), last_gpu_frame_ms(0), tracing(false), trace_first_frame(0), trace_gpu_start(0)
+{
+	glGenQueries(queries.size(), queries.data());
+	glGenQueries(timestamp_queries.size(), timestamp_queries.data());
+}
+PassTimer::~PassTimer(){
+	glDeleteQueries(queries.size(), queries.data());
+	glDeleteQueries(timestamp_queries.size(), timestamp_queries.data());
+}
+void PassTimer::begin(size_t pass, bool gpu){
+	if (!enabled){
+		return;
+	}
+	cpu_open[pass] = true;
+	cpu_begin[pass] = Clock::now();
+	if (gpu){
+		const size_t q = (frame % frames_in_flight) * pass_names.size() + pass;
+		glQueryCounter(timestamp_queries[q], GL_TIMESTAMP);
+		glBeginQuery(GL_TIME_ELAPSED, queries[q]);
+		issued[q] = true;
+	}
+}
+void PassTimer::end(size_t pass){
+	if (!enabled || !cpu_open[pass]){
+		return;
+	}
+	const size_t q = (frame % frames_in_flight) * pass_names.size() + pass;
+	if (issued[q]){
+		glEndQuery(GL_TIME_ELAPSED);
+	}
+	const double ms = std::chrono::duration<double, std::milli>(Clock::now() - cpu_begin[pass]).count();
+	cpu_history[pass].push(ms);
+	if (keep_samples){
+		cpu_samples[pass].push_back(ms);
+	}
+	if (tracing){
+		trace.push_back(TraceEvent{pass, frame, false,
+				std::chrono::duration<double, std::micro>(cpu_begin[pass] - trace_start).count(), ms * 1e3});
+	}
+	cpu_open[pass] = false;
+}
+void PassTimer::end_frame(){
+	slot_frames[frame % frames_in_flight] = frame;
+	++frame;
+	pending = std::min(pending + 1, frames_in_flight);
+	// If the next frame's slot in the ring is still holding results read them back
+	// before it gets re-used. By now the GPU should be done with it
+	if (pending == frames_in_flight){
+		collect(frame % frames_in_flight);
+		--pending;
+	}
+}
+void PassTimer::flush(){
+	for (; pending > 0; --pending){
+		collect((frame - pending) % frames_in_flight);
+	}
+}
+void PassTimer::set_enabled(bool e){
+	enabled = e;
+}
+bool PassTimer::is_enabled() const {
+	return enabled;
+}
+void PassTimer::set_keep_samples(bool keep){
+	keep_samples = keep;
+}
+size_t PassTimer::num_passes() const {
+	return pass_names.size();
+}
+const std::string& PassTimer::name(size_t pass) const {
+	return pass_names[pass];
+}
+const std::vector<double>& PassTimer::samples(size_t pass) const {
+	return pass_samples[pass];
+}
+const std::vector<double>& PassTimer::cpu_times(size_t pass) const {
+	return cpu_samples[pass];
+}
+const PassHistory& PassTimer::gpu_recent(size_t pass) const {
+	return gpu_history[pass];
+}
+const PassHistory& PassTimer::cpu_recent(size_t pass) const {
+	return cpu_history[pass];
+}
+double PassTimer::last_frame_gpu_ms() const {
+	return last_gpu_frame_ms;
+}
+bool PassTimer::write_stats(const std::string &file) const {
+	std::ofstream fout{file};
+	if (!fout){
+		std::cout << "PassTimer: failed to open " << file << " for writing\n";
+		return false;
+	}
+	const bool csv = file.size() > 4 && file.substr(file.size() - 4) == ".csv";
+	if (csv){
+		fout << "pass,count,min_ms,median_ms,p99_ms,mean_ms,cpu_median_ms,cpu_p99_ms,cpu_mean_ms\n";
+	}
+	else {
+		fout << "{\n\t\"units\": \"ms\",\n\t\"passes\": [\n";
+	}
+	for (size_t i = 0; i < pass_names.size(); ++i){
+		const PassStats stats = compute_pass_stats(pass_samples[i]);
+		const PassStats cpu = compute_pass_stats(cpu_samples[i]);
+		if (csv){
+			fout << pass_names[i] << "," << stats.count << "," << stats.min << ","
+				<< stats.median << "," << stats.p99 << "," << stats.mean << ","
+				<< cpu.median << "," << cpu.p99 << "," << cpu.mean << "\n";
+		}
+		else {
+			fout << "\t\t{\"name\": \"" << pass_names[i] << "\", \"count\": " << stats.count
+				<< ", \"min\": " << stats.min << ", \"median\": " << stats.median
+				<< ", \"p99\": " << stats.p99 << ", \"mean\": " << stats.mean
+				<< ", \"cpu\": {\"median\": " << cpu.median << ", \"p99\": " << cpu.p99
+				<< ", \"mean\": " << cpu.mean << "}}"
+				<< (i + 1 < pass_names.size() ? ",\n" : "\n");
+		}
+	}
+	if (!csv){
+		fout << "\t]\n}\n";
+	}
+	return true;
+}
+void PassTimer::start_trace(){
+	trace.clear();
+	tracing = true;
+	trace_first_frame = frame;
+	glGetInteger64v(GL_TIMESTAMP, &trace_gpu_start);
+	trace_start = Clock::now();
+}
+bool PassTimer::is_tracing() const {
+	return tracing;
+}
+size_t PassTimer::trace_frames() const {
+	return tracing ? frame - trace_first_frame : 0;
+}
+bool PassTimer::write_trace(const std::string &file){
+	flush();
+	tracing = false;
+	std::ofstream fout{file};
+	if (!fout){
+		std::cout << "PassTimer: failed to open " << file << " for writing\n";
+		return false;
+	}
+	std::sort(trace.begin(), trace.end(), [](const TraceEvent &a, const TraceEvent &b){
+		return a.gpu != b.gpu ? b.gpu : a.start < b.start;
+	});
+	fout << std::fixed << std::setprecision(3)
+		<< "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n"
+		<< "\t{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": 0, \"args\": {\"name\": \"CPU\"}},\n"
+		<< "\t{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": 1, \"args\": {\"name\": \"GPU\"}}";
+	for (const auto &e : trace){
+		fout << ",\n\t{\"name\": \"" << pass_names[e.pass] << "\", \"cat\": \"" << (e.gpu ? "gpu" : "cpu")
+			<< "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << (e.gpu ? 1 : 0) << ", \"ts\": " << e.start
+			<< ", \"dur\": " << e.duration << ", \"args\": {\"frame\": " << e.frame - trace_first_frame << "}}";
+	}
+	fout << "\n]}\n";
+	return static_cast<bool>(fout);
+}
+void PassTimer::collect(size_t f){
+	double frame_ms = 0;
+	for (size_t i = 0; i < pass_names.size(); ++i){
+		const size_t q = f * pass_names.size() + i;
+		if (!issued[q]){
+			continue;
+		}
+		// This will block if the GPU is somehow still not done with the frame
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(queries[q], GL_QUERY_RESULT, &elapsed);
+		const double ms = elapsed * 1e-6;
+		frame_ms += ms;
+		gpu_history[i].push(ms);
+		if (keep_samples){
+			pass_samples[i].push_back(ms);
+		}
+		if (tracing && slot_frames[f] >= trace_first_frame){
+			GLuint64 start = 0;
+			glGetQueryObjectui64v(timestamp_queries[q], GL_QUERY_RESULT, &start);
+			trace.push_back(TraceEvent{i, slot_frames[f], true,
+					(static_cast<GLint64>(start) - trace_gpu_start) * 1e-3, elapsed * 1e-3});
+		}
+		issued[q] = false;
+	}
+	if (frame_ms > 0){
+		last_gpu_frame_ms = frame_ms;
+	}
+}
+
@@ -0,0 +1,157 @@
+#ifndef PASS_TIMER_H
+#define PASS_TIMER_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include "glt/gl_core_4_5.h"
+
+// Summary statistics for the times recorded for a pass, in milliseconds
+struct PassStats {
+	double min, median, p99, mean;
+	size_t count;
+};
+
+/*
+ * Compute the min/median/p99/mean of the samples passed
+ */
+PassStats compute_pass_stats(std::vector<double> samples);
+
+/*
+ * The most recent times recorded for a pass in a fixed size ring, for the profiler
+ * overlay's graphs and percentiles
+ */
+class PassHistory {
+	std::vector<float> ring;
+	size_t capacity;
+	// Where the next sample goes, which is the oldest sample once the ring is full
+	size_t next;
+
+public:
+	PassHistory(size_t capacity);
+	void push(float ms);
+	PassStats stats() const;
+	// The samples in the ring, oldest first starting from offset() and wrapping around
+	const std::vector<float>& samples() const;
+	size_t offset() const;
+};
+
+/*
+ * A pass timed on the CPU or GPU in a Chrome trace, with times in microseconds.
+ * GPU events are placed on the CPU's clock
+ */
+struct TraceEvent {
+	size_t pass, frame;
+	bool gpu;
+	double start, duration;
+};
+
+/*
+ * Times each pass of the render loop on the GPU using GL_TIME_ELAPSED queries and
+ * on the CPU with timestamps taken when the pass begins and ends. The queries are
+ * kept in a ring a few frames deep so that reading back the results of an old frame
+ * won't stall waiting on the frames still in flight. Since GL_TIME_ELAPSED queries
+ * can't be nested only one pass can be timed on the GPU at a time, passes timed only
+ * on the CPU can nest freely. Each pass also issues a GL_TIMESTAMP query when it begins
+ * so the GPU passes can be placed on a timeline when capturing a trace
+ */
+class PassTimer {
+	using Clock = std::chrono::steady_clock;
+
+	std::vector<std::string> pass_names;
+	// Queries for each pass in each frame of the ring, indexed [frame * passes + pass]
+	std::vector<GLuint> queries, timestamp_queries;
+	// Track which queries were actually issued in each frame, since some
+	// passes (e.g. the blur) may be skipped
+	std::vector<bool> issued;
+	// The frame number each slot of the ring was issued in
+	std::vector<size_t> slot_frames;
+	// When each pass began on the CPU, if it's currently open
+	std::vector<Clock::time_point> cpu_begin;
+	std::vector<bool> cpu_open;
+	std::vector<std::vector<double>> pass_samples, cpu_samples;
+	std::vector<PassHistory> gpu_history, cpu_history;
+	size_t frames_in_flight, frame, pending;
+	bool enabled, keep_samples;
+	// The summed GPU time of the passes in the most recently collected frame
+	double last_gpu_frame_ms;
+	// The trace being captured, the GPU and CPU clocks were read together at trace_start
+	// to line up their timestamps
+	std::vector<TraceEvent> trace;
+	bool tracing;
+	size_t trace_first_frame;
+	Clock::time_point trace_start;
+	GLint64 trace_gpu_start;
+
+public:
+	PassTimer(const std::vector<std::string> &pass_names, size_t frames_in_flight = 3, size_t history = 240);
+	~PassTimer();
+	PassTimer(const PassTimer&) = delete;
+	PassTimer& operator=(const PassTimer&) = delete;
+	/*
+	 * Start/stop timing the pass, must be matched. If gpu is false the pass is only
+	 * timed on the CPU, e.g. for the buffer swap, otherwise it can't be nested with other
+	 * GPU timed passes
+	 */
+	void begin(size_t pass, bool gpu = true);
+	void end(size_t pass);
+	/*
+	 * Mark the end of the frame, collecting the results of the oldest frame in
+	 * the ring if it's now going to be re-used
+	 */
+	void end_frame();
+	/*
+	 * Wait on and collect the results of any frames still in flight
+	 */
+	void flush();
+	/*
+	 * Enable/disable recording of new timings, begin/end do nothing while disabled
+	 */
+	void set_enabled(bool e);
+	bool is_enabled() const;
+	/*
+	 * Set if every sample should be kept for samples() and write_stats, e.g. over a
+	 * benchmark run. Otherwise only the rolling history is kept
+	 */
+	void set_keep_samples(bool keep);
+	size_t num_passes() const;
+	const std::string& name(size_t pass) const;
+	// Get the recorded GPU or CPU times for the pass in milliseconds
+	const std::vector<double>& samples(size_t pass) const;
+	const std::vector<double>& cpu_times(size_t pass) const;
+	// Get the rolling history of recent GPU or CPU times for the pass
+	const PassHistory& gpu_recent(size_t pass) const;
+	const PassHistory& cpu_recent(size_t pass) const;
+	/*
+	 * Get the total GPU time of the passes timed in the most recently collected frame,
+	 * which is frames_in_flight frames behind the current one. Returns 0 if no frame
+	 * has been collected yet
+	 */
+	double last_frame_gpu_ms() const;
+	/*
+	 * Write the min/median/p99 timings for each pass to the file, the format
+	 * is picked from the extension, .csv for CSV and JSON otherwise
+	 */
+	bool write_stats(const std::string &file) const;
+	/*
+	 * Start capturing the passes of the following frames into a trace, replacing any
+	 * previous trace
+	 */
+	void start_trace();
+	void stop_trace();
+	bool is_tracing() const;
+	// The number of frames in the trace so far
+	size_t trace_frames() const;
+	/*
+	 * Write the captured trace in the Chrome trace event format, viewable in
+	 * chrome://tracing or Perfetto, with the CPU and GPU passes on separate tracks.
+	 * Collects the frames still in flight first
+	 */
+	bool write_trace(const std::string &file);
+
+private:
+	void collect(size_t f);
+};
+
+#endif
+
@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include "png_image.h"
+
+// Largest block deflate can store uncompressed
+const size_t DEFLATE_MAX_STORED = 65535;
+
+static const std::array<uint32_t, 256> CRC_TABLE = [](){
+	std::array<uint32_t, 256> table;
+	for (uint32_t i = 0; i < 256; ++i){
+		uint32_t c = i;
+		for (int k = 0; k < 8; ++k){
+			c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+		}
+		table[i] = c;
+	}
+	return table;
+}();
+
+static void push_u32(std::vector<uint8_t> &out, uint32_t x){
+	out.push_back(x >> 24);
+	out.push_back((x >> 16) & 0xff);
+	out.push_back((x >> 8) & 0xff);
+	out.push_back(x & 0xff);
+}
+// Write a chunk, its length, type, data and the CRC of the type and data
+static void write_chunk(std::ofstream &fout, const char *type, const std::vector<uint8_t> &data){
+	std::vector<uint8_t> header;
+	push_u32(header, data.size());
+	header.insert(header.end(), type, type + 4);
+	uint32_t crc = 0xffffffffu;
+	for (size_t i = 4; i < header.size(); ++i){
+		crc = CRC_TABLE[(crc ^ header[i]) & 0xff] ^ (crc >> 8);
+	}
+	for (const uint8_t b : data){
+		crc = CRC_TABLE[(crc ^ b) & 0xff] ^ (crc >> 8);
+	}
+	std::vector<uint8_t> footer;
+	push_u32(footer, crc ^ 0xffffffffu);
+	fout.write(reinterpret_cast<const char*>(header.data()), header.size());
+	fout.write(reinterpret_cast<const char*>(data.data()), data.size());
+	fout.write(reinterpret_cast<const char*>(footer.data()), footer.size());
+}
+bool save_png(const std::string &file, int width, int height, int channels, const uint8_t *data){
+	static const uint8_t color_types[5] = {0, 0, 0, 2, 6};
+	if (channels != 1 && channels != 3 && channels != 4){
+		std::cout << "Can't save a " << channels << " channel image as a PNG\n";
+		return false;
+	}
+	std::ofstream fout{file, std::ios::binary};
+	if (!fout){
+		std::cout << "Failed to open " << file << " for writing\n";
+		return false;
+	}
+	const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+	fout.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+	std::vector<uint8_t> ihdr;
+	push_u32(ihdr, width);
+	push_u32(ihdr, height);
+	// 8 bits per channel, deflate, the standard filters and no interlacing
+	ihdr.insert(ihdr.end(), {8, color_types[channels], 0, 0, 0});
+	write_chunk(fout, "IHDR", ihdr);
+
+	// Each row starts with its filter type, we don't filter since nothing's compressed
+	const size_t row_bytes = static_cast<size_t>(width) * channels;
+	const size_t raw_bytes = (row_bytes + 1) * height;
+	std::vector<uint8_t> raw;
+	raw.reserve(raw_bytes);
+	for (int y = 0; y < height; ++y){
+		raw.push_back(0);
+		raw.insert(raw.end(), data + y * row_bytes, data + (y + 1) * row_bytes);
+	}
+	// A zlib stream of stored deflate blocks followed by the Adler-32 of the raw data
+	std::vector<uint8_t> idat;
+	idat.reserve(raw_bytes + 5 * (raw_bytes / DEFLATE_MAX_STORED + 1) + 6);
+	idat.push_back(0x78);
+	idat.push_back(0x01);
+	for (size_t i = 0; i < raw_bytes || i == 0; i += DEFLATE_MAX_STORED){
+		const size_t len = std::min(raw_bytes - i, DEFLATE_MAX_STORED);
+		idat.push_back(i + len == raw_bytes ? 1 : 0);
+		idat.push_back(len & 0xff);
+		idat.push_back(len >> 8);
+		idat.push_back(~len & 0xff);
+		idat.push_back((~len >> 8) & 0xff);
+		idat.insert(idat.end(), raw.begin() + i, raw.begin() + i + len);
+	}
+	// The sums can go 5552 bytes before overflowing so only take the modulus once per run
+	uint32_t a = 1, b = 0;
+	for (size_t i = 0; i < raw.size(); i += 5552){
+		const size_t end = std::min(i + 5552, raw.size());
+		for (size_t j = i; j < end; ++j){
+			a += raw[j];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+	}
+	push_u32(idat, (b << 16) | a);
+	write_chunk(fout, "IDAT", idat);
+	write_chunk(fout, "IEND", {});
+	return static_cast<bool>(fout);
+}
+
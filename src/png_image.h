@@ -0,0 +1,16 @@
+#ifndef PNG_IMAGE_H
+#define PNG_IMAGE_H
+
+#include <cstdint>
+#include <string>
+
+/*
+ * Save an 8 bit image as a PNG, with 1 (gray), 3 (RGB) or 4 (RGBA) interleaved channels
+ * and its rows from top to bottom. The image data is stored without compression so
+ * frames can be written as fast as they're rendered, the files are about the size of
+ * the raw pixels
+ */
+bool save_png(const std::string &file, int width, int height, int channels, const uint8_t *data);
+
+#endif
+
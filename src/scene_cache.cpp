@@ -0,0 +1,375 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <sys/stat.h>
+#include "mapped_file.h"
+#include "scene_cache.h"
+
+// Bump when the layout of the file changes so old caches are rebuilt
+const uint32_t SCENE_CACHE_VERSION = 2;
+const char SCENE_CACHE_MAGIC[8] = {'S', 'S', 'A', 'O', 'S', 'C', 'N', '\0'};
+
+// Size recorded for a dependency which didn't exist when the cache was built, e.g. a missing
+// texture the loader put a placeholder in for, so the cache is rebuilt once it's added
+const uint64_t MISSING_DEPENDENCY = ~0ull;
+
+// A file the cache was built from and the size and modification time it had
+struct SceneDependency {
+	std::string file;
+	uint64_t size;
+	int64_t mtime;
+};
+
+// The client formats we read back and upload the texture arrays with
+struct TexelFormat {
+	GLenum internal_format, format, type;
+	uint32_t bytes;
+};
+const TexelFormat TEXEL_FORMATS[] = {
+	{GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4},
+	{GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE, 4},
+	{GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE, 3},
+	{GL_SRGB8, GL_RGB, GL_UNSIGNED_BYTE, 3},
+	{GL_RG8, GL_RG, GL_UNSIGNED_BYTE, 2},
+	{GL_R8, GL_RED, GL_UNSIGNED_BYTE, 1}
+};
+
+// Get the format for the internal format, any we don't know are read back as RGBA8
+static TexelFormat texel_format(GLenum internal_format){
+	for (const auto &f : TEXEL_FORMATS){
+		if (f.internal_format == internal_format){
+			return f;
+		}
+	}
+	return TEXEL_FORMATS[0];
+}
+static bool stat_file(const std::string &file, uint64_t &size, int64_t &mtime){
+	struct stat st;
+	if (stat(file.c_str(), &st) != 0){
+		return false;
+	}
+	size = static_cast<uint64_t>(st.st_size);
+	mtime = static_cast<int64_t>(st.st_mtime);
+	return true;
+}
+static std::string directory_of(const std::string &file){
+	const size_t dir_end = file.find_last_of("/\\");
+	return dir_end == std::string::npos ? "" : file.substr(0, dir_end + 1);
+}
+// Get the arguments following the keyword if the line starts with it
+static bool line_keyword(const std::string &line, const std::string &keyword, std::string &args){
+	const size_t start = line.find_first_not_of(" \t");
+	if (start == std::string::npos || line.compare(start, keyword.size(), keyword) != 0){
+		return false;
+	}
+	const size_t arg_start = line.find_first_not_of(" \t", start + keyword.size());
+	if (arg_start == std::string::npos || arg_start == start + keyword.size()){
+		return false;
+	}
+	const size_t arg_end = line.find_last_not_of(" \t\r");
+	args = line.substr(arg_start, arg_end - arg_start + 1);
+	return true;
+}
+// Find the MTL files referenced by the OBJ and the textures they reference
+static std::vector<std::string> find_dependencies(const std::string &model_file){
+	std::vector<std::string> deps{model_file};
+	std::vector<std::string> mtls;
+	const std::string model_dir = directory_of(model_file);
+	std::ifstream fin{model_file};
+	std::string line, args;
+	while (std::getline(fin, line)){
+		if (line_keyword(line, "mtllib", args)){
+			mtls.push_back(model_dir + args);
+		}
+	}
+	const std::string map_keywords[] = {"map_Ka", "map_Kd", "map_Ks", "map_Ns", "map_d", "map_bump", "bump", "disp"};
+	for (const auto &mtl : mtls){
+		deps.push_back(mtl);
+		const std::string mtl_dir = directory_of(mtl);
+		std::ifstream mtl_in{mtl};
+		while (std::getline(mtl_in, line)){
+			for (const auto &k : map_keywords){
+				if (line_keyword(line, k, args)){
+					// The texture file is the last argument, after any options
+					const size_t name_start = args.find_last_of(" \t");
+					deps.push_back(mtl_dir + (name_start == std::string::npos ? args : args.substr(name_start + 1)));
+					break;
+				}
+			}
+		}
+	}
+	std::sort(deps.begin() + 1, deps.end());
+	deps.erase(std::unique(deps.begin() + 1, deps.end()), deps.end());
+	return deps;
+}
+
+template<typename T>
+static void write_pod(std::ostream &os, const T &t){
+	os.write(reinterpret_cast<const char*>(&t), sizeof(T));
+}
+static void write_string(std::ostream &os, const std::string &s){
+	write_pod(os, static_cast<uint32_t>(s.size()));
+	os.write(s.data(), s.size());
+}
+// Read back the contents of the sub-buffer and write them prefixed by their size
+static void write_sub_buffer(std::ostream &os, const glt::SubBuffer &buf){
+	std::vector<char> data(buf.size);
+	glBindBuffer(GL_COPY_READ_BUFFER, buf.buffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, buf.offset, buf.size, data.data());
+	write_pod(os, static_cast<uint64_t>(buf.size));
+	os.write(data.data(), data.size());
+}
+
+std::string scene_cache_path(const std::string &model_file){
+	const size_t ext = model_file.find_last_of('.');
+	const size_t dir_end = model_file.find_last_of("/\\");
+	if (ext == std::string::npos || (dir_end != std::string::npos && ext < dir_end)){
+		return model_file + ".scache";
+	}
+	return model_file.substr(0, ext) + ".scache";
+}
+bool save_scene_cache(const std::string &cache_file, const std::string &model_file,
+		const glt::SubBuffer &vert_buf, const glt::SubBuffer &elem_buf, const glt::SubBuffer &mat_buf,
+		const glt::OBJTextures &textures, const std::unordered_map<std::string, glt::ModelMatInfo> &model_info)
+{
+	std::vector<SceneDependency> deps;
+	for (const auto &f : find_dependencies(model_file)){
+		SceneDependency d{f, 0, 0};
+		if (!stat_file(f, d.size, d.mtime)){
+			std::cout << "Scene cache: failed to stat " << f << ", the cache will be rebuilt once it exists\n";
+			d.size = MISSING_DEPENDENCY;
+			d.mtime = -1;
+		}
+		deps.push_back(d);
+	}
+
+	std::ofstream fout{cache_file, std::ios::binary};
+	if (!fout){
+		std::cout << "Failed to open " << cache_file << " for writing\n";
+		return false;
+	}
+	fout.write(SCENE_CACHE_MAGIC, sizeof(SCENE_CACHE_MAGIC));
+	write_pod(fout, SCENE_CACHE_VERSION);
+	write_pod(fout, static_cast<uint32_t>(deps.size()));
+	for (const auto &d : deps){
+		write_string(fout, d.file);
+		write_pod(fout, d.size);
+		write_pod(fout, d.mtime);
+	}
+
+	write_pod(fout, static_cast<uint32_t>(model_info.size()));
+	for (const auto &m : model_info){
+		write_string(fout, m.first);
+		write_pod(fout, static_cast<uint64_t>(m.second.indices));
+		write_pod(fout, static_cast<uint64_t>(m.second.index_offset));
+		write_pod(fout, static_cast<uint64_t>(m.second.vert_offset));
+		write_pod(fout, static_cast<int32_t>(m.second.mat_id));
+	}
+	write_sub_buffer(fout, vert_buf);
+	write_sub_buffer(fout, elem_buf);
+	write_sub_buffer(fout, mat_buf);
+
+	write_pod(fout, static_cast<uint32_t>(textures.textures.size()));
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	std::vector<char> texels;
+	for (const auto &tex : textures.textures){
+		glBindTexture(GL_TEXTURE_2D_ARRAY, tex);
+		GLint internal_format = 0, width = 0, height = 0, layers = 0, levels = 0;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, 0, GL_TEXTURE_INTERNAL_FORMAT, &internal_format);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, 0, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, 0, GL_TEXTURE_HEIGHT, &height);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, 0, GL_TEXTURE_DEPTH, &layers);
+		glGetTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_IMMUTABLE_LEVELS, &levels);
+		if (levels == 0){
+			// Mutable textures may not have a full mip chain, count the levels actually there
+			const GLint max_dim = std::max(width, height);
+			GLint w = width;
+			while (w > 0 && (max_dim >> levels) > 0){
+				++levels;
+				w = 0;
+				glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, levels, GL_TEXTURE_WIDTH, &w);
+			}
+		}
+		const TexelFormat fmt = texel_format(internal_format);
+		write_pod(fout, static_cast<uint32_t>(fmt.internal_format));
+		write_pod(fout, static_cast<uint32_t>(width));
+		write_pod(fout, static_cast<uint32_t>(height));
+		write_pod(fout, static_cast<uint32_t>(layers));
+		write_pod(fout, static_cast<uint32_t>(levels));
+		for (int l = 0; l < levels; ++l){
+			const uint64_t bytes = static_cast<uint64_t>(std::max(width >> l, 1)) * std::max(height >> l, 1)
+				* layers * fmt.bytes;
+			texels.resize(bytes);
+			glGetTexImage(GL_TEXTURE_2D_ARRAY, l, fmt.format, fmt.type, texels.data());
+			write_pod(fout, bytes);
+			fout.write(texels.data(), bytes);
+		}
+	}
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	if (!fout){
+		std::cout << "Failed writing scene cache " << cache_file << "\n";
+		return false;
+	}
+	return true;
+}
+
+// Bounds checked reads from the mapped cache file
+struct CacheReader {
+	const char *ptr, *end;
+
+	template<typename T>
+	bool read(T &t){
+		if (static_cast<size_t>(end - ptr) < sizeof(T)){
+			return false;
+		}
+		std::memcpy(&t, ptr, sizeof(T));
+		ptr += sizeof(T);
+		return true;
+	}
+	// Get a pointer to the next n bytes in the file and skip over them
+	bool read_bytes(uint64_t n, const char *&data){
+		if (static_cast<uint64_t>(end - ptr) < n){
+			return false;
+		}
+		data = ptr;
+		ptr += n;
+		return true;
+	}
+	bool read_string(std::string &s){
+		uint32_t len;
+		const char *data;
+		if (!read(len) || !read_bytes(len, data)){
+			return false;
+		}
+		s.assign(data, len);
+		return true;
+	}
+	// Read a block of data prefixed by its size
+	bool read_block(uint64_t &size, const char *&data){
+		return read(size) && read_bytes(size, data);
+	}
+};
+
+// A texture array level in the mapped cache file
+struct CachedTexture {
+	TexelFormat format;
+	uint32_t width, height, layers;
+	std::vector<const char*> levels;
+};
+
+// Upload the data to a newly allocated sub-buffer through a mapping of it. Mapping binds
+// the buffer to the target, which leaves the vertex and element buffers bound like glt does
+static glt::SubBuffer upload_sub_buffer(glt::BufferAllocator &allocator, GLenum target, const char *data,
+		uint64_t size, size_t alignment)
+{
+	glt::SubBuffer buf = allocator.alloc(size, alignment);
+	void *dst = buf.map(target, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+	std::memcpy(dst, data, size);
+	buf.unmap(target);
+	return buf;
+}
+
+bool load_scene_cache(const std::string &cache_file, glt::BufferAllocator &allocator, glt::SubBuffer &vert_buf,
+		glt::SubBuffer &elem_buf, glt::SubBuffer &mat_buf, glt::OBJTextures &textures,
+		std::unordered_map<std::string, glt::ModelMatInfo> &model_info)
+{
+	MappedFile file;
+	if (!file.open(cache_file)){
+		return false;
+	}
+	CacheReader reader{file.data(), file.data() + file.size()};
+	const char *magic;
+	uint32_t version, n_deps;
+	if (!reader.read_bytes(sizeof(SCENE_CACHE_MAGIC), magic)
+			|| std::memcmp(magic, SCENE_CACHE_MAGIC, sizeof(SCENE_CACHE_MAGIC)) != 0
+			|| !reader.read(version) || version != SCENE_CACHE_VERSION || !reader.read(n_deps))
+	{
+		std::cout << "Scene cache " << cache_file << " is invalid or from an older version, ignoring it\n";
+		return false;
+	}
+	for (uint32_t i = 0; i < n_deps; ++i){
+		SceneDependency d;
+		if (!reader.read_string(d.file) || !reader.read(d.size) || !reader.read(d.mtime)){
+			std::cout << "Scene cache " << cache_file << " is truncated\n";
+			return false;
+		}
+		uint64_t size;
+		int64_t mtime;
+		const bool exists = stat_file(d.file, size, mtime);
+		if (d.size == MISSING_DEPENDENCY ? exists : !exists || size != d.size || mtime != d.mtime){
+			std::cout << "Scene cache " << cache_file << " is out of date with " << d.file << ", ignoring it\n";
+			return false;
+		}
+	}
+
+	// Validate the rest of the file before we start creating any GL objects
+	uint32_t n_models;
+	std::unordered_map<std::string, glt::ModelMatInfo> info;
+	bool valid = reader.read(n_models);
+	for (uint32_t i = 0; valid && i < n_models; ++i){
+		std::string name;
+		uint64_t indices, index_offset, vert_offset;
+		int32_t mat_id;
+		valid = reader.read_string(name) && reader.read(indices) && reader.read(index_offset)
+			&& reader.read(vert_offset) && reader.read(mat_id);
+		info[name] = glt::ModelMatInfo(indices, index_offset, vert_offset, mat_id);
+	}
+	uint64_t vert_size = 0, elem_size = 0, mat_size = 0;
+	const char *vert_data = nullptr, *elem_data = nullptr, *mat_data = nullptr;
+	valid = valid && reader.read_block(vert_size, vert_data) && reader.read_block(elem_size, elem_data)
+		&& reader.read_block(mat_size, mat_data);
+
+	uint32_t n_textures = 0;
+	valid = valid && reader.read(n_textures);
+	std::vector<CachedTexture> cached_textures(valid ? n_textures : 0);
+	for (auto &t : cached_textures){
+		uint32_t internal_format, levels;
+		valid = reader.read(internal_format) && reader.read(t.width) && reader.read(t.height)
+			&& reader.read(t.layers) && reader.read(levels);
+		if (!valid){
+			break;
+		}
+		t.format = texel_format(internal_format);
+		for (uint32_t l = 0; valid && l < levels; ++l){
+			uint64_t bytes;
+			const char *data;
+			valid = reader.read_block(bytes, data) && bytes == static_cast<uint64_t>(std::max(t.width >> l, 1u))
+				* std::max(t.height >> l, 1u) * t.layers * t.format.bytes;
+			t.levels.push_back(data);
+		}
+	}
+	if (!valid){
+		std::cout << "Scene cache " << cache_file << " is truncated\n";
+		return false;
+	}
+
+	GLint ssbo_alignment = 0;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &ssbo_alignment);
+	vert_buf = upload_sub_buffer(allocator, GL_ARRAY_BUFFER, vert_data, vert_size, sizeof(float));
+	elem_buf = upload_sub_buffer(allocator, GL_ELEMENT_ARRAY_BUFFER, elem_data, elem_size, sizeof(GLuint));
+	mat_buf = upload_sub_buffer(allocator, GL_SHADER_STORAGE_BUFFER, mat_data, mat_size,
+			std::max(ssbo_alignment, 1));
+
+	textures.textures.resize(cached_textures.size());
+	glGenTextures(textures.textures.size(), textures.textures.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (size_t i = 0; i < cached_textures.size(); ++i){
+		const CachedTexture &t = cached_textures[i];
+		glBindTexture(GL_TEXTURE_2D_ARRAY, textures.textures[i]);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, t.levels.size(), t.format.internal_format, t.width, t.height, t.layers);
+		for (size_t l = 0; l < t.levels.size(); ++l){
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, 0, 0, 0, std::max(t.width >> l, 1u),
+					std::max(t.height >> l, 1u), t.layers, t.format.format, t.format.type, t.levels[l]);
+		}
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+				t.levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	model_info = std::move(info);
+	return true;
+}
+
@@ -0,0 +1,42 @@
+#ifndef SCENE_CACHE_H
+#define SCENE_CACHE_H
+
+#include <string>
+#include <unordered_map>
+#include "glt/gl_core_4_5.h"
+#include "glt/buffer_allocator.h"
+#include "glt/load_models.h"
+
+/*
+ * A binary cache of a scene loaded by glt::load_model_with_mats, holding the interleaved
+ * vertex and index data, the model info table, the material SSBO contents and the decoded
+ * texture arrays with their mip levels. Loading it skips parsing the OBJ/MTL files and
+ * decoding the textures. The OBJ, its MTL files and their textures are recorded with their
+ * size and modification time so a stale cache is ignored. Ones which were missing are
+ * recorded as such, so adding them later also makes the cache stale
+ */
+
+/*
+ * Get the path of the scene cache for the model file, the model's path with
+ * its extension replaced by .scache
+ */
+std::string scene_cache_path(const std::string &model_file);
+/*
+ * Write the scene loaded from the model file by glt::load_model_with_mats to the cache file,
+ * reading the buffers and textures back from GL
+ */
+bool save_scene_cache(const std::string &cache_file, const std::string &model_file,
+		const glt::SubBuffer &vert_buf, const glt::SubBuffer &elem_buf, const glt::SubBuffer &mat_buf,
+		const glt::OBJTextures &textures, const std::unordered_map<std::string, glt::ModelMatInfo> &model_info);
+/*
+ * Load the scene from the cache file, filling out the buffers, textures and model info like
+ * glt::load_model_with_mats would. The file is memory mapped and uploaded directly into the
+ * mapped sub-buffers and textures. Returns false without touching the outputs if the cache
+ * doesn't exist, is invalid or is older than the files it was built from
+ */
+bool load_scene_cache(const std::string &cache_file, glt::BufferAllocator &allocator, glt::SubBuffer &vert_buf,
+		glt::SubBuffer &elem_buf, glt::SubBuffer &mat_buf, glt::OBJTextures &textures,
+		std::unordered_map<std::string, glt::ModelMatInfo> &model_info);
+
+#endif
+
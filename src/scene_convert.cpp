@@ -0,0 +1,69 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include "glt/gl_core_4_5.h"
+#include "glt/buffer_allocator.h"
+#include "glt/load_models.h"
+#include "headless.h"
+#include "scene_cache.h"
+
+/*
+ * Convert an OBJ model and its materials and textures to the binary scene cache
+ * loaded by the renderer. Loading the model needs a GL context since glt uploads it
+ * as it's parsed, so we read it back from a headless context
+ */
+int main(int argc, char **argv){
+	if (argc < 2){
+		std::cout << "Usage: ./scene_convert <model.obj> [out.scache]\n"
+			<< "The output defaults to the model's path with a .scache extension, which the renderer"
+			<< " picks up automatically\n";
+		return 1;
+	}
+	const std::string model_file = argv[1];
+	const std::string cache_file = argc > 2 ? argv[2] : scene_cache_path(model_file);
+
+	HeadlessContext ctx;
+	if (!create_headless_context(ctx)){
+		return 1;
+	}
+	if (ogl_LoadFunctions() == ogl_LOAD_FAILED){
+		std::cout << "ogl load failed" << std::endl;
+		destroy_headless_context(ctx);
+		return 1;
+	}
+
+	int ret = 0;
+	{
+		GLuint vao;
+		glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+		glt::BufferAllocator allocator{static_cast<size_t>(128e6)};
+		glt::SubBuffer vert_buf, elem_buf, mat_buf;
+		std::unordered_map<std::string, glt::ModelMatInfo> model_info;
+		glt::OBJTextures textures;
+
+		const auto start = std::chrono::steady_clock::now();
+		if (!glt::load_model_with_mats(model_file, allocator, vert_buf, elem_buf, mat_buf, textures, model_info)){
+			std::cout << "Error loading model!\n";
+			ret = 1;
+		}
+		else {
+			const auto loaded = std::chrono::steady_clock::now();
+			if (save_scene_cache(cache_file, model_file, vert_buf, elem_buf, mat_buf, textures, model_info)){
+				std::cout << "Loaded " << model_file << " in "
+					<< std::chrono::duration<double, std::milli>(loaded - start).count() << "ms, wrote "
+					<< model_info.size() << " models and " << textures.textures.size() << " texture arrays to "
+					<< cache_file << "\n";
+			}
+			else {
+				ret = 1;
+			}
+		}
+		glDeleteTextures(textures.textures.size(), textures.textures.data());
+		glDeleteVertexArrays(1, &vao);
+	}
+	destroy_headless_context(ctx);
+	return ret;
+}
+
@@ -0,0 +1,444 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <tuple>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+#include "gl_caps.h"
+#include "shader_variants.h"
+
+// Not in the core header glLoadGen made for us, shared by the KHR and ARB extensions
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// Bump when the layout of the cached program files changes so old ones are rebuilt
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+const char PROGRAM_CACHE_MAGIC[8] = {'S', 'S', 'A', 'O', 'P', 'R', 'G', '\0'};
+
+// Set by setup_program_builds
+static std::string program_cache_dir;
+// The vendor, renderer and version strings which the cached programs are keyed on
+static std::string driver_id;
+static bool parallel_compile = false;
+
+// Read the shader source, expanding any #include "file" lines relative to its directory
+static bool read_shader_source(const std::string &file, std::string &source, int depth = 0){
+	if (depth > 8){
+		std::cout << "Too many nested includes reading shader " << file << "\n";
+		return false;
+	}
+	std::ifstream fin{file};
+	if (!fin){
+		std::cout << "Failed to open shader " << file << "\n";
+		return false;
+	}
+	const size_t dir_end = file.find_last_of("/\\");
+	const std::string dir = dir_end == std::string::npos ? "" : file.substr(0, dir_end + 1);
+	std::string line;
+	while (std::getline(fin, line)){
+		const size_t inc = line.find("#include");
+		if (inc != std::string::npos && line.find_first_not_of(" \t") == inc){
+			const size_t open = line.find('"', inc);
+			const size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+			if (close == std::string::npos){
+				std::cout << "Malformed include in shader " << file << ": " << line << "\n";
+				return false;
+			}
+			if (!read_shader_source(dir + line.substr(open + 1, close - open - 1), source, depth + 1)){
+				return false;
+			}
+		}
+		else {
+			source += line + "\n";
+		}
+	}
+	return true;
+}
+// Insert the defines after the #version line, which must come first in the shader
+static void insert_defines(std::string &source, const ShaderDefines &defines){
+	std::string define_src;
+	for (const auto &d : defines){
+		define_src += "#define " + d.first + " " + d.second + "\n";
+	}
+	size_t pos = source.find("#version");
+	pos = pos == std::string::npos ? 0 : source.find('\n', pos);
+	pos = pos == std::string::npos ? source.size() : pos + 1;
+	source.insert(pos, define_src);
+}
+// Hash the data into the running 64 bit FNV-1a hash
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t len){
+	const uint8_t *bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < len; ++i){
+		hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+	}
+	return hash;
+}
+template<typename T>
+static void write_pod(std::ostream &os, const T &t){
+	os.write(reinterpret_cast<const char*>(&t), sizeof(T));
+}
+template<typename T>
+static void read_pod(std::istream &is, T &t){
+	is.read(reinterpret_cast<char*>(&t), sizeof(T));
+}
+// Load the program from its cached binary, returns 0 if it's not cached or the driver rejects it
+static GLuint load_cached_program(const std::string &file, uint64_t key){
+	std::ifstream fin{file, std::ios::binary};
+	if (!fin){
+		return 0;
+	}
+	char magic[8];
+	uint32_t version = 0, format = 0, size = 0;
+	uint64_t file_key = 0;
+	fin.read(magic, sizeof(magic));
+	read_pod(fin, version);
+	read_pod(fin, file_key);
+	read_pod(fin, format);
+	read_pod(fin, size);
+	if (!fin || std::memcmp(magic, PROGRAM_CACHE_MAGIC, sizeof(magic)) != 0 || version != PROGRAM_CACHE_VERSION
+			|| file_key != key)
+	{
+		return 0;
+	}
+	std::vector<char> binary(size);
+	fin.read(binary.data(), size);
+	if (!fin){
+		return 0;
+	}
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, format, binary.data(), size);
+	// The driver can reject binaries from an older build of itself, we just compile it again then
+	GLint status;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (status == GL_FALSE){
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+static void save_cached_program(const std::string &file, uint64_t key, GLuint program){
+	GLint len = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &len);
+	if (len <= 0){
+		return;
+	}
+	std::vector<char> binary(len);
+	GLsizei size = 0;
+	GLenum format = 0;
+	glGetProgramBinary(program, len, &size, &format, binary.data());
+	// Write to a temporary file and move it over so another instance never reads half a binary
+	const std::string tmp_file = file + ".tmp";
+	{
+		std::ofstream fout{tmp_file, std::ios::binary};
+		fout.write(PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC));
+		write_pod(fout, PROGRAM_CACHE_VERSION);
+		write_pod(fout, key);
+		write_pod(fout, static_cast<uint32_t>(format));
+		write_pod(fout, static_cast<uint32_t>(size));
+		fout.write(binary.data(), size);
+		if (!fout){
+			std::cout << "Failed to write program binary " << tmp_file << "\n";
+			return;
+		}
+	}
+	if (std::rename(tmp_file.c_str(), file.c_str()) != 0){
+		std::remove(tmp_file.c_str());
+	}
+}
+static void delete_build_shaders(ProgramBuild &build){
+	for (const auto &s : build.shaders){
+		glDetachShader(build.program, s.second);
+		glDeleteShader(s.second);
+	}
+	build.shaders.clear();
+}
+void setup_program_builds(const std::string &cache_dir, MaxShaderCompilerThreadsFn max_compiler_threads){
+	driver_id.clear();
+	for (const GLenum s : {GL_VENDOR, GL_RENDERER, GL_VERSION}){
+		const char *str = reinterpret_cast<const char*>(glGetString(s));
+		driver_id += std::string{str ? str : ""} + "\n";
+	}
+	program_cache_dir.clear();
+	GLint num_formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+	if (!cache_dir.empty() && num_formats == 0){
+		std::cout << "The driver has no program binary formats, programs won't be cached\n";
+	}
+	else if (!cache_dir.empty()){
+		const std::string dir = cache_dir.back() == '/' || cache_dir.back() == '\\' ? cache_dir : cache_dir + "/";
+#ifdef _WIN32
+		const int err = _mkdir(dir.c_str());
+#else
+		const int err = mkdir(dir.c_str(), 0755);
+#endif
+		if (err != 0 && errno != EEXIST){
+			std::cout << "Failed to create the program cache directory " << dir << ", programs won't be cached\n";
+		}
+		else {
+			program_cache_dir = dir;
+		}
+	}
+	parallel_compile = gl_has_extension("GL_KHR_parallel_shader_compile")
+		|| gl_has_extension("GL_ARB_parallel_shader_compile");
+	if (parallel_compile && max_compiler_threads){
+		// Let the driver use as many threads as it wants
+		max_compiler_threads(0xffffffff);
+	}
+}
+bool parallel_shader_compile(){
+	return parallel_compile;
+}
+bool start_program_variant(const std::vector<std::pair<GLenum, std::string>> &shaders,
+		const ShaderDefines &defines, ProgramBuild &build)
+{
+	build = ProgramBuild{0, {}, "", 0};
+	// The expanded source covers the includes and defines, the driver string changes with driver
+	// updates, which may not be able to load the old binaries
+	uint64_t key = hash_bytes(0xcbf29ce484222325ull, driver_id.data(), driver_id.size());
+	std::vector<std::string> sources;
+	for (const auto &s : shaders){
+		std::string source;
+		if (!read_shader_source(s.second, source)){
+			return false;
+		}
+		insert_defines(source, defines);
+		key = hash_bytes(key, &s.first, sizeof(s.first));
+		key = hash_bytes(key, source.data(), source.size());
+		sources.push_back(std::move(source));
+	}
+	if (!program_cache_dir.empty()){
+		char name[32];
+		std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+		build.program = load_cached_program(program_cache_dir + name, key);
+		if (build.program != 0){
+			return true;
+		}
+		build.cache_file = program_cache_dir + name;
+		build.cache_key = key;
+	}
+
+	// Nothing is checked until the build is finished, so with parallel shader compilation
+	// none of this waits on the compiler
+	build.program = glCreateProgram();
+	for (size_t i = 0; i < shaders.size(); ++i){
+		GLuint shader = glCreateShader(shaders[i].first);
+		const char *src = sources[i].c_str();
+		glShaderSource(shader, 1, &src, nullptr);
+		glCompileShader(shader);
+		glAttachShader(build.program, shader);
+		build.shaders.push_back(std::make_pair(shaders[i].second, shader));
+	}
+	if (!build.cache_file.empty()){
+		glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	glLinkProgram(build.program);
+	return true;
+}
+bool program_variant_ready(const ProgramBuild &build){
+	if (!parallel_compile || build.shaders.empty()){
+		return true;
+	}
+	GLint done = GL_FALSE;
+	glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &done);
+	return done == GL_TRUE;
+}
+GLint finish_program_variant(ProgramBuild &build){
+	// Programs from the binary cache were checked when loaded
+	if (build.shaders.empty()){
+		return build.program;
+	}
+	GLint status;
+	glGetProgramiv(build.program, GL_LINK_STATUS, &status);
+	if (status == GL_FALSE){
+		// A shader failing to compile fails the link, so report the compile errors if there are any
+		bool compile_failed = false;
+		for (const auto &s : build.shaders){
+			glGetShaderiv(s.second, GL_COMPILE_STATUS, &status);
+			if (status == GL_FALSE){
+				GLint len;
+				glGetShaderiv(s.second, GL_INFO_LOG_LENGTH, &len);
+				std::vector<char> log(std::max(len, 1), '\0');
+				glGetShaderInfoLog(s.second, log.size(), nullptr, log.data());
+				std::cout << "Shader compilation error in " << s.first << ":\n" << log.data() << "\n";
+				compile_failed = true;
+			}
+		}
+		if (!compile_failed){
+			GLint len;
+			glGetProgramiv(build.program, GL_INFO_LOG_LENGTH, &len);
+			std::vector<char> log(std::max(len, 1), '\0');
+			glGetProgramInfoLog(build.program, log.size(), nullptr, log.data());
+			std::cout << "Program linking error:\n" << log.data() << "\n";
+		}
+		cancel_program_variant(build);
+		return -1;
+	}
+	delete_build_shaders(build);
+	if (!build.cache_file.empty()){
+		save_cached_program(build.cache_file, build.cache_key, build.program);
+	}
+	return build.program;
+}
+void cancel_program_variant(ProgramBuild &build){
+	delete_build_shaders(build);
+	if (build.program != 0){
+		glDeleteProgram(build.program);
+		build.program = 0;
+	}
+}
+GLint load_program_variant(const std::vector<std::pair<GLenum, std::string>> &shaders,
+		const ShaderDefines &defines)
+{
+	ProgramBuild build;
+	if (!start_program_variant(shaders, defines, build)){
+		return -1;
+	}
+	return finish_program_variant(build);
+}
+std::vector<GLint> load_programs(const std::vector<std::vector<std::pair<GLenum, std::string>>> &programs){
+	std::vector<ProgramBuild> builds(programs.size());
+	std::vector<bool> started(programs.size());
+	for (size_t i = 0; i < programs.size(); ++i){
+		started[i] = start_program_variant(programs[i], {}, builds[i]);
+	}
+	std::vector<GLint> loaded(programs.size(), -1);
+	for (size_t i = 0; i < programs.size(); ++i){
+		if (started[i]){
+			loaded[i] = finish_program_variant(builds[i]);
+		}
+	}
+	return loaded;
+}
+void fill_ao_sample_pattern(const AOParams &params, float *pattern){
+	const int n_samples = std::min(std::max(params.n_samples, 1), AO_MAX_SAMPLES);
+	const double TAU = 6.2831853071795864;
+	for (int i = 0; i < n_samples; ++i){
+		const float alpha = 1.f / n_samples * (i + 0.5f);
+		const double theta = TAU * alpha * params.turns;
+		pattern[4 * i] = static_cast<float>(std::cos(theta));
+		pattern[4 * i + 1] = static_cast<float>(std::sin(theta));
+		pattern[4 * i + 2] = alpha;
+		pattern[4 * i + 3] = 0.f;
+	}
+}
+
+bool AOShaderCache::Key::operator<(const Key &b) const {
+	return std::tie(rendered_normals, n_samples, adaptive, multi_scale, sample_heatmap)
+		< std::tie(b.rendered_normals, b.n_samples, b.adaptive, b.multi_scale, b.sample_heatmap);
+}
+AOShaderCache::AOShaderCache(const std::string &shader_path, bool octahedral_normals, int depth_unit,
+		int normals_unit, AO_SHADER_LAYOUT layout)
+	: shader_path(shader_path), octahedral_normals(octahedral_normals), layout(layout), depth_unit(depth_unit),
+	normals_unit(normals_unit)
+{}
+AOShaderCache::~AOShaderCache(){
+	for (const auto &v : variants){
+		if (v.second.program != 0){
+			glDeleteProgram(v.second.program);
+		}
+	}
+	for (auto &b : building){
+		cancel_program_variant(b.second);
+	}
+}
+const AOVariant* AOShaderCache::get(const AOParams &params, bool sample_heatmap, bool wait){
+	// Multi-scale AO picks its own sample counts so takes over from adaptive sampling
+	const Key key{params.use_rendered_normals != 0, std::min(std::max(params.n_samples, 1), AO_MAX_SAMPLES),
+		params.adaptive_samples != 0 && params.multi_scale == 0, params.multi_scale != 0, sample_heatmap};
+	auto fnd = variants.find(key);
+	if (fnd != variants.end()){
+		return fnd->second.program != 0 ? &fnd->second : nullptr;
+	}
+	auto build = building.find(key);
+	if (build != building.end()){
+		if (!wait && !program_variant_ready(build->second)){
+			return nullptr;
+		}
+		const AOVariant *variant = add_variant(key, build->second);
+		building.erase(build);
+		return variant;
+	}
+
+	ShaderDefines defines{
+		{"AO_MAX_SAMPLES", std::to_string(AO_MAX_SAMPLES)},
+		{"AO_N_SAMPLES", std::to_string(key.n_samples)},
+		{"AO_RENDERED_NORMALS", key.rendered_normals ? "1" : "0"},
+		{"AO_OCTAHEDRAL_NORMALS", octahedral_normals ? "1" : "0"},
+		{"AO_ADAPTIVE", key.adaptive ? "1" : "0"},
+		{"AO_MULTI_SCALE", key.multi_scale ? "1" : "0"},
+		{"AO_MAX_SCALES", std::to_string(AO_MAX_SCALES)},
+		{"AO_SAMPLE_HEATMAP", key.sample_heatmap ? "1" : "0"},
+		{"AO_DEINTERLEAVED", layout == AO_LAYOUT_DEINTERLEAVED ? "1" : "0"}
+	};
+	std::vector<std::pair<GLenum, std::string>> shaders;
+	if (layout == AO_LAYOUT_DEINTERLEAVED){
+		// Each layer is drawn on its own with its index in a uniform
+		defines.push_back(std::make_pair("LAYERED", "1"));
+		defines.push_back(std::make_pair("LAYER_UNIFORM", "1"));
+		shaders.push_back(std::make_pair(GL_VERTEX_SHADER, shader_path + "ao_sample_vert.glsl"));
+	}
+	else if (layout == AO_LAYOUT_LAYERED){
+		defines.push_back(std::make_pair("LAYERED", "1"));
+		shaders.push_back(std::make_pair(GL_VERTEX_SHADER, shader_path + "layered_quad_vert.glsl"));
+		shaders.push_back(std::make_pair(GL_GEOMETRY_SHADER, shader_path + "layered_quad_geom.glsl"));
+	}
+	else {
+		shaders.push_back(std::make_pair(GL_VERTEX_SHADER, shader_path + "ao_sample_vert.glsl"));
+	}
+	shaders.push_back(std::make_pair(GL_FRAGMENT_SHADER, shader_path + "ao_sample_frag.glsl"));
+	ProgramBuild new_build;
+	if (!start_program_variant(shaders, defines, new_build)){
+		std::cout << "Failed to compile AO shader variant with " << key.n_samples << " samples\n";
+		variants.insert(std::make_pair(key, AOVariant{0, -1, -1, -1, key.n_samples, key.sample_heatmap}));
+		return nullptr;
+	}
+	if (!wait && !program_variant_ready(new_build)){
+		building.insert(std::make_pair(key, new_build));
+		return nullptr;
+	}
+	return add_variant(key, new_build);
+}
+void AOShaderCache::poll(){
+	for (auto it = building.begin(); it != building.end();){
+		if (program_variant_ready(it->second)){
+			add_variant(it->first, it->second);
+			it = building.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+}
+size_t AOShaderCache::size() const {
+	return variants.size();
+}
+size_t AOShaderCache::num_building() const {
+	return building.size();
+}
+const AOVariant* AOShaderCache::add_variant(const Key &key, ProgramBuild &build){
+	const GLint program = finish_program_variant(build);
+	AOVariant variant{0, -1, -1, -1, key.n_samples, key.sample_heatmap};
+	if (program == -1){
+		std::cout << "Failed to compile AO shader variant with " << key.n_samples << " samples\n";
+	}
+	else {
+		variant.program = program;
+		variant.ao_level_unif = glGetUniformLocation(program, "ao_level");
+		variant.phi_offset_unif = glGetUniformLocation(program, "phi_offset");
+		variant.layer_unif = glGetUniformLocation(program, "layer");
+		glUseProgram(program);
+		glUniform1i(glGetUniformLocation(program, "camera_depth"), depth_unit);
+		glUniform1i(glGetUniformLocation(program, "camera_normals"), normals_unit);
+	}
+	auto it = variants.insert(std::make_pair(key, variant)).first;
+	return it->second.program != 0 ? &it->second : nullptr;
+}
+
@@ -0,0 +1,161 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "glt/gl_core_4_5.h"
+#include "ao_params.h"
+
+// The most samples the AO sample pattern table has room for, matching the UI's slider
+const int AO_MAX_SAMPLES = 64;
+
+// Name and value pairs to #define when compiling a shader variant
+typedef std::vector<std::pair<std::string, std::string>> ShaderDefines;
+// glMaxShaderCompilerThreadsKHR/ARB, which glLoadGen doesn't load for us
+typedef void (APIENTRY *MaxShaderCompilerThreadsFn)(GLuint count);
+
+/*
+ * Setup how programs are built on the current context. Linked programs are saved as binaries
+ * in the cache directory, keyed on their expanded source, defines and the driver, and loaded
+ * from it when built again. An empty directory disables the cache. If the context supports
+ * KHR/ARB_parallel_shader_compile the driver compiles on its own threads and programs can be
+ * built in the background, see start_program_variant. max_compiler_threads may be null
+ */
+void setup_program_builds(const std::string &cache_dir, MaxShaderCompilerThreadsFn max_compiler_threads);
+// Check if the driver compiles programs in the background
+bool parallel_shader_compile();
+
+// A program being built by start_program_variant
+struct ProgramBuild {
+	GLuint program;
+	// The shaders and their files, kept to report compile errors once the link is done.
+	// Empty if the program was loaded from the binary cache
+	std::vector<std::pair<std::string, GLuint>> shaders;
+	// Where to save the program's binary once it's linked, empty if it's not being cached
+	std::string cache_file;
+	uint64_t cache_key;
+};
+
+/*
+ * Start building a program from the shader files with the defines inserted after the #version
+ * line of each shader, loading it from the binary cache if it's there or otherwise issuing the
+ * compile and link without waiting on them. #include "file" is expanded relative to the
+ * including shader. Returns false and prints the error if a shader couldn't be read
+ */
+bool start_program_variant(const std::vector<std::pair<GLenum, std::string>> &shaders,
+		const ShaderDefines &defines, ProgramBuild &build);
+// Check if the program has been built, always true without parallel shader compilation
+bool program_variant_ready(const ProgramBuild &build);
+/*
+ * Wait for the program to be built and check it, saving its binary to the cache if it was
+ * compiled. Returns the program, or -1 and prints the log if compiling or linking failed
+ */
+GLint finish_program_variant(ProgramBuild &build);
+// Delete a program which is still being built
+void cancel_program_variant(ProgramBuild &build);
+/*
+ * Load, compile and link a program from the shader files like glt::load_program, but
+ * with the defines inserted after the #version line of each shader so specialized
+ * variants can be built from the same source, and through the binary cache.
+ * Returns -1 and prints the log if compiling or linking failed
+ */
+GLint load_program_variant(const std::vector<std::pair<GLenum, std::string>> &shaders,
+		const ShaderDefines &defines);
+/*
+ * Load the programs like load_program_variant without any defines, starting them all
+ * before waiting on any so the driver can compile them in parallel. Programs which
+ * failed to build are -1
+ */
+std::vector<GLint> load_programs(const std::vector<std::vector<std::pair<GLenum, std::string>>> &programs);
+
+/*
+ * Fill the AO sample pattern table for the params, 4 floats per sample: the sample's unit
+ * offset on the unrotated spiral in xy and its fraction of the screen space radius in z.
+ * The AO shader rotates the spiral per pixel, so only needs one cos/sin per pixel
+ */
+void fill_ao_sample_pattern(const AOParams &params, float *pattern);
+
+/*
+ * How the AO sample shader's targets are laid out. Screen renders the AO of the screen into
+ * a 2D target, layered renders one view per layer of 2D array targets, see layered.glsl.
+ * Deinterleaved splits the screen into 16 quarter resolution layers, each holding one pixel
+ * of every 4x4 block and drawn on its own, see DeinterleavedAO
+ */
+enum AO_SHADER_LAYOUT { AO_LAYOUT_SCREEN, AO_LAYOUT_LAYERED, AO_LAYOUT_DEINTERLEAVED };
+
+// An AO sample shader specialized for a set of parameters
+struct AOVariant {
+	GLuint program;
+	GLint ao_level_unif, phi_offset_unif;
+	// The layer being drawn, only used by deinterleaved variants
+	GLint layer_unif;
+	// The sample count the variant unrolls, which the sample pattern table must be filled for,
+	// and if it outputs the sample heatmap instead of the AO
+	int n_samples;
+	bool sample_heatmap;
+};
+
+/*
+ * Compiles specializations of the AO sample shader on demand and keeps them around so
+ * switching back to settings used before is free. Variants are keyed on the normal source,
+ * sample count, adaptive sampling, multi-scale AO and heatmap output, which are baked in as #defines so the
+ * sample loop fully unrolls. The number of turns only changes the sample pattern table and
+ * the adaptive sample range is read from the params block, so they don't need a variant.
+ * With parallel shader compilation new variants can be built in the background while the
+ * caller keeps rendering with the last one it got
+ */
+class AOShaderCache {
+	struct Key {
+		bool rendered_normals;
+		int n_samples;
+		bool adaptive, multi_scale, sample_heatmap;
+
+		bool operator<(const Key &b) const;
+	};
+
+	std::string shader_path;
+	bool octahedral_normals;
+	AO_SHADER_LAYOUT layout;
+	int depth_unit, normals_unit;
+	// Variants which failed to compile are kept with program 0 so we don't retry them every frame
+	std::map<Key, AOVariant> variants;
+	std::map<Key, ProgramBuild> building;
+
+public:
+	/*
+	 * Setup the cache to build AO shaders from the shader directory, reading the depth
+	 * pyramid and normals from the texture units passed. Layered and deinterleaved variants
+	 * read the depth from a 2D array, see AO_SHADER_LAYOUT
+	 */
+	AOShaderCache(const std::string &shader_path, bool octahedral_normals, int depth_unit, int normals_unit,
+			AO_SHADER_LAYOUT layout = AO_LAYOUT_SCREEN);
+	~AOShaderCache();
+	AOShaderCache(const AOShaderCache&) = delete;
+	AOShaderCache& operator=(const AOShaderCache&) = delete;
+	/*
+	 * Get the variant specialized for the params, compiling it if it hasn't been used
+	 * before. If sample_heatmap is set the variant outputs the fraction of the samples
+	 * taken at each pixel instead of the AO. Returns null if the variant failed to compile,
+	 * or if wait isn't set and it's still being built in the background
+	 */
+	const AOVariant* get(const AOParams &params, bool sample_heatmap = false, bool wait = true);
+	/*
+	 * Add the variants which have finished building in the background to the cache, so
+	 * builds for settings passed over (e.g. while dragging a slider) are still finished
+	 * and saved. Call once per frame
+	 */
+	void poll();
+	size_t size() const;
+	// Number of variants being built in the background
+	size_t num_building() const;
+
+private:
+	// Finish building the variant and add it to the cache
+	const AOVariant* add_variant(const Key &key, ProgramBuild &build);
+};
+
+#endif
+
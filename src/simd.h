@@ -0,0 +1,200 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_HAS_SSE2
+#include <immintrin.h>
+#endif
+
+/*
+ * Thin wrappers over the instruction sets used by the CPU AO kernels so each kernel can be
+ * written once as a template and instantiated per ISA. F is a vector of floats, I a vector
+ * of 32 bit ints and WIDTH the number of lanes. Each ISA is only defined if the translation
+ * unit including this header is compiled with support for it
+ */
+struct SimdScalar {
+	static const int WIDTH = 1;
+	typedef float F;
+	typedef int32_t I;
+
+	static F set1(float x){ return x; }
+	static F load(const float *p){ return *p; }
+	static void store(float *p, F v){ *p = v; }
+	static F add(F a, F b){ return a + b; }
+	static F sub(F a, F b){ return a - b; }
+	static F mul(F a, F b){ return a * b; }
+	static F div(F a, F b){ return a / b; }
+	static F min(F a, F b){ return a < b ? a : b; }
+	static F max(F a, F b){ return a > b ? a : b; }
+	static F abs(F a){ return std::abs(a); }
+	static F sqrt(F a){ return std::sqrt(a); }
+	// Select x in the lanes where a < b, otherwise y
+	static F select_lt(F a, F b, F x, F y){ return a < b ? x : y; }
+	// Bitmask of the lanes where a < b, lane i in bit i
+	static int mask_lt(F a, F b){ return a < b ? 1 : 0; }
+
+	static I set1i(int32_t x){ return x; }
+	static I iota(){ return 0; }
+	static I addi(I a, I b){ return a + b; }
+	static I subi(I a, I b){ return a - b; }
+	static I muli(I a, I b){ return a * b; }
+	static I mini(I a, I b){ return a < b ? a : b; }
+	static I maxi(I a, I b){ return a > b ? a : b; }
+	// Arithmetic shift right of each lane by the matching lane of s
+	static I srav(I a, I s){ return a >> s; }
+	// Truncating float to int conversion, out of range values and NaN give INT32_MIN
+	// like cvttps does instead of being undefined
+	static F cvtf(I a){ return static_cast<float>(a); }
+	static I cvtt(F a){
+		if (!(a > -2147483648.f && a < 2147483648.f)){
+			return INT32_MIN;
+		}
+		return static_cast<int32_t>(a);
+	}
+	// The unbiased exponent of the float, i.e. floor(log2(a)) for a > 0
+	static I exponent(F a){
+		uint32_t bits;
+		std::memcpy(&bits, &a, sizeof(bits));
+		return static_cast<int32_t>((bits >> 23) & 0xff) - 127;
+	}
+	static F gather(const float *base, I idx){ return base[idx]; }
+	static I gatheri(const int32_t *base, I idx){ return base[idx]; }
+	// Look up entries in a small table of 16 ints
+	static I lookup16(const int32_t *table, I idx){ return table[idx]; }
+	// The quad-local derivative along x of the row values at x, matching the fine
+	// dFdx on the GPU which differences the odd and even pixel of the 2x2 quad
+	static F quad_dx(const float *row, int x){ return row[x | 1] - row[x & ~1]; }
+};
+
+#ifdef SIMD_HAS_SSE2
+// SSE2 is the x86-64 baseline, so the ops missing from it (variable shifts, gathers,
+// 32 bit multiplies and min/max) are emulated
+struct SimdSSE2 {
+	static const int WIDTH = 4;
+	typedef __m128 F;
+	typedef __m128i I;
+
+	static F set1(float x){ return _mm_set1_ps(x); }
+	static F load(const float *p){ return _mm_loadu_ps(p); }
+	static void store(float *p, F v){ _mm_storeu_ps(p, v); }
+	static F add(F a, F b){ return _mm_add_ps(a, b); }
+	static F sub(F a, F b){ return _mm_sub_ps(a, b); }
+	static F mul(F a, F b){ return _mm_mul_ps(a, b); }
+	static F div(F a, F b){ return _mm_div_ps(a, b); }
+	static F min(F a, F b){ return _mm_min_ps(a, b); }
+	static F max(F a, F b){ return _mm_max_ps(a, b); }
+	static F abs(F a){ return _mm_and_ps(a, _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff))); }
+	static F sqrt(F a){ return _mm_sqrt_ps(a); }
+	static F select_lt(F a, F b, F x, F y){
+		const F m = _mm_cmplt_ps(a, b);
+		return _mm_or_ps(_mm_and_ps(m, x), _mm_andnot_ps(m, y));
+	}
+	static int mask_lt(F a, F b){ return _mm_movemask_ps(_mm_cmplt_ps(a, b)); }
+
+	static I set1i(int32_t x){ return _mm_set1_epi32(x); }
+	static I iota(){ return _mm_setr_epi32(0, 1, 2, 3); }
+	static I addi(I a, I b){ return _mm_add_epi32(a, b); }
+	static I subi(I a, I b){ return _mm_sub_epi32(a, b); }
+	static I muli(I a, I b){
+		const I even = _mm_mul_epu32(a, b);
+		const I odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+		return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+				_mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+	}
+	static I mini(I a, I b){
+		const I m = _mm_cmpgt_epi32(a, b);
+		return _mm_or_si128(_mm_and_si128(m, b), _mm_andnot_si128(m, a));
+	}
+	static I maxi(I a, I b){
+		const I m = _mm_cmpgt_epi32(a, b);
+		return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b));
+	}
+	static I srav(I a, I s){
+		alignas(16) int32_t av[4], sv[4];
+		_mm_store_si128(reinterpret_cast<I*>(av), a);
+		_mm_store_si128(reinterpret_cast<I*>(sv), s);
+		return _mm_setr_epi32(av[0] >> sv[0], av[1] >> sv[1], av[2] >> sv[2], av[3] >> sv[3]);
+	}
+	static F cvtf(I a){ return _mm_cvtepi32_ps(a); }
+	static I cvtt(F a){ return _mm_cvttps_epi32(a); }
+	static I exponent(F a){
+		const I e = _mm_and_si128(_mm_srli_epi32(_mm_castps_si128(a), 23), _mm_set1_epi32(0xff));
+		return _mm_sub_epi32(e, _mm_set1_epi32(127));
+	}
+	static F gather(const float *base, I idx){
+		alignas(16) int32_t i[4];
+		_mm_store_si128(reinterpret_cast<I*>(i), idx);
+		return _mm_setr_ps(base[i[0]], base[i[1]], base[i[2]], base[i[3]]);
+	}
+	static I gatheri(const int32_t *base, I idx){
+		alignas(16) int32_t i[4];
+		_mm_store_si128(reinterpret_cast<I*>(i), idx);
+		return _mm_setr_epi32(base[i[0]], base[i[1]], base[i[2]], base[i[3]]);
+	}
+	static I lookup16(const int32_t *table, I idx){ return gatheri(table, idx); }
+	static F quad_dx(const float *row, int x){
+		const F v = _mm_loadu_ps(row + x);
+		return _mm_sub_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 1, 1)),
+				_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 0, 0)));
+	}
+};
+#endif
+
+#ifdef __AVX2__
+struct SimdAVX2 {
+	static const int WIDTH = 8;
+	typedef __m256 F;
+	typedef __m256i I;
+
+	static F set1(float x){ return _mm256_set1_ps(x); }
+	static F load(const float *p){ return _mm256_loadu_ps(p); }
+	static void store(float *p, F v){ _mm256_storeu_ps(p, v); }
+	static F add(F a, F b){ return _mm256_add_ps(a, b); }
+	static F sub(F a, F b){ return _mm256_sub_ps(a, b); }
+	static F mul(F a, F b){ return _mm256_mul_ps(a, b); }
+	static F div(F a, F b){ return _mm256_div_ps(a, b); }
+	static F min(F a, F b){ return _mm256_min_ps(a, b); }
+	static F max(F a, F b){ return _mm256_max_ps(a, b); }
+	static F abs(F a){ return _mm256_and_ps(a, _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff))); }
+	static F sqrt(F a){ return _mm256_sqrt_ps(a); }
+	static F select_lt(F a, F b, F x, F y){
+		return _mm256_blendv_ps(y, x, _mm256_cmp_ps(a, b, _CMP_LT_OQ));
+	}
+	static int mask_lt(F a, F b){ return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LT_OQ)); }
+
+	static I set1i(int32_t x){ return _mm256_set1_epi32(x); }
+	static I iota(){ return _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7); }
+	static I addi(I a, I b){ return _mm256_add_epi32(a, b); }
+	static I subi(I a, I b){ return _mm256_sub_epi32(a, b); }
+	static I muli(I a, I b){ return _mm256_mullo_epi32(a, b); }
+	static I mini(I a, I b){ return _mm256_min_epi32(a, b); }
+	static I maxi(I a, I b){ return _mm256_max_epi32(a, b); }
+	static I srav(I a, I s){ return _mm256_srav_epi32(a, s); }
+	static F cvtf(I a){ return _mm256_cvtepi32_ps(a); }
+	static I cvtt(F a){ return _mm256_cvttps_epi32(a); }
+	static I exponent(F a){
+		const I e = _mm256_and_si256(_mm256_srli_epi32(_mm256_castps_si256(a), 23), _mm256_set1_epi32(0xff));
+		return _mm256_sub_epi32(e, _mm256_set1_epi32(127));
+	}
+	static F gather(const float *base, I idx){ return _mm256_i32gather_ps(base, idx, 4); }
+	static I gatheri(const int32_t *base, I idx){
+		return _mm256_i32gather_epi32(reinterpret_cast<const int*>(base), idx, 4);
+	}
+	// Small tables fit in two registers, so permutes are much cheaper than a gather
+	static I lookup16(const int32_t *table, I idx){
+		const I lo = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(reinterpret_cast<const I*>(table)), idx);
+		const I hi = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(reinterpret_cast<const I*>(table + 8)), idx);
+		return _mm256_blendv_epi8(lo, hi, _mm256_cmpgt_epi32(idx, _mm256_set1_epi32(7)));
+	}
+	static F quad_dx(const float *row, int x){
+		const F v = _mm256_loadu_ps(row + x);
+		return _mm256_sub_ps(_mm256_movehdup_ps(v), _mm256_moveldup_ps(v));
+	}
+};
+#endif
+
+#endif
+
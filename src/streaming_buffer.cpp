@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <iostream>
+#include "gl_caps.h"
+#include "streaming_buffer.h"
+
+StreamingBuffer::StreamingBuffer(const std::vector<size_t> &block_sizes, size_t alignment)
+	: buffer(0), sizes(block_sizes), slot_size(0), mapped(nullptr), slot(0),
+	// glBufferStorage is core in 4.4 but we only ask for 4.3
+	persistent(gl_version_at_least(4, 4) || gl_has_extension("GL_ARB_buffer_storage"))
+{
+	alignment = std::max(alignment, size_t{1});
+	for (const auto &s : sizes){
+		offsets.push_back(slot_size);
+		slot_size += ((s + alignment - 1) / alignment) * alignment;
+	}
+	fences.fill(nullptr);
+
+	const size_t total = slot_size * STREAMING_BUFFER_SLOTS;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	if (persistent){
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, total, nullptr, flags);
+		mapped = static_cast<char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, total, flags));
+	}
+	if (!mapped){
+		if (persistent){
+			std::cout << "Failed to persistently map streaming buffer, falling back to glBufferSubData\n";
+			glDeleteBuffers(1, &buffer);
+			glGenBuffers(1, &buffer);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			persistent = false;
+		}
+		glBufferData(GL_COPY_WRITE_BUFFER, total, nullptr, GL_STREAM_DRAW);
+		fallback.resize(total);
+		mapped = fallback.data();
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	// Start on the last slot so the first frame begins at the start of the buffer
+	slot = STREAMING_BUFFER_SLOTS - 1;
+}
+StreamingBuffer::~StreamingBuffer(){
+	for (auto &f : fences){
+		if (f){
+			glDeleteSync(f);
+		}
+	}
+	if (persistent){
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	glDeleteBuffers(1, &buffer);
+}
+void StreamingBuffer::begin_frame(){
+	slot = (slot + 1) % STREAMING_BUFFER_SLOTS;
+	GLsync &fence = fences[slot];
+	if (fence){
+		GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		while (status == GL_TIMEOUT_EXPIRED){
+			status = glClientWaitSync(fence, 0, 1000000);
+		}
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+}
+void* StreamingBuffer::block(size_t i){
+	return mapped + slot * slot_size + offsets[i];
+}
+void StreamingBuffer::bind(GLenum target, GLuint index, size_t i){
+	const size_t offset = slot * slot_size + offsets[i];
+	if (!persistent){
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, offset, sizes[i], mapped + offset);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	glBindBufferRange(target, index, buffer, offset, sizes[i]);
+}
+void StreamingBuffer::end_frame(){
+	fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+bool StreamingBuffer::is_persistent() const {
+	return persistent;
+}
+
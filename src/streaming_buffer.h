@@ -0,0 +1,60 @@
+#ifndef STREAMING_BUFFER_H
+#define STREAMING_BUFFER_H
+
+#include <array>
+#include <vector>
+#include "glt/gl_core_4_5.h"
+
+// Number of frames of data kept in a StreamingBuffer's ring
+const int STREAMING_BUFFER_SLOTS = 3;
+
+/*
+ * A ring of copies of some blocks of per-frame data (e.g. uniform blocks) which stays
+ * persistently and coherently mapped, so writing a new frame's data never makes the driver
+ * sync with the frames still in flight. Each frame writes all its blocks into the next slot
+ * of the ring and binds them from there, and a fence on each slot tells us when the GPU is
+ * done with it. If the context doesn't support buffer storage the blocks are written to a
+ * CPU copy instead and uploaded with glBufferSubData when they're bound
+ */
+class StreamingBuffer {
+	GLuint buffer;
+	// Offset and size of each block within a slot
+	std::vector<size_t> offsets, sizes;
+	size_t slot_size;
+	char *mapped;
+	std::vector<char> fallback;
+	std::array<GLsync, STREAMING_BUFFER_SLOTS> fences;
+	int slot;
+	bool persistent;
+
+public:
+	/*
+	 * Create a ring holding blocks of the sizes passed, with each block aligned to alignment
+	 * (e.g. GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT)
+	 */
+	StreamingBuffer(const std::vector<size_t> &block_sizes, size_t alignment);
+	~StreamingBuffer();
+	StreamingBuffer(const StreamingBuffer&) = delete;
+	StreamingBuffer& operator=(const StreamingBuffer&) = delete;
+	/*
+	 * Move on to the next slot in the ring, waiting for the GPU to finish with the frame
+	 * which last used it. The blocks' contents are undefined until they're written again
+	 */
+	void begin_frame();
+	// Get the block's memory in the current slot to write this frame's data to
+	void* block(size_t i);
+	/*
+	 * Bind the block in the current slot to the indexed target, should be called after
+	 * writing its data for the frame
+	 */
+	void bind(GLenum target, GLuint index, size_t i);
+	/*
+	 * Fence the current slot, call once all the commands reading this frame's data
+	 * have been issued
+	 */
+	void end_frame();
+	bool is_persistent() const;
+};
+
+#endif
+
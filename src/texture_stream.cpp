@@ -0,0 +1,365 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <utility>
+#include "texture_stream.h"
+
+// Build our own private copy of stb_image for decoding on the worker threads
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+namespace {
+
+// The order of the maps in material_maps and the placeholder layer each uses
+enum MATERIAL_MAP { MAP_KA, MAP_KD, MAP_KS, MAP_BUMP, MAP_D };
+const std::array<PLACEHOLDER_LAYER, 5> MAP_PLACEHOLDERS = {{PLACEHOLDER_WHITE, PLACEHOLDER_WHITE,
+	PLACEHOLDER_BLACK, PLACEHOLDER_FLAT_NORMAL, PLACEHOLDER_WHITE}};
+
+// Get the (array, layer) pair of the map in the material
+int32_t* material_map(GpuMaterial &mat, int map){
+	switch (map){
+		case MAP_KA: return mat.map_ka_kd;
+		case MAP_KD: return mat.map_ka_kd + 2;
+		case MAP_KS: return mat.map_ks_n;
+		case MAP_BUMP: return mat.map_ks_n + 2;
+		default: return mat.map_mask;
+	}
+}
+size_t decoded_size(const std::vector<std::vector<uint8_t>> &levels){
+	size_t bytes = 0;
+	for (const auto &l : levels){
+		bytes += l.size();
+	}
+	return bytes;
+}
+int mip_levels(int width, int height){
+	int levels = 1;
+	while ((std::max(width, height) >> levels) > 0){
+		++levels;
+	}
+	return levels;
+}
+
+}
+
+TextureStreamer::TextureStreamer(const ObjModel &model, const glt::SubBuffer &mat_buf, glt::OBJTextures &obj_textures,
+		int threads)
+	: materials(obj_gpu_materials(model)), mat_buf(mat_buf), streamed(0), finished(0), n_resident(0), next_pbo(0),
+	uploading(false), current_level(0), current_row(0), next_decode(0), decoded_bytes(0), quit(false),
+	start(std::chrono::steady_clock::now())
+{
+	// Find the distinct textures used by the materials
+	std::map<std::string, int> texture_ids;
+	for (const auto &m : model.materials){
+		const std::array<const std::string*, 5> files = {{&m.map_ka, &m.map_kd, &m.map_ks, &m.map_bump, &m.map_d}};
+		std::array<int, 5> ids;
+		for (size_t i = 0; i < files.size(); ++i){
+			if (files[i]->empty()){
+				ids[i] = -1;
+				continue;
+			}
+			auto it = texture_ids.find(*files[i]);
+			if (it == texture_ids.end()){
+				it = texture_ids.insert(std::make_pair(*files[i], static_cast<int>(textures.size()))).first;
+				textures.push_back(Texture{*files[i], 0, 0, 0, -1, 0, false});
+			}
+			ids[i] = it->second;
+		}
+		material_maps.push_back(ids);
+	}
+
+	// Only read the image headers for now to find the sizes, textures of the same size share an array
+	std::map<std::pair<int, int>, std::vector<size_t>> sizes;
+	for (size_t i = 0; i < textures.size(); ++i){
+		Texture &t = textures[i];
+		int channels = 0;
+		if (!stbi_info(t.file.c_str(), &t.width, &t.height, &channels)){
+			std::cout << "Failed to read texture " << t.file << ": " << stbi_failure_reason() << "\n";
+			continue;
+		}
+		sizes[std::make_pair(t.width, t.height)].push_back(i);
+	}
+	if (sizes.size() + 1 > static_cast<size_t>(MAX_MODEL_TEXTURE_ARRAYS)){
+		std::cout << "Warning: the model's textures need " << sizes.size() + 1 << " texture arrays but only "
+			<< MAX_MODEL_TEXTURE_ARRAYS << " are supported, some textures won't be loaded\n";
+	}
+
+	GLint prev_array = 0;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &prev_array);
+	arrays.resize(std::min(sizes.size() + 1, static_cast<size_t>(MAX_MODEL_TEXTURE_ARRAYS)));
+	glGenTextures(arrays.size(), arrays.data());
+	const uint8_t placeholder[] = {255, 255, 255, 255, 128, 128, 255, 255, 0, 0, 0, 255};
+	glBindTexture(GL_TEXTURE_2D_ARRAY, arrays[0]);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA8, 1, 1, 3);
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, 1, 1, 3, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	int array = 1;
+	for (auto it = sizes.begin(); it != sizes.end() && array < static_cast<int>(arrays.size()); ++it, ++array){
+		const int levels = mip_levels(it->first.first, it->first.second);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, arrays[array]);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, it->first.first, it->first.second, it->second.size());
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		for (size_t i = 0; i < it->second.size(); ++i){
+			Texture &t = textures[it->second[i]];
+			t.levels = levels;
+			t.array = array;
+			t.layer = i;
+			++streamed;
+		}
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, prev_array);
+	obj_textures.textures.insert(obj_textures.textures.end(), arrays.begin(), arrays.end());
+
+	for (auto &p : pbos){
+		glGenBuffers(1, &p.buffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, p.buffer);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, TEXTURE_STREAM_PBO_BYTES, nullptr, GL_STREAM_DRAW);
+		p.fence = nullptr;
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	update_materials();
+
+	if (threads <= 0){
+		threads = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+	}
+	threads = std::min(threads, static_cast<int>(std::max(streamed, size_t{1})));
+	for (int i = 0; i < threads; ++i){
+		workers.emplace_back([this](){ decode_loop(); });
+	}
+}
+TextureStreamer::~TextureStreamer(){
+	{
+		std::lock_guard<std::mutex> lock{mutex};
+		quit = true;
+	}
+	decoded_space.notify_all();
+	for (auto &t : workers){
+		t.join();
+	}
+	for (auto &p : pbos){
+		if (p.fence){
+			glDeleteSync(p.fence);
+		}
+		glDeleteBuffers(1, &p.buffer);
+	}
+}
+void TextureStreamer::update(size_t budget, bool wait){
+	if (done()){
+		return;
+	}
+	GLint prev_array = 0;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &prev_array);
+	bool materials_changed = false;
+	size_t uploaded = 0;
+	while (uploaded < budget && !done()){
+		if (!uploading && !next_texture(wait)){
+			break;
+		}
+		if (current.levels.empty()){
+			// Decoding failed, the texture's maps fall back to the material's colors
+			textures[current.texture].array = -1;
+			++finished;
+			uploading = false;
+			materials_changed = true;
+			continue;
+		}
+
+		PixelBuffer &pbo = pbos[next_pbo];
+		if (pbo.fence){
+			GLenum status = glClientWaitSync(pbo.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+			while (wait && status == GL_TIMEOUT_EXPIRED){
+				status = glClientWaitSync(pbo.fence, 0, 1000000);
+			}
+			if (status == GL_TIMEOUT_EXPIRED){
+				break;
+			}
+			glDeleteSync(pbo.fence);
+			pbo.fence = nullptr;
+		}
+
+		// Pack rows of the decoded textures into the buffer until it's full or we're out of data
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo.buffer);
+		uint8_t *dst = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, TEXTURE_STREAM_PBO_BYTES,
+					GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+		std::vector<RowCopy> copies;
+		std::vector<size_t> completed;
+		size_t offset = 0;
+		while (uploading){
+			const Texture &t = textures[current.texture];
+			const size_t width = std::max(t.width >> current_level, 1);
+			const int height = std::max(t.height >> current_level, 1);
+			const int rows = std::min(static_cast<size_t>(height - current_row),
+					(TEXTURE_STREAM_PBO_BYTES - offset) / (width * 4));
+			if (rows == 0){
+				break;
+			}
+			std::memcpy(dst + offset, current.levels[current_level].data() + current_row * width * 4, rows * width * 4);
+			copies.push_back(RowCopy{current.texture, current_level, current_row, rows, offset});
+			offset += rows * width * 4;
+			current_row += rows;
+			if (current_row == height){
+				current_row = 0;
+				if (++current_level == t.levels){
+					completed.push_back(current.texture);
+					current = DecodedTexture{};
+					uploading = false;
+					if (uploaded + offset < budget){
+						next_texture(false);
+					}
+				}
+			}
+			// Failed textures are handled by the outer loop
+			if (uploading && current.levels.empty()){
+				break;
+			}
+		}
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+		for (const auto &c : copies){
+			const Texture &t = textures[c.texture];
+			glBindTexture(GL_TEXTURE_2D_ARRAY, arrays[t.array]);
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, c.level, 0, c.y, t.layer, std::max(t.width >> c.level, 1), c.rows, 1,
+					GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<const void*>(c.offset));
+		}
+		pbo.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		next_pbo = (next_pbo + 1) % pbos.size();
+		uploaded += offset;
+		// The uploads are ahead of any draws reading the texture in the command stream, so
+		// we can switch the materials over now without waiting on the fence
+		for (const auto &i : completed){
+			textures[i].resident = true;
+			++finished;
+			++n_resident;
+		}
+		materials_changed = materials_changed || !completed.empty();
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, prev_array);
+	if (materials_changed){
+		update_materials();
+	}
+}
+void TextureStreamer::finish(){
+	while (!done()){
+		update(SIZE_MAX, true);
+	}
+}
+bool TextureStreamer::done() const {
+	return finished == streamed;
+}
+size_t TextureStreamer::resident() const {
+	return n_resident;
+}
+size_t TextureStreamer::total() const {
+	return textures.size();
+}
+double TextureStreamer::elapsed_ms() const {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+void TextureStreamer::decode_loop(){
+	for (size_t i = next_decode++; i < textures.size(); i = next_decode++){
+		if (textures[i].array == -1){
+			continue;
+		}
+		DecodedTexture tex = decode(i);
+		const size_t bytes = decoded_size(tex.levels);
+		std::unique_lock<std::mutex> lock{mutex};
+		decoded_space.wait(lock, [&](){ return quit || decoded_bytes < TEXTURE_STREAM_MAX_DECODED_BYTES; });
+		if (quit){
+			return;
+		}
+		decoded_bytes += bytes;
+		decoded.push_back(std::move(tex));
+		decoded_ready.notify_one();
+	}
+}
+TextureStreamer::DecodedTexture TextureStreamer::decode(size_t texture) const {
+	const Texture &t = textures[texture];
+	DecodedTexture tex{texture, {}};
+	int width = 0, height = 0, channels = 0;
+	stbi_uc *img = stbi_load(t.file.c_str(), &width, &height, &channels, 4);
+	if (!img || width != t.width || height != t.height){
+		std::cout << "Failed to decode texture " << t.file << "\n";
+		stbi_image_free(img);
+		return tex;
+	}
+	// Flip the image so the first row is at the bottom like GL expects
+	tex.levels.resize(t.levels);
+	tex.levels[0].resize(static_cast<size_t>(width) * height * 4);
+	for (int y = 0; y < height; ++y){
+		std::memcpy(tex.levels[0].data() + static_cast<size_t>(height - 1 - y) * width * 4,
+				img + static_cast<size_t>(y) * width * 4, width * 4);
+	}
+	stbi_image_free(img);
+
+	// Box filter down the mip chain, clamping at the edge for odd sizes
+	for (int l = 1; l < t.levels; ++l){
+		const int pw = std::max(width >> (l - 1), 1), ph = std::max(height >> (l - 1), 1);
+		const int w = std::max(width >> l, 1), h = std::max(height >> l, 1);
+		const std::vector<uint8_t> &prev = tex.levels[l - 1];
+		std::vector<uint8_t> &level = tex.levels[l];
+		level.resize(static_cast<size_t>(w) * h * 4);
+		for (int y = 0; y < h; ++y){
+			const int y0 = std::min(2 * y, ph - 1), y1 = std::min(2 * y + 1, ph - 1);
+			for (int x = 0; x < w; ++x){
+				const int x0 = std::min(2 * x, pw - 1), x1 = std::min(2 * x + 1, pw - 1);
+				for (int c = 0; c < 4; ++c){
+					const int sum = prev[(static_cast<size_t>(y0) * pw + x0) * 4 + c]
+						+ prev[(static_cast<size_t>(y0) * pw + x1) * 4 + c]
+						+ prev[(static_cast<size_t>(y1) * pw + x0) * 4 + c]
+						+ prev[(static_cast<size_t>(y1) * pw + x1) * 4 + c];
+					level[(static_cast<size_t>(y) * w + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+				}
+			}
+		}
+	}
+	return tex;
+}
+bool TextureStreamer::next_texture(bool wait){
+	std::unique_lock<std::mutex> lock{mutex};
+	if (wait){
+		decoded_ready.wait(lock, [&](){ return !decoded.empty(); });
+	}
+	if (decoded.empty()){
+		return false;
+	}
+	current = std::move(decoded.front());
+	decoded.pop_front();
+	decoded_bytes -= decoded_size(current.levels);
+	uploading = true;
+	current_level = 0;
+	current_row = 0;
+	lock.unlock();
+	decoded_space.notify_all();
+	return true;
+}
+void TextureStreamer::update_materials(){
+	for (size_t i = 0; i < material_maps.size(); ++i){
+		for (size_t m = 0; m < material_maps[i].size(); ++m){
+			int32_t *map = material_map(materials[i], m);
+			const int id = material_maps[i][m];
+			if (id == -1 || textures[id].array == -1){
+				map[0] = -1;
+				map[1] = -1;
+			}
+			else if (textures[id].resident){
+				map[0] = textures[id].array;
+				map[1] = textures[id].layer;
+			}
+			else {
+				map[0] = 0;
+				map[1] = MAP_PLACEHOLDERS[m];
+			}
+		}
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mat_buf.buffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, mat_buf.offset, materials.size() * sizeof(GpuMaterial), materials.data());
+}
+
@@ -0,0 +1,128 @@
+#ifndef TEXTURE_STREAM_H
+#define TEXTURE_STREAM_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "glt/gl_core_4_5.h"
+#include "glt/buffer_allocator.h"
+#include "glt/load_models.h"
+#include "obj_loader.h"
+#include "obj_upload.h"
+
+// Size of each pixel buffer in the upload ring and the number of buffers in it
+const size_t TEXTURE_STREAM_PBO_BYTES = 4 * 1024 * 1024;
+const int TEXTURE_STREAM_PBOS = 3;
+// Upload budget for each frame
+const size_t TEXTURE_STREAM_FRAME_BYTES = 2 * TEXTURE_STREAM_PBO_BYTES;
+// Number of texture arrays the shaders can sample, must match NUM_MODEL_TEXTURES in global.glsl
+const int MAX_MODEL_TEXTURE_ARRAYS = 16;
+// Decoding stalls once this much decoded texture data is waiting to be uploaded
+const size_t TEXTURE_STREAM_MAX_DECODED_BYTES = 256 * 1024 * 1024;
+// Layers of the 1x1 placeholder array, which is always the first texture array
+enum PLACEHOLDER_LAYER {
+	PLACEHOLDER_WHITE,
+	PLACEHOLDER_FLAT_NORMAL,
+	PLACEHOLDER_BLACK,
+};
+
+/*
+ * Streams the textures of a model loaded by load_obj_parallel to the GPU while we render.
+ * The images are decoded and mipmapped on worker threads and uploaded through a ring of
+ * pixel buffer objects a few megabytes per frame. The material maps point at a 1x1
+ * placeholder layer until their texture is resident and are then switched over to it
+ */
+class TextureStreamer {
+	struct Texture {
+		std::string file;
+		int width, height, levels;
+		// The texture array and layer holding the texture, array is -1 if it can't be loaded
+		int array, layer;
+		bool resident;
+	};
+	struct DecodedTexture {
+		size_t texture;
+		// RGBA8 texels of each mip level, empty if decoding failed
+		std::vector<std::vector<uint8_t>> levels;
+	};
+	// A run of rows of a mip level copied into a pixel buffer to be uploaded
+	struct RowCopy {
+		size_t texture;
+		int level, y, rows;
+		size_t offset;
+	};
+	struct PixelBuffer {
+		GLuint buffer;
+		// Signalled once the GPU is done reading the buffer, null if it's free
+		GLsync fence;
+	};
+
+	std::vector<Texture> textures;
+	std::vector<GLuint> arrays;
+	// The materials as uploaded, with each map's texture index and the placeholder it uses
+	std::vector<GpuMaterial> materials;
+	std::vector<std::array<int, 5>> material_maps;
+	glt::SubBuffer mat_buf;
+	// Number of textures we're streaming and how many have been uploaded or failed
+	size_t streamed, finished, n_resident;
+
+	std::array<PixelBuffer, TEXTURE_STREAM_PBOS> pbos;
+	int next_pbo;
+	// The decoded texture being uploaded and the next row to copy from it
+	DecodedTexture current;
+	bool uploading;
+	int current_level, current_row;
+
+	std::vector<std::thread> workers;
+	std::atomic<size_t> next_decode;
+	std::mutex mutex;
+	std::condition_variable decoded_ready, decoded_space;
+	std::deque<DecodedTexture> decoded;
+	size_t decoded_bytes;
+	bool quit;
+	std::chrono::steady_clock::time_point start;
+
+public:
+	/*
+	 * Read the sizes of the model's textures, create the texture arrays to hold them and
+	 * write the materials to mat_buf with their maps on the placeholder, then start decoding
+	 * on the number of threads passed or one per hardware thread if threads is 0. The texture
+	 * arrays are appended to textures.textures to be bound to model_textures and deleted by
+	 * the caller as for glt's loader
+	 */
+	TextureStreamer(const ObjModel &model, const glt::SubBuffer &mat_buf, glt::OBJTextures &textures,
+			int threads = 0);
+	~TextureStreamer();
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+	/*
+	 * Upload up to budget bytes of decoded textures and switch the materials over to any which
+	 * became resident, should be called once per frame. Pixel buffers still in use by the GPU
+	 * are skipped until a later frame unless wait is set, in which case we also wait for the
+	 * next texture to be decoded if there isn't one ready
+	 */
+	void update(size_t budget, bool wait = false);
+	// Upload all the remaining textures, blocking until they're resident
+	void finish();
+	bool done() const;
+	size_t resident() const;
+	size_t total() const;
+	// Milliseconds since the streamer was created
+	double elapsed_ms() const;
+
+private:
+	void decode_loop();
+	DecodedTexture decode(size_t texture) const;
+	bool next_texture(bool wait);
+	void update_materials();
+};
+
+#endif
+
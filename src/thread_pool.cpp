@@ -0,0 +1,126 @@
+#include <algorithm>
+#include "thread_pool.h"
+
+WorkStealingPool::WorkStealingPool(int n_threads)
+	: job(nullptr), generation(0), busy(0), quit(false), remaining(0)
+{
+	if (n_threads <= 0){
+		n_threads = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+	}
+	for (int i = 0; i < n_threads; ++i){
+		queues.emplace_back(new TaskQueue);
+	}
+	// The calling thread acts as worker 0
+	for (int i = 1; i < n_threads; ++i){
+		threads.emplace_back(&WorkStealingPool::worker_loop, this, i);
+	}
+}
+WorkStealingPool::~WorkStealingPool(){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (auto &t : threads){
+		t.join();
+	}
+}
+void WorkStealingPool::parallel_for(int n, const std::function<void(int, int)> &f){
+	if (n <= 0){
+		return;
+	}
+	if (threads.empty() || n == 1){
+		for (int i = 0; i < n; ++i){
+			f(0, i);
+		}
+		return;
+	}
+	// Publish the loop before any of its tasks are queued, so any worker which can see
+	// a task has also seen the job and count it belongs to
+	size_t gen;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &f;
+		remaining = n;
+		gen = ++generation;
+	}
+	// Hand each worker a contiguous block of the tasks
+	const int n_queues = static_cast<int>(queues.size());
+	for (int q = 0; q < n_queues; ++q){
+		std::lock_guard<std::mutex> lock(queues[q]->mutex);
+		const int begin = static_cast<int>(static_cast<int64_t>(n) * q / n_queues);
+		const int end = static_cast<int>(static_cast<int64_t>(n) * (q + 1) / n_queues);
+		for (int i = begin; i < end; ++i){
+			queues[q]->tasks.push_back(Task{gen, i});
+		}
+	}
+	wake.notify_all();
+
+	run_tasks(0, gen, f);
+
+	// Wait for the tasks to finish and every worker which joined the loop to leave it.
+	// Workers joining after this copy the cleared job but find no tasks of their generation
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [&](){ return busy == 0 && remaining == 0; });
+	job = nullptr;
+}
+int WorkStealingPool::size() const {
+	return static_cast<int>(queues.size());
+}
+void WorkStealingPool::worker_loop(int id){
+	size_t seen = 0;
+	while (true){
+		const std::function<void(int, int)> *f = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&](){ return quit || generation != seen; });
+			if (quit){
+				return;
+			}
+			seen = generation;
+			f = job;
+			++busy;
+		}
+		if (f){
+			run_tasks(id, seen, *f);
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			--busy;
+		}
+		done.notify_all();
+	}
+}
+void WorkStealingPool::run_tasks(int id, size_t gen, const std::function<void(int, int)> &f){
+	int task;
+	while (pop_task(id, gen, task) || steal_task(id, gen, task)){
+		f(id, task);
+		--remaining;
+	}
+}
+bool WorkStealingPool::pop_task(int id, size_t gen, int &task){
+	TaskQueue &q = *queues[id];
+	std::lock_guard<std::mutex> lock(q.mutex);
+	// The queues only hold one loop's tasks at a time, a loop isn't done until they're all taken
+	if (q.tasks.empty() || q.tasks.front().generation != gen){
+		return false;
+	}
+	task = q.tasks.front().index;
+	q.tasks.pop_front();
+	return true;
+}
+bool WorkStealingPool::steal_task(int id, size_t gen, int &task){
+	const int n_queues = static_cast<int>(queues.size());
+	for (int i = 1; i < n_queues; ++i){
+		TaskQueue &q = *queues[(id + i) % n_queues];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (!q.tasks.empty() && q.tasks.back().generation == gen){
+			// Take from the far end of the victim's block to keep its locality
+			task = q.tasks.back().index;
+			q.tasks.pop_back();
+			return true;
+		}
+	}
+	return false;
+}
+
@@ -0,0 +1,66 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * A pool of persistent worker threads which run parallel loops with work stealing. Each
+ * worker starts with a contiguous block of the loop's tasks in its own queue, so neighbouring
+ * tasks (e.g. tiles of an image) stay on the same core, and takes tasks from the back of the
+ * other workers' queues once its own runs dry so uneven task costs still balance out
+ */
+class WorkStealingPool {
+	// A task of the loop started in the generation
+	struct Task {
+		size_t generation;
+		int index;
+	};
+	struct TaskQueue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+	std::vector<std::thread> threads;
+	std::vector<std::unique_ptr<TaskQueue>> queues;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	// The running loop's function and generation, workers copy both under the mutex and only
+	// run tasks from that generation, so a worker waking late can't run another loop's tasks
+	const std::function<void(int, int)> *job;
+	size_t generation;
+	// Workers which have joined the current generation and not left yet
+	int busy;
+	bool quit;
+	std::atomic<int> remaining;
+
+public:
+	/*
+	 * Create a pool with the number of threads passed, or one per hardware thread if
+	 * threads is 0. The thread calling parallel_for counts as one of the pool's threads
+	 */
+	WorkStealingPool(int threads = 0);
+	~WorkStealingPool();
+	WorkStealingPool(const WorkStealingPool&) = delete;
+	WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+	/*
+	 * Run f(worker, i) for each i in [0, n) across the pool and wait for them to finish.
+	 * worker is the index of the thread running the task, in [0, size())
+	 */
+	void parallel_for(int n, const std::function<void(int worker, int i)> &f);
+	int size() const;
+
+private:
+	void worker_loop(int id);
+	void run_tasks(int id, size_t gen, const std::function<void(int, int)> &f);
+	bool pop_task(int id, size_t gen, int &task);
+	bool steal_task(int id, size_t gen, int &task);
+};
+
+#endif
+
@@ -0,0 +1,52 @@
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "thread_pool.h"
+
+/*
+ * Stress the pool's hand off between loops with many tiny back to back parallel_fors, where
+ * workers often wake for a loop only after it's finished. Each task of each loop must run
+ * exactly once and every loop must see all of its tasks done when parallel_for returns
+ */
+int main(int argc, char **argv){
+	int threads = 8, loops = 200000;
+	for (int i = 1; i < argc; ++i){
+		const std::string arg = argv[i];
+		if (i + 1 >= argc){
+			std::cout << "Usage: ./thread_pool_stress [--threads N] [--loops N]\n";
+			return 1;
+		}
+		if (arg == "--threads"){
+			threads = std::stoi(argv[++i]);
+		}
+		else if (arg == "--loops"){
+			loops = std::stoi(argv[++i]);
+		}
+	}
+	WorkStealingPool pool{threads};
+	const int n_tasks[] = {3, 1, 2, 17};
+	std::vector<std::atomic<int>> runs(17);
+	for (int l = 0; l < loops; ++l){
+		const int n = n_tasks[l % 4];
+		for (int i = 0; i < n; ++i){
+			runs[i] = 0;
+		}
+		pool.parallel_for(n, [&](int worker, int i){
+			if (worker < 0 || worker >= pool.size() || i < 0 || i >= n){
+				std::cout << "Loop " << l << " ran task " << i << " on worker " << worker << "\n";
+				std::exit(1);
+			}
+			++runs[i];
+		});
+		for (int i = 0; i < n; ++i){
+			if (runs[i] != 1){
+				std::cout << "Loop " << l << " ran task " << i << " " << runs[i] << " times\n";
+				return 1;
+			}
+		}
+	}
+	std::cout << "Ran " << loops << " loops on " << pool.size() << " threads\n";
+	return 0;
+}
@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "bvh.h"
+#include "vertex_ao.h"
+
+// Vertices baked per task of the parallel loop
+const int BAKE_VERTS_PER_TASK = 256;
+
+// Van der Corput radical inverse in base 2, the second coordinate of the Hammersley set
+static float radical_inverse(uint32_t i){
+	i = (i << 16) | (i >> 16);
+	i = ((i & 0x55555555u) << 1) | ((i & 0xaaaaaaaau) >> 1);
+	i = ((i & 0x33333333u) << 2) | ((i & 0xccccccccu) >> 2);
+	i = ((i & 0x0f0f0f0fu) << 4) | ((i & 0xf0f0f0f0u) >> 4);
+	i = ((i & 0x00ff00ffu) << 8) | ((i & 0xff00ff00u) >> 8);
+	return static_cast<float>(i) * 2.3283064365386963e-10f;
+}
+// Hash the vertex index to a value in [0, 1), for the per-vertex shift of the ray set
+static float hash_unit(uint32_t x){
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return static_cast<float>(x >> 8) / 16777216.f;
+}
+
+std::vector<float> bake_vertex_ao(const std::vector<float> &vertices, size_t stride,
+		const std::vector<uint32_t> &triangles, const VertexAOParams &params, WorkStealingPool &pool)
+{
+	const BVH bvh{vertices, stride, triangles};
+	const size_t num_verts = vertices.size() / stride;
+	const int packets = std::max((params.rays + BVH_PACKET_SIZE - 1) / BVH_PACKET_SIZE, 1);
+	const int rays = packets * BVH_PACKET_SIZE;
+	// Start the rays just off the surface and skip hits right at their start so they don't hit
+	// the triangles around the vertex, or surfaces the vertex lies on
+	const float offset = 1e-4f * bvh.diagonal();
+	const float near = std::max(params.near, offset);
+	const float two_pi = 6.28318530718f;
+	const float far = params.far > 0.f ? params.far : 0.1f * bvh.diagonal();
+
+	std::vector<float> ao(num_verts, 1.f);
+	const int tasks = (num_verts + BAKE_VERTS_PER_TASK - 1) / BAKE_VERTS_PER_TASK;
+	pool.parallel_for(tasks, [&](int, int task){
+		alignas(32) float dx[BVH_PACKET_SIZE], dy[BVH_PACKET_SIZE], dz[BVH_PACKET_SIZE];
+		const size_t end = std::min(static_cast<size_t>(task + 1) * BAKE_VERTS_PER_TASK, num_verts);
+		for (size_t v = static_cast<size_t>(task) * BAKE_VERTS_PER_TASK; v < end; ++v){
+			const float *p = &vertices[v * stride];
+			float n[3] = {p[3], p[4], p[5]};
+			const float len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			if (!(len > 0.f)){
+				continue;
+			}
+			for (auto &x : n){
+				x /= len;
+			}
+			// Build a frame around the normal from the axis least aligned with it
+			float t[3];
+			if (std::abs(n[0]) < 0.9f){
+				t[0] = 0.f; t[1] = n[2]; t[2] = -n[1];
+			}
+			else {
+				t[0] = -n[2]; t[1] = 0.f; t[2] = n[0];
+			}
+			const float t_len = std::sqrt(t[0] * t[0] + t[1] * t[1] + t[2] * t[2]);
+			for (auto &x : t){
+				x /= t_len;
+			}
+			const float b[3] = {n[1] * t[2] - n[2] * t[1], n[2] * t[0] - n[0] * t[2], n[0] * t[1] - n[1] * t[0]};
+			const float origin[3] = {p[0] + offset * n[0], p[1] + offset * n[1], p[2] + offset * n[2]};
+
+			const float shift_u = hash_unit(2 * v), shift_v = hash_unit(2 * v + 1);
+			int occluded = 0;
+			for (int k = 0; k < packets; ++k){
+				for (int l = 0; l < BVH_PACKET_SIZE; ++l){
+					const int i = k * BVH_PACKET_SIZE + l;
+					float u = (i + 0.5f) / rays + shift_u;
+					float w = radical_inverse(i) + shift_v;
+					u -= std::floor(u);
+					w -= std::floor(w);
+					// Cosine weighted, so each ray counts equally towards the AO
+					const float r = std::sqrt(u);
+					const float phi = two_pi * w;
+					const float lx = r * std::cos(phi), ly = r * std::sin(phi);
+					const float lz = std::sqrt(std::max(1.f - u, 0.f));
+					dx[l] = lx * t[0] + ly * b[0] + lz * n[0];
+					dy[l] = lx * t[1] + ly * b[1] + lz * n[1];
+					dz[l] = lx * t[2] + ly * b[2] + lz * n[2];
+				}
+				const int hits = bvh.occluded(origin, dx, dy, dz, near, far);
+				for (int l = 0; l < BVH_PACKET_SIZE; ++l){
+					occluded += (hits >> l) & 1;
+				}
+			}
+			ao[v] = 1.f - static_cast<float>(occluded) / rays;
+		}
+	});
+	return ao;
+}
+std::string vertex_ao_path(const std::string &model_file){
+	const size_t ext = model_file.find_last_of('.');
+	const size_t dir_end = model_file.find_last_of("/\\");
+	if (ext == std::string::npos || (dir_end != std::string::npos && ext < dir_end)){
+		return model_file + ".aobake";
+	}
+	return model_file.substr(0, ext) + ".aobake";
+}
+uint64_t vertex_checksum(const std::vector<float> &vertices){
+	// 64 bit FNV-1a over the bytes of the vertex data
+	uint64_t hash = 14695981039346656037ull;
+	const unsigned char *bytes = reinterpret_cast<const unsigned char*>(vertices.data());
+	for (size_t i = 0; i < vertices.size() * sizeof(float); ++i){
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+bool save_vertex_ao(const std::string &file, uint64_t checksum, const std::vector<float> &ao){
+	std::ofstream fout{file, std::ios::binary};
+	if (!fout){
+		std::cout << "Failed to open " << file << " for writing\n";
+		return false;
+	}
+	const int32_t num_verts = ao.size();
+	fout.write("AOBK", 4);
+	fout.write(reinterpret_cast<const char*>(&num_verts), sizeof(num_verts));
+	fout.write(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+	fout.write(reinterpret_cast<const char*>(ao.data()), ao.size() * sizeof(float));
+	return static_cast<bool>(fout);
+}
+bool load_vertex_ao(const std::string &file, uint64_t checksum, size_t num_verts, std::vector<float> &ao){
+	std::ifstream fin{file, std::ios::binary};
+	if (!fin){
+		return false;
+	}
+	char tag[4];
+	int32_t file_verts = 0;
+	uint64_t file_checksum = 0;
+	fin.read(tag, 4);
+	fin.read(reinterpret_cast<char*>(&file_verts), sizeof(file_verts));
+	fin.read(reinterpret_cast<char*>(&file_checksum), sizeof(file_checksum));
+	if (!fin || std::memcmp(tag, "AOBK", 4) != 0){
+		std::cout << file << " is not a valid AO bake\n";
+		return false;
+	}
+	if (static_cast<size_t>(file_verts) != num_verts || file_checksum != checksum){
+		std::cout << file << " was baked for a different model or vertex order, ignoring it\n";
+		return false;
+	}
+	ao.resize(num_verts);
+	fin.read(reinterpret_cast<char*>(ao.data()), ao.size() * sizeof(float));
+	if (!fin){
+		std::cout << file << " is truncated\n";
+		return false;
+	}
+	return true;
+}
+
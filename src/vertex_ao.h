@@ -0,0 +1,50 @@
+#ifndef VERTEX_AO_H
+#define VERTEX_AO_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "thread_pool.h"
+
+// Settings for baking per-vertex AO, distances are in the model's units
+struct VertexAOParams {
+	// Rays traced per vertex, rounded up to a multiple of BVH_PACKET_SIZE
+	int rays;
+	// Occluders closer than near are skipped, e.g. to leave them to the screen space AO,
+	// and those further than far don't occlude. If far is <= 0 a tenth of the diagonal of the
+	// model's bounds is used
+	float near, far;
+};
+
+/*
+ * Bake the ambient occlusion at each vertex by tracing cosine weighted rays over the
+ * hemisphere around its normal against the triangles. The result is the fraction of the
+ * rays which didn't hit anything between near and far, so 1 is unoccluded. Vertices are
+ * interleaved with stride floats each, the position first and then the normal, and the
+ * triangles are triples of indices into them. The rays of each vertex follow a Hammersley
+ * set with a random shift per vertex so neighbouring vertices' noise doesn't line up
+ */
+std::vector<float> bake_vertex_ao(const std::vector<float> &vertices, size_t stride,
+		const std::vector<uint32_t> &triangles, const VertexAOParams &params, WorkStealingPool &pool);
+
+/*
+ * Get the path of the baked AO for the model file, the model's path with its
+ * extension replaced by .aobake
+ */
+std::string vertex_ao_path(const std::string &model_file);
+/*
+ * Hash the model's vertex data so a bake can be checked against the model it's
+ * loaded for, in case the model changed or was loaded with its vertices in a different order
+ */
+uint64_t vertex_checksum(const std::vector<float> &vertices);
+/*
+ * Save/load the baked AO, the file is an "AOBK" tag followed by the number of vertices as
+ * a 32 bit int, the checksum of the vertices it was baked for as a 64 bit int and then
+ * the AO values, all little endian. Loading fails if the bake doesn't match the checksum
+ * and vertex count passed
+ */
+bool save_vertex_ao(const std::string &file, uint64_t checksum, const std::vector<float> &ao);
+bool load_vertex_ao(const std::string &file, uint64_t checksum, size_t num_verts, std::vector<float> &ao);
+
+#endif
+